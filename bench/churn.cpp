@@ -0,0 +1,168 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+// Connection churn against a running server: every client connects, sends a single command, waits for its reply and
+// disconnects, the way short-lived clients such as PHP requests do. Reports connections per second, and how long each
+// one took from connect to reply.
+//
+//   churn_bench [--port 6379] [--unix-socket PATH] [--connections 20000]
+//
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string port{"6379"};
+        std::string unix_socket{};
+        size_t connections{20'000};
+    };
+
+    constexpr std::string_view request{"*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n"};
+    // the reply to GET on a key that was never set
+    constexpr std::string_view reply{"$-1\r\n"};
+
+    int connect_tcp(const addrinfo &address) {
+        const int fd = socket(address.ai_family, address.ai_socktype | SOCK_CLOEXEC, address.ai_protocol);
+        if (fd == -1) {
+            throw std::system_error(errno, std::system_category(), "socket");
+        }
+        if (connect(fd, address.ai_addr, address.ai_addrlen) == -1) {
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::system_category(), "connect");
+        }
+
+        constexpr int yes{1};
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        return fd;
+    }
+
+    int connect_unix(const std::string &path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::system_category(), "connect");
+        }
+        return fd;
+    }
+
+    // one short-lived client, start to finish
+    void visit(const int fd) {
+        if (write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size())) {
+            close(fd);
+            throw std::system_error(errno, std::system_category(), "write");
+        }
+
+        char buffer[64];
+        size_t received{0};
+        while (received < reply.size()) {
+            const ssize_t result = read(fd, buffer + received, sizeof(buffer) - received);
+            if (result <= 0) {
+                close(fd);
+                throw std::system_error(errno, std::system_category(), "read");
+            }
+            received += result;
+        }
+
+        close(fd);
+    }
+
+    void measure(const std::string_view name, const Options &options, const std::function<int()> &connect) {
+        for (size_t i{0}; i < std::min<size_t>(options.connections / 10, 1000); ++i) {
+            visit(connect());
+        }
+
+        std::vector<Clock::duration> latencies(options.connections);
+        const auto start = Clock::now();
+        for (auto &latency: latencies) {
+            const auto connected = Clock::now();
+            visit(connect());
+            latency = Clock::now() - connected;
+        }
+        const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+        std::ranges::sort(latencies);
+        const auto percentile = [&latencies](const double p) {
+            const auto latency = latencies[static_cast<size_t>(p * static_cast<double>(latencies.size() - 1))];
+            return std::chrono::duration<double, std::micro>(latency).count();
+        };
+
+        std::cout << std::format("{:<6} {:>10.0f} connections/s   connect to reply p50 {:>8.1f}us  p99 {:>8.1f}us\n",
+                                 name, static_cast<double>(options.connections) / elapsed.count(), percentile(0.5),
+                                 percentile(0.99));
+    }
+
+    bool parse(const std::string_view value, size_t &result) {
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+        return error == std::errc{} && end == value.data() + value.size();
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    Options options{};
+
+    for (int i{1}; i + 1 < argc; i += 2) {
+        const std::string_view flag{argv[i]};
+        const std::string_view value{argv[i + 1]};
+
+        bool valid{true};
+        if (flag == "--port") {
+            options.port = value;
+        } else if (flag == "--unix-socket") {
+            options.unix_socket = value;
+        } else if (flag == "--connections") {
+            valid = parse(value, options.connections) && options.connections > 0;
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << std::format("Invalid option '{} {}'\n", flag, value);
+            return 1;
+        }
+    }
+
+    try {
+        if (options.port != "0") {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo *address{};
+            if (getaddrinfo("localhost", options.port.c_str(), &hints, &address) != 0) {
+                throw std::runtime_error("getaddrinfo failed");
+            }
+
+            // the client's ends linger in TIME_WAIT, so a long run needs net.ipv4.tcp_tw_reuse or a wide port range
+            measure("tcp", options, [address] { return connect_tcp(*address); });
+            freeaddrinfo(address);
+        }
+        if (!options.unix_socket.empty()) {
+            measure("unix", options, [&options] { return connect_unix(options.unix_socket); });
+        }
+    } catch (const std::exception &error) {
+        std::cerr << std::format("Benchmark failed: {}\n", error.what());
+        return 1;
+    }
+}
@@ -0,0 +1,171 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+// The parsers on their own, without a server: decodes the same input with every delimiter scanning kernel the CPU
+// supports, and reports the cost per byte of input. The inputs are a pipeline of small GETs and SETs as a client
+// sends them, a pipeline of replies as a client reads them, long simple strings, where scanning for the end of the
+// line is all there is to do, and a single large value arriving a page at a time, sent as a SET and read as a reply.
+//
+//   parser_bench [--megabytes 16] [--rounds 5]
+//
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "command_parser.h"
+#include "resp_parser.h"
+#include "resp_scan.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        size_t megabytes{16};
+        size_t rounds{5};
+    };
+
+    // how much a client hands the parser at once, about what one recv returns
+    constexpr size_t chunk_size{16 * 1024};
+
+    std::string bulk(const std::string_view value) {
+        return std::format("${}\r\n{}\r\n", value.size(), value);
+    }
+
+    std::string commands(const size_t size) {
+        std::string data{};
+        for (size_t i{0}; data.size() < size; ++i) {
+            const std::string key = std::format("key:{}", i % 10'000);
+            data += i % 2 == 0
+                        ? "*2\r\n" + bulk("GET") + bulk(key)
+                        : "*3\r\n" + bulk("SET") + bulk(key) + bulk(std::string(16 + i % 48, 'v'));
+        }
+        return data;
+    }
+
+    std::string replies(const size_t size) {
+        std::string data{};
+        for (size_t i{0}; data.size() < size; ++i) {
+            data += i % 2 == 0 ? bulk(std::string(16 + i % 48, 'v')) : "+OK\r\n";
+        }
+        return data;
+    }
+
+    std::string large_value(const size_t size) {
+        return bulk(std::string(size, 'v'));
+    }
+
+    std::string large_set(const size_t size) {
+        return "*3\r\n" + bulk("SET") + bulk("key") + large_value(size);
+    }
+
+    std::string lines(const size_t size) {
+        std::string data{};
+        while (data.size() < size) {
+            data += "+" + std::string(1024, 'x') + "\r\n";
+        }
+        return data;
+    }
+
+    // feeds data in chunks and returns how many values came out, so none of the work can be left out
+    size_t decode_commands(const std::string &data, const size_t chunk = chunk_size) {
+        resp::CommandParser parser{};
+        size_t decoded{0};
+        for (size_t offset{0}; offset < data.size(); offset += chunk) {
+            parser.feed(std::span{data}.subspan(offset, std::min(chunk, data.size() - offset)));
+            while (const auto arguments = parser.next()) {
+                decoded += arguments->size();
+            }
+            parser.keep();
+        }
+        return decoded;
+    }
+
+    size_t decode_values(const std::string &data, const size_t chunk = chunk_size) {
+        resp::Parser parser{};
+        size_t decoded{0};
+        for (size_t offset{0}; offset < data.size(); offset += chunk) {
+            parser.feed(std::span{data}.subspan(offset, std::min(chunk, data.size() - offset)));
+            decoded += parser.take_values().size();
+        }
+        return decoded;
+    }
+
+    void measure(const std::string_view name, const std::string &data, const Options &options,
+                 const std::function<size_t(const std::string &)> &decode) {
+        std::string results{};
+        size_t expected{0};
+
+        for (const resp::ScanKernel kernel: {resp::ScanKernel::scalar, resp::ScanKernel::sse2, resp::ScanKernel::avx2}) {
+            if (!resp::set_scan_kernel(kernel)) {
+                continue;
+            }
+
+            // the best of a few rounds, so a stray interruption does not count
+            Clock::duration best{Clock::duration::max()};
+            for (size_t round{0}; round < options.rounds; ++round) {
+                const auto start = Clock::now();
+                const size_t decoded = decode(data);
+                best = std::min(best, Clock::now() - start);
+
+                if (expected != 0 && decoded != expected) {
+                    std::cerr << std::format("{} decoded {} values with {}, {} with the others\n", name, decoded,
+                                             resp::to_string(kernel), expected);
+                }
+                expected = decoded;
+            }
+
+            const std::chrono::duration<double, std::nano> elapsed = best;
+            results += std::format("  {:>6} {:6.3f}ns/byte {:8.0f}MB/s", resp::to_string(kernel),
+                                   elapsed.count() / static_cast<double>(data.size()),
+                                   static_cast<double>(data.size()) / elapsed.count() * 1e3);
+        }
+
+        resp::set_scan_kernel(resp::best_scan_kernel());
+        std::cout << std::format("{:<10}{}\n", name, results);
+    }
+
+    bool parse(const std::string_view value, size_t &result) {
+        const auto [last, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+        return error == std::errc{} && last == value.data() + value.size();
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    Options options{};
+
+    for (int i{1}; i + 1 < argc; i += 2) {
+        const std::string_view flag{argv[i]};
+        const std::string_view value{argv[i + 1]};
+
+        bool valid{true};
+        if (flag == "--megabytes") {
+            valid = parse(value, options.megabytes) && options.megabytes > 0;
+        } else if (flag == "--rounds") {
+            valid = parse(value, options.rounds) && options.rounds > 0;
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << std::format("Invalid option '{} {}'\n", flag, value);
+            return 1;
+        }
+    }
+
+    const size_t size{options.megabytes * 1024 * 1024};
+    measure("commands", commands(size), options, [](const std::string &data) { return decode_commands(data); });
+    measure("replies", replies(size), options, [](const std::string &data) { return decode_values(data); });
+    measure("lines", lines(size), options, [](const std::string &data) { return decode_values(data); });
+
+    // a page at a time, the way a large value trickles in
+    constexpr size_t page{4096};
+    measure("large set", large_set(size), options, [](const std::string &data) { return decode_commands(data, page); });
+    measure("large get", large_value(size), options, [](const std::string &data) { return decode_values(data, page); });
+}
@@ -0,0 +1,225 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+// Round trips against a running server over each transport it listens on: TCP, a unix domain socket and a shared
+// memory channel. Every round trip sends a pipeline of GETs and waits for all of their replies.
+//
+//   transport_bench [--port 6379] [--unix-socket PATH] [--shm-socket PATH] [--requests 100000] [--pipeline 1]
+//                   [--spin-us 0]
+//
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "resp_parser.h"
+#include "shm_client.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string port{"6379"};
+        std::string unix_socket{};
+        std::string shm_socket{};
+        size_t requests{100'000};
+        size_t pipeline{1};
+        std::chrono::nanoseconds spin{};
+    };
+
+    // a blocking RESP client over a stream socket
+    class SocketClient {
+    public:
+        explicit SocketClient(const int socket): m_socket{socket} {
+        }
+
+        ~SocketClient() { close(m_socket); }
+
+        void send(const std::string &request) const {
+            for (size_t sent{0}; sent < request.size();) {
+                const ssize_t result = write(m_socket, request.data() + sent, request.size() - sent);
+                if (result <= 0) {
+                    throw std::system_error(errno, std::system_category(), "write");
+                }
+                sent += result;
+            }
+        }
+
+        void receive(const size_t replies) {
+            while (m_received < replies) {
+                const ssize_t result = read(m_socket, m_buffer, sizeof(m_buffer));
+                if (result <= 0) {
+                    throw std::system_error(errno, std::system_category(), "read");
+                }
+                m_parser.feed({m_buffer, static_cast<size_t>(result)});
+                m_received += m_parser.take_values().size();
+            }
+            m_received -= replies;
+        }
+
+    private:
+        int m_socket;
+        resp::Parser m_parser{};
+        size_t m_received{0};
+        char m_buffer[64 * 1024]{};
+    };
+
+    int connect_tcp(const std::string &port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *result{};
+        if (getaddrinfo("localhost", port.c_str(), &hints, &result) != 0) {
+            throw std::runtime_error("getaddrinfo failed");
+        }
+
+        const int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+        const int connected = connect(fd, result->ai_addr, result->ai_addrlen);
+        freeaddrinfo(result);
+        if (connected == -1) {
+            throw std::system_error(errno, std::system_category(), "connect");
+        }
+
+        constexpr int yes{1};
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        return fd;
+    }
+
+    int connect_unix(const std::string &path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+            throw std::system_error(errno, std::system_category(), "connect");
+        }
+        return fd;
+    }
+
+    // times every round trip, and reports throughput and latency percentiles
+    void measure(const std::string_view name, const Options &options, const std::function<void()> &round_trip) {
+        const size_t round_trips = std::max<size_t>(options.requests / options.pipeline, 1);
+        for (size_t i{0}; i < std::min<size_t>(round_trips / 10, 1000); ++i) {
+            round_trip();
+        }
+
+        std::vector<Clock::duration> latencies(round_trips);
+        const auto start = Clock::now();
+        for (auto &latency: latencies) {
+            const auto sent = Clock::now();
+            round_trip();
+            latency = Clock::now() - sent;
+        }
+        const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+        std::ranges::sort(latencies);
+        const auto percentile = [&latencies](const double p) {
+            const auto latency = latencies[static_cast<size_t>(p * static_cast<double>(latencies.size() - 1))];
+            return std::chrono::duration<double, std::micro>(latency).count();
+        };
+
+        std::cout << std::format("{:<6} {:>12.0f} requests/s   round trip p50 {:>8.1f}us  p99 {:>8.1f}us  "
+                                 "p99.9 {:>8.1f}us\n", name,
+                                 static_cast<double>(round_trips * options.pipeline) / elapsed.count(),
+                                 percentile(0.5), percentile(0.99), percentile(0.999));
+    }
+
+    void measure_socket(const std::string_view name, const int fd, const Options &options) {
+        SocketClient client{fd};
+
+        client.send("*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n");
+        client.receive(1);
+
+        std::string pipeline{};
+        for (size_t i{0}; i < options.pipeline; ++i) {
+            pipeline += "*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n";
+        }
+
+        measure(name, options, [&] {
+            client.send(pipeline);
+            client.receive(options.pipeline);
+        });
+    }
+
+    void measure_shm(const Options &options) {
+        ShmClient client{options.shm_socket, options.spin};
+        client.execute({"SET", "key", "value"});
+
+        measure("shm", options, [&] {
+            for (size_t i{0}; i < options.pipeline; ++i) {
+                client.send({"GET", "key"});
+            }
+            for (size_t i{0}; i < options.pipeline; ++i) {
+                client.receive();
+            }
+        });
+    }
+
+    template<typename T>
+    bool parse(const std::string_view value, T &result) {
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+        return error == std::errc{} && end == value.data() + value.size();
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    Options options{};
+
+    for (int i{1}; i + 1 < argc; i += 2) {
+        const std::string_view flag{argv[i]};
+        const std::string_view value{argv[i + 1]};
+        size_t spin_us{};
+
+        bool valid{true};
+        if (flag == "--port") {
+            options.port = value;
+        } else if (flag == "--unix-socket") {
+            options.unix_socket = value;
+        } else if (flag == "--shm-socket") {
+            options.shm_socket = value;
+        } else if (flag == "--requests") {
+            valid = parse(value, options.requests) && options.requests > 0;
+        } else if (flag == "--pipeline") {
+            valid = parse(value, options.pipeline) && options.pipeline > 0;
+        } else if (flag == "--spin-us") {
+            valid = parse(value, spin_us);
+            options.spin = std::chrono::microseconds{spin_us};
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << std::format("Invalid option '{} {}'\n", flag, value);
+            return 1;
+        }
+    }
+
+    try {
+        if (options.port != "0") {
+            measure_socket("tcp", connect_tcp(options.port), options);
+        }
+        if (!options.unix_socket.empty()) {
+            measure_socket("unix", connect_unix(options.unix_socket), options);
+        }
+        if (!options.shm_socket.empty()) {
+            measure_shm(options);
+        }
+    } catch (const std::exception &error) {
+        std::cerr << std::format("Benchmark failed: {}\n", error.what());
+        return 1;
+    }
+}
@@ -5,27 +5,61 @@
 #ifndef ACCEPTOR_H
 #define ACCEPTOR_H
 #include <unistd.h>
+#include <vector>
 
+#include "connection.h"
+#include "connection_pool.h"
 #include "event_loop.h"
 #include "request_handler.h"
 
 
 class Acceptor final : public EventLoop::Handler {
 public:
-    Acceptor(const int socket, EventLoop &event_loop, RequestHandler &request_handler): m_socket{socket},
-        m_event_loop{event_loop}, m_request_handler{request_handler} {
+    // a shared memory acceptor offers every client a channel and serves it through that rather than the socket
+    Acceptor(const int socket, EventLoop &event_loop, RequestHandler &request_handler,
+             ConnectionPool &connection_pool, const Connection::Options &connection_options = {},
+             const bool shared_memory = false): m_socket{socket}, m_event_loop{event_loop},
+                                                m_request_handler{request_handler},
+                                                m_connection_pool{connection_pool},
+                                                m_connection_options{connection_options},
+                                                m_shared_memory{shared_memory} {
     }
 
     ~Acceptor() override {
+        for (const int socket: m_held) {
+            close(socket);
+        }
         close(m_socket);
     }
 
     void handle(uint32_t events) override;
 
+    void handle_accepted(int socket) override;
+
 private:
+    static constexpr size_t max_accepts_per_wakeup{64};
+
     int m_socket{-1};
     EventLoop &m_event_loop;
     RequestHandler &m_request_handler;
+    ConnectionPool &m_connection_pool;
+    Connection::Options m_connection_options{};
+    bool m_shared_memory{false};
+    // cleared once the kernel refuses to let client sockets busy poll, so it is only complained about once
+    bool m_socket_busy_poll{true};
+    // for a multishot accept, which reports connections one by one: the loop iteration they are counted for as one
+    // wakeup, how many of them there have been, and those past the cap, which wait for the iteration's other
+    // completions
+    uint64_t m_wakeup_iteration{0};
+    size_t m_wakeup_accepts{0};
+    std::vector<int> m_held{};
+
+    void add_connection(int socket);
+
+    void add_held();
+
+    // has the kernel poll the device queue for the socket's data for as long as the event loop spins
+    void set_busy_poll(int socket);
 };
 
 
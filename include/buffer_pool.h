@@ -0,0 +1,31 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <vector>
+
+// Byte buffers lent out to the connections of one event loop while they have replies to send, so that a connection
+// with nothing in flight holds no buffer of its own. Not thread-safe; each loop has its own.
+class BufferPool {
+public:
+    // an empty buffer, with whatever capacity it was returned with
+    std::vector<char> acquire();
+
+    void release(std::vector<char> buffer);
+
+    [[nodiscard]] size_t size() const { return m_buffers.size(); }
+
+private:
+    static constexpr size_t max_buffers{256};
+    // a buffer that grew past this for one large reply is freed rather than kept for everyone
+    static constexpr size_t max_capacity{64 * 1024};
+
+    std::vector<std::vector<char> > m_buffers{};
+};
+
+
+#endif //BUFFER_POOL_H
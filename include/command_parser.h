@@ -0,0 +1,91 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace resp {
+    // Decodes client commands, arrays of bulk strings, into a flat argv of string_views that point straight into the
+    // data they arrived in, so no argument is copied or allocated on its own. Data is decoded where the caller received
+    // it; only what is still pending when the caller needs its buffer back is copied into the parser's own. A command
+    // that arrives in pieces is picked up where decoding stopped, rather than decoded from the start again.
+    class CommandParser {
+    public:
+        using Arguments = std::span<const std::string_view>;
+
+        // buffer_limit is how much memory an emptied buffer may keep for the next incomplete command
+        explicit CommandParser(const size_t buffer_limit = 0): m_buffer_limit{buffer_limit} {
+        }
+
+        // data must stay put until keep is called
+        void feed(std::span<const char> data);
+
+        // the next complete command, if one has arrived. the arguments are good until the next call to any of these
+        std::optional<Arguments> next();
+
+        // copies whatever has not been decoded yet into the parser's own buffer, since the caller is about to reuse
+        // the data it fed in
+        void keep();
+
+        // where the next command starts, to come back to with rewind as long as nothing is fed or kept in between
+        [[nodiscard]] size_t mark() const { return m_position; }
+
+        // makes whatever was decoded since mark undecoded again, an error found in it included
+        void rewind(size_t mark);
+
+        // whether anything fed in has not been decoded yet, a complete command or not
+        [[nodiscard]] bool pending() const { return m_position < m_input.size(); }
+
+        // set once the client has broken the protocol; nothing after that is decoded
+        [[nodiscard]] const std::optional<std::string> &error() const { return m_error; }
+
+        [[nodiscard]] size_t memory_usage() const {
+            return m_buffer.capacity() + m_arguments.capacity() * sizeof(std::string_view) +
+                   m_slices.capacity() * sizeof(Slice);
+        }
+
+    private:
+        // the same limits redis puts on clients, so a bogus length cannot have us reserve memory for it
+        static constexpr size_t max_arguments{1024 * 1024};
+        static constexpr size_t max_bulk_length{512 * 1024 * 1024};
+        // a length line that runs on for longer than this is not a length
+        static constexpr size_t max_line_length{32};
+
+        std::vector<char> m_buffer{};
+        // what is being decoded: either the caller's data or the buffer above
+        std::span<const char> m_input{};
+        bool m_buffered{false};
+        size_t m_position{0};
+        std::vector<std::string_view> m_arguments{};
+        // an argument of the command being decoded, relative to where the command starts, since the data may move
+        // before the rest of the command arrives
+        struct Slice {
+            size_t offset;
+            size_t size;
+        };
+
+        // how far decoding got into a command that has not fully arrived yet: how many arguments it has, those
+        // decoded so far, where to carry on from, and how many bytes the whole command needs at least
+        size_t m_count{0};
+        std::vector<Slice> m_slices{};
+        size_t m_resume{0};
+        size_t m_needed{0};
+        std::optional<std::string> m_error{};
+        size_t m_buffer_limit{};
+
+        // the length following the type byte at position, or nothing when the line is not complete yet; moves
+        // position past the line
+        std::optional<int64_t> decode_length(size_t &position, char type, std::string_view what);
+
+        void fail(std::string message);
+    };
+}
+
+#endif //COMMAND_PARSER_H
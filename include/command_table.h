@@ -0,0 +1,182 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace commands {
+    // more than any command could have arguments for
+    constexpr size_t max_key_count{1'000'000'000};
+
+    enum Flag : uint8_t {
+        // reads the keys it is given, so a tracking client may cache the reply
+        read = 1 << 0,
+        write = 1 << 1,
+        admin = 1 << 2,
+        // about the connection itself rather than any data, so it is never forwarded to another shard
+        connection = 1 << 3,
+        // runs as soon as it arrives even after MULTI, rather than being queued for EXEC
+        transaction = 1 << 4,
+        // about every shard's data, so with several shards it runs on each of them
+        all_shards = 1 << 5,
+        // cannot be called from a function
+        noscript = 1 << 6,
+    };
+
+    // a count of keys among the arguments, or 0 when it is not one
+    constexpr size_t parse_count(const std::string_view argument) {
+        size_t count{0};
+        for (const char c: argument) {
+            if (c < '0' || c > '9' || count > max_key_count) {
+                return 0;
+            }
+            count = count * 10 + static_cast<size_t>(c - '0');
+        }
+        return count;
+    }
+
+    // what is known about a command before it runs, laid out the way redis' COMMAND INFO reports it
+    struct Spec {
+        // lowercase, and letters only
+        std::string_view name;
+        // the number of arguments, the name included, or when negative, the least there may be
+        int arity;
+        uint8_t flags;
+        // where the keys are: every step-th argument from first_key up to last_key, which counts from the end when
+        // negative. no keys at all when first_key is 0
+        int first_key;
+        int last_key;
+        int step;
+        // for the commands that say how many keys they have, such as FCALL, where that count is. the keys follow it
+        int key_count{0};
+
+        [[nodiscard]] constexpr bool accepts(const size_t arguments) const {
+            return arity >= 0 ? arguments == static_cast<size_t>(arity) : arguments >= static_cast<size_t>(-arity);
+        }
+
+        [[nodiscard]] constexpr bool has(const Flag flag) const { return (flags & flag) != 0; }
+
+        // calls f with each key among arguments, which have already been checked against the arity
+        template<typename F>
+        constexpr void for_each_key(const std::span<const std::string_view> arguments, F &&f) const {
+            if (key_count != 0) {
+                const auto position = static_cast<size_t>(key_count);
+                const size_t count = position < arguments.size() ? parse_count(arguments[position]) : 0;
+                for (size_t i{position + 1}; i <= position + count && i < arguments.size(); ++i) {
+                    f(arguments[i]);
+                }
+                return;
+            }
+
+            if (first_key == 0) {
+                return;
+            }
+
+            const auto last = last_key >= 0
+                                  ? static_cast<size_t>(last_key)
+                                  : arguments.size() - static_cast<size_t>(-last_key);
+            for (auto i = static_cast<size_t>(first_key); i <= last && i < arguments.size();
+                 i += static_cast<size_t>(step)) {
+                f(arguments[i]);
+            }
+        }
+    };
+
+    template<typename Handler>
+    struct Command : Spec {
+        Handler handler;
+    };
+
+    // FNV-1a over the name with every letter folded to lowercase, so the lookup does not have to fold it first. a
+    // character that is not a letter may collide with one that is, which the comparison after the lookup sorts out
+    constexpr uint32_t hash(const std::string_view name, const uint32_t seed) {
+        uint32_t hash{2166136261u ^ seed};
+        for (const char c: name) {
+            hash = (hash ^ static_cast<uint8_t>(c | 0x20)) * 16777619u;
+        }
+        return hash;
+    }
+
+    // whether name is command, in any case; the command being letters only, folding one bit is enough
+    constexpr bool iequals(const std::string_view name, const std::string_view command) {
+        if (name.size() != command.size()) {
+            return false;
+        }
+        for (size_t i{0}; i < name.size(); ++i) {
+            if ((name[i] | 0x20) != command[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Every command a server knows, in a table built at compile time: a seed is searched for that hashes each name
+    // to a slot of its own, so a lookup is one hash, one slot and one comparison, whatever the case of the name.
+    template<typename Handler, size_t N>
+    class Table {
+    public:
+        consteval explicit Table(const std::array<Command<Handler>, N> &commands): m_commands{commands} {
+            for (const Command<Handler> &command: m_commands) {
+                for (const char c: command.name) {
+                    if (c < 'a' || c > 'z') {
+                        throw "command names must be lowercase letters";
+                    }
+                }
+            }
+
+            for (uint32_t seed{0}; seed < max_seeds; ++seed) {
+                if (try_seed(seed)) {
+                    return;
+                }
+            }
+            throw "no seed hashes every command to a slot of its own";
+        }
+
+        // the command called name, in any case, or none
+        [[nodiscard]] constexpr const Command<Handler> *find(const std::string_view name) const {
+            const uint8_t slot = m_slots[hash(name, m_seed) & (slots - 1)];
+            if (slot == 0) {
+                return nullptr;
+            }
+
+            const Command<Handler> &command = m_commands[slot - 1];
+            return iequals(name, command.name) ? &command : nullptr;
+        }
+
+        [[nodiscard]] constexpr std::span<const Command<Handler>, N> all() const { return m_commands; }
+
+    private:
+        // a sparse table takes few seeds to find one without collisions
+        static constexpr size_t slots{std::bit_ceil(N * 4)};
+        static constexpr uint32_t max_seeds{1 << 16};
+        static_assert(N < 255, "slots hold a command's index in a byte");
+
+        std::array<Command<Handler>, N> m_commands;
+        // each slot holds the index of its command plus one, or 0 when empty
+        std::array<uint8_t, slots> m_slots{};
+        uint32_t m_seed{0};
+
+        consteval bool try_seed(const uint32_t seed) {
+            m_slots = {};
+            for (size_t i{0}; i < N; ++i) {
+                uint8_t &slot = m_slots[hash(m_commands[i].name, seed) & (slots - 1)];
+                if (slot != 0) {
+                    return false;
+                }
+                slot = static_cast<uint8_t>(i + 1);
+            }
+
+            m_seed = seed;
+            return true;
+        }
+    };
+}
+
+#endif //COMMAND_TABLE_H
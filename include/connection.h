@@ -5,46 +5,283 @@
 #ifndef CONNECTION_H
 #define CONNECTION_H
 
-#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <new>
 #include <unistd.h>
 #include <vector>
+#include <sys/socket.h>
 
 #include "event_loop.h"
+#include "output_buffer.h"
+#include "command_parser.h"
 #include "request_handler.h"
-#include "resp_parser.h"
+#include "shm_channel.h"
 
-class RequestHandler;
+class ConnectionPool;
 
-class Connection final : public EventLoop::Handler {
+class Connection final : public EventLoop::Handler, public RequestHandler::Client {
 public:
-    Connection(const int socket, RequestHandler &request_handler, EventLoop &event_loop): m_request_handler{
-            request_handler
-        },
-        m_event_loop{event_loop}, m_socket{socket} {
+    // zero turns any of these off
+    struct Options {
+        // disconnects the client once it has not sent anything for this long
+        std::chrono::seconds idle_timeout{0};
+        // how many commands, and how many bytes read, one client gets per loop iteration before it has to let the
+        // other clients have their turn. with io_uring the bytes arrive a whole receive at a time, so the one that
+        // overruns the budget is still served, and only what comes after it waits
+        size_t command_budget{0};
+        size_t byte_budget{0};
+    };
+
+    // with a channel, requests and replies go through its rings, and the socket is only watched for the client going
+    // away
+    Connection(const int socket, RequestHandler &request_handler, EventLoop &event_loop, const Options &options,
+               std::unique_ptr<ShmChannel> channel = nullptr): Connection{
+        socket, request_handler, event_loop, options, std::move(channel), nullptr, nullptr
+    } {
     }
 
     ~Connection() override {
+        // the token may have been taken back by the pool already, for the next connection
+        if (m_self) {
+            *m_self = nullptr;
+        }
+        --m_event_loop.stats().connected_clients;
         close(m_socket);
     }
 
+    // a pooled connection hands its storage back to the pool rather than freeing it
+    void operator delete(Connection *connection, std::destroying_delete_t);
+
     void handle(uint32_t events) override;
 
-    void send(const resp::Value &value);
+    void handle_received(std::span<const char> data) override;
+
+    void handle_sent(ssize_t bytes_sent) override;
+
+    void io_receive(std::span<char> buffer) override;
+
+    void io_send() override;
+
+    void handle_io_received() override;
+
+    void handle_io_sent() override;
+
+    // the client has written to the channel, or made room in it
+    void handle_doorbell();
+
+    void send(const resp::Value &value) override;
+
+    [[nodiscard]] size_t memory_usage() const override;
+
+    // holds back further requests while one is being served by another shard, so replies stay in order
+    void suspend() { m_suspended = true; }
+
+    void resume();
+
+    // cleared once the connection goes away; lets replies that arrive late tell whether anyone is still listening
+    [[nodiscard]] std::shared_ptr<Connection *> self() const { return m_self; }
+
+    // unique among the server's connections, for HELLO and CLIENT ID
+    [[nodiscard]] uint64_t id() const { return m_id; }
+
+    [[nodiscard]] resp::Protocol protocol() const { return m_protocol; }
+
+    // replies from here on are sent in protocol
+    void set_protocol(resp::Protocol protocol);
+
+    // client side caching, see CLIENT TRACKING: whether the client is told about the keys it has read changing, or
+    // about every key under the prefixes it has subscribed to
+    enum class Tracking {
+        off,
+        on,
+        broadcast,
+    };
+
+    [[nodiscard]] Tracking tracking() const { return m_tracking; }
+
+    void set_tracking(const Tracking tracking) { m_tracking = tracking; }
+
+    // pushes an invalidation for key, or for every key, if the client is still tracking
+    void invalidate(std::optional<std::string_view> key);
+
+    // see CLIENT REPLY: whether the replies of the commands that follow are sent, or dropped before they are even
+    // serialized, for all of them or just the next one
+    enum class Reply {
+        on,
+        off,
+        skip,
+    };
+
+    // ON takes effect for the command setting it, which then gets its reply
+    void set_reply(const Reply reply) {
+        m_reply = reply;
+        if (reply == Reply::on) {
+            m_muted = false;
+        }
+    }
+
+    [[nodiscard]] RequestHandler::Transaction &transaction() { return m_transaction; }
 
 private:
-    static constexpr int buffer_size{4096};
-    resp::Parser m_parser{};
+    friend class ConnectionPool;
+
+    // iovecs handed to a single send
+    static constexpr size_t max_iovecs{64};
+    // how many pipelined commands are decoded ahead of running them, for the keys of all of them to be prefetched
+    static constexpr size_t batch_size{16};
+
+    // how far a receive got before it stopped
+    enum class Received {
+        drained,
+        yielded,
+        out_of_budget,
+        closed,
+    };
+
+    // and a send
+    enum class Sent {
+        all,
+        would_block,
+        failed,
+    };
+
+    // decodes requests where they were received; whatever it has not decoded yet, because the connection is suspended
+    // or yielded or the rest has not arrived, it keeps for later
+    resp::CommandParser m_parser{};
+    // the commands decoded ahead: the arguments of each, one after the other, and for each, where it starts in the
+    // parser, to go back to if it is not run after all, and where its arguments end
+    struct Decoded {
+        size_t mark;
+        size_t end;
+    };
+
+    std::vector<std::string_view> m_batch_arguments{};
+    std::vector<Decoded> m_batch{};
+    size_t m_batch_next{0};
     RequestHandler &m_request_handler;
     EventLoop &m_event_loop;
     int m_socket{};
-    std::array<char, buffer_size> m_read_buffer{};
-    std::vector<char> m_write_buffer{};
-    size_t m_bytes_sent{0};
-    size_t m_bytes_remaining{0};
+    std::unique_ptr<ShmChannel> m_channel{};
+    // both only hold memory while there is something to send. the loop's pool is not thread-safe, so with I/O threads
+    // filling the write buffer, it allocates for itself
+    OutputBuffer m_write_buffer{m_event_loop.offloading() ? nullptr : &m_event_loop.buffers()};
+    // completion-based loops only: the replies handed to the kernel, left untouched until the send completes
+    OutputBuffer m_send_buffer{&m_event_loop.buffers()};
+    std::vector<iovec> m_iovecs{};
+    msghdr m_message{};
+    bool m_sending{false};
+    // write readiness is only subscribed to while the kernel's send buffer is full, or with a channel, waited for while
+    // its ring is
+    bool m_writable_armed{false};
+    // with I/O threads: replies waiting to be serialized on one of them
+    std::vector<resp::Value> m_replies{};
+    // with I/O threads: queued for the next batch, and how the last one went
+    bool m_receive_offloaded{false};
+    bool m_send_offloaded{false};
+    Received m_io_received{Received::drained};
+    Sent m_io_sent{Sent::all};
+    std::shared_ptr<Connection *> m_self{};
+    // out of budget for this loop iteration, and waiting for the next to carry on
+    bool m_yielded{false};
+    // told it has broken the protocol: nothing more is read from the client, and it is hung up on once everything it
+    // has been sent is out
+    bool m_closing{false};
+    // the loop iteration the budget below was handed out for
+    uint64_t m_budget_iteration{0};
+    size_t m_commands_left{0};
+    // for a completion-based loop, which hands over what was received rather than being asked to read it
+    size_t m_bytes_left{0};
+    bool m_suspended{false};
+    Options m_options{};
+    TimerWheel::Clock::time_point m_last_active{};
+    // rather than being pushed back on every request, the idle timer lets itself out and checks when it fires
+    TimerWheel::Id m_idle_timer{0};
+    // where the connection's storage goes once it is destroyed; nowhere but the heap when there is no pool
+    ConnectionPool *m_pool{nullptr};
+    uint64_t m_id{};
+    resp::Protocol m_protocol{resp::Protocol::resp2};
+    Tracking m_tracking{Tracking::off};
+    Reply m_reply{Reply::on};
+    // the command being run has its replies dropped
+    bool m_muted{false};
+    RequestHandler::Transaction m_transaction{};
+
+    // self is a token left behind by an earlier connection, or none
+    Connection(int socket, RequestHandler &request_handler, EventLoop &event_loop, const Options &options,
+               std::unique_ptr<ShmChannel> channel, ConnectionPool *pool, std::shared_ptr<Connection *> self)
+        : m_request_handler{request_handler}, m_event_loop{event_loop}, m_socket{socket},
+          m_channel{std::move(channel)}, m_self{self ? std::move(self) : std::make_shared<Connection *>()},
+          m_options{options}, m_last_active{event_loop.now()}, m_pool{pool}, m_id{next_id()} {
+        *m_self = this;
+        ++m_event_loop.stats().connected_clients;
+        if (m_options.idle_timeout > std::chrono::seconds::zero()) {
+            schedule_idle_check(m_options.idle_timeout);
+        }
+        if (m_channel) {
+            add_doorbell();
+        }
+    }
+
+    static uint64_t next_id();
+
+    void dispatch(bool writable, bool readable);
+
+    // hands a reply, or a push, to the write buffer or the I/O threads
+    void queue(const resp::Value &value);
 
     void handle_receive();
 
     void handle_send();
+
+    // reads until the socket is drained or the connection has to stop, passing on the data as it comes in
+    Received receive(std::span<char> buffer, const std::function<void(std::span<const char>)> &consume);
+
+    void finish_receive(Received received);
+
+    // sends the write buffer until it is empty or the socket's is full
+    Sent send_written();
+
+    void finish_send(Sent sent);
+
+    // serves the requests in data, and keeps the rest
+    void process(std::span<const char> data);
+
+    // serves the requests the parser holds for as long as the connection is neither suspended nor out of budget
+    void execute();
+
+    // the next command to run, from the batch decoded ahead, which is decoded first when it has run out
+    std::optional<RequestHandler::Arguments> next_command();
+
+    void decode_batch();
+
+    // hands whatever was decoded ahead but not run back to the parser, to decode again once the connection carries on
+    void drop_batch();
+
+    // hands out this iteration's budget the first time it is asked about
+    void renew_budget();
+
+    // whether this iteration's budget has a command left
+    bool has_budget();
+
+    void spend_budget();
+
+    // lets the other connections have their turn, and picks up again on the next loop iteration
+    void yield();
+
+    void flush();
+
+    // completion-based loops only: sends what is left of the send buffer
+    void send_buffered();
+
+    void disconnect();
+
+    void add_doorbell();
+
+    void schedule_idle_check(TimerWheel::Clock::duration delay);
+
+    void check_idle();
 };
 
 
@@ -0,0 +1,45 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <memory>
+#include <vector>
+
+#include "connection.h"
+
+// What the connections of one event loop leave behind once their clients have gone, their storage and their liveness
+// tokens, handed on to the clients that connect next, so that a client that connects, sends a command and disconnects
+// again costs no allocations for the connection itself. Not thread-safe; each shard has its own, and it must outlive
+// the connections it hands out.
+class ConnectionPool {
+public:
+    ConnectionPool() = default;
+
+    ConnectionPool(const ConnectionPool &) = delete;
+
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+    ~ConnectionPool();
+
+    // a connection that goes back to the pool once it is deleted
+    std::unique_ptr<Connection> acquire(int socket, RequestHandler &request_handler, EventLoop &event_loop,
+                                        const Connection::Options &options,
+                                        std::unique_ptr<ShmChannel> channel = nullptr);
+
+    // takes back the storage of a destroyed connection, and its token if nobody else holds on to it
+    void release(void *storage, std::shared_ptr<Connection *> self);
+
+    [[nodiscard]] size_t size() const { return m_storage.size(); }
+
+private:
+    static constexpr size_t max_connections{1024};
+
+    std::vector<void *> m_storage{};
+    std::vector<std::shared_ptr<Connection *> > m_tokens{};
+};
+
+
+#endif //CONNECTION_POOL_H
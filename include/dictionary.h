@@ -5,7 +5,9 @@
 #ifndef DICTIONARY_H
 #define DICTIONARY_H
 #include <expected>
+#include <functional>
 #include <mutex>
+#include <string_view>
 #include <unordered_map>
 
 #include "resp_parser.h"
@@ -15,23 +17,60 @@ using Timestamp = std::chrono::time_point<Clock>;
 
 class Dictionary {
 public:
-    std::optional<std::reference_wrapper<resp::Value> > get(const std::string &key);
+    // told about every change made to the dictionary, after it is made, expiry included
+    class Observer {
+    public:
+        virtual ~Observer() = default;
 
-    void set(const std::string &key, const resp::Value &value, const std::optional<Timestamp> &expiry = std::nullopt);
+        virtual void modified(std::string_view key) = 0;
 
-    std::optional<resp::Value> set_and_get(const std::string &key,
-                                           const resp::Value &value,
+        virtual void flushed() = 0;
+    };
+
+    // one observer at a time, or none
+    void observe(Observer *observer) { m_observer = observer; }
+
+    // strings from this long up are stored encoded the way they are sent, so a read replies with a single copy, or no
+    // copy at all, of the stored bytes. zero encodes every string, for read-heavy data sets
+    void set_encode_threshold(const size_t threshold) { m_encode_threshold = threshold; }
+
+    // contents as this dictionary stores a string, to be handed to set
+    [[nodiscard]] resp::Value string_value(const std::string_view contents) const {
+        return resp::string_value(contents, m_encode_threshold);
+    }
+
+    // keys are only copied when an entry is created for them
+    std::optional<std::reference_wrapper<resp::Value> > get(std::string_view key);
+
+    // starts loading the memory a lookup of key reads, without waiting for it, so that looking up several keys one
+    // after the other only waits for memory about once rather than once per key
+    void prefetch(std::string_view key) const;
+
+    // whether the entries are too many to stay in the cache, below which prefetching them is just more work
+    [[nodiscard]] bool worth_prefetching() const { return m_map.size() >= prefetch_entries; }
+
+    void set(std::string_view key, resp::Value value, const std::optional<Timestamp> &expiry = std::nullopt);
+
+    std::optional<resp::Value> set_and_get(std::string_view key,
+                                           resp::Value value,
                                            const std::optional<Timestamp> &expiry = std::nullopt);
 
     void flush();
 
-    bool exists(const std::string &key);
+    bool exists(std::string_view key);
 
-    void del(const std::string &key);
+    // for WATCH: a stamp that changes whenever the entry for key does. while there is none, it is the stamp of the
+    // last deletion of any key, so a key that comes and goes in the meantime is noticed all the same, at the cost of
+    // deleting some other key passing for a change too
+    uint64_t version(std::string_view key);
 
-    ssize_t push(const std::string &key, std::span<const resp::Value> values, bool reverse = false);
+    void del(std::string_view key);
 
-    std::optional<std::span<const resp::Value> > range(const std::string &key, ptrdiff_t start, ptrdiff_t stop);
+    // the values are copied into bulk strings as they are stored
+    ssize_t push(std::string_view key, std::span<const std::string_view> values, bool reverse = false);
+
+    // the elements themselves, shared with the stored list rather than copied
+    std::optional<resp::SharedArray> range(std::string_view key, ptrdiff_t start, ptrdiff_t stop);
 
     enum class incr_error {
         non_bulk_string_value,
@@ -39,16 +78,63 @@ public:
         non_numeric_value,
     };
 
-    std::expected<int64_t, incr_error> incr(const std::string &key, int64_t amount = 1);
+    std::expected<int64_t, incr_error> incr(std::string_view key, int64_t amount = 1);
+
+    [[nodiscard]] size_t size() const { return m_map.size(); }
 
     void save(std::ostream &stream) const;
 
-    void load(std::istream &stream);
+    // writes every entry without the leading entry count, so several dictionaries can be stitched into one dump
+    void save_entries(std::ostream &stream) const;
+
+    // keep selects which keys of the dump belong to this dictionary; by default everything is loaded
+    void load(std::istream &stream, const std::function<bool(const std::string &)> &keep = nullptr);
 
 private:
-    std::unordered_map<std::string, std::pair<resp::Value, std::optional<Timestamp> > > m_map{};
+    static constexpr size_t prefetch_entries{64 * 1024};
+
+    // lets the map be searched with a string_view, without making a string of it first
+    struct KeyHash {
+        using is_transparent = void;
+
+        size_t operator()(const std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+
+    struct Entry {
+        resp::Value value;
+        std::optional<Timestamp> expiry;
+        // the stamp of the last change
+        uint64_t version;
+    };
 
-    bool expired(const std::string &key) const;
+    using Map = std::unordered_map<std::string, Entry, KeyHash, std::equal_to<> >;
+
+    Map m_map{};
+    // counts every change, to stamp each with
+    uint64_t m_version{0};
+    uint64_t m_last_deletion{0};
+    Observer *m_observer{nullptr};
+    size_t m_encode_threshold{resp::share_threshold};
+
+    void modified(const std::string_view key) const {
+        if (m_observer) {
+            m_observer->modified(key);
+        }
+    }
+
+    // stamps an entry that has been changed in place
+    void modified(Map::iterator entry) {
+        entry->second.version = ++m_version;
+        modified(entry->first);
+    }
+
+    void deleted(const std::string_view key) {
+        m_last_deletion = ++m_version;
+        modified(key);
+    }
+
+    // the entry for key, unless there is none or it has expired, in which case it is dropped
+    Map::iterator find(std::string_view key);
 };
 
 
@@ -5,11 +5,22 @@
 #ifndef EVENT_LOOP_H
 #define EVENT_LOOP_H
 
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
-#include <unordered_map>
+#include <span>
+#include <sys/types.h>
 #include <vector>
 
+#include "buffer_pool.h"
+#include "io_threads.h"
+#include "timer_wheel.h"
+
+class Uring;
+struct io_uring_cqe;
+struct msghdr;
+
 class EventLoop {
 public:
     class Handler {
@@ -17,24 +28,211 @@ public:
         virtual ~Handler() = default;
 
         virtual void handle(uint32_t events) = 0;
+
+        // a completion-based backend accepts, receives and sends on the handler's behalf and reports the outcome
+        // through these instead of readiness.
+
+        // the accepted socket, or -errno if the accept failed
+        virtual void handle_accepted(int socket) {
+        }
+
+        // an empty span means the peer closed the connection or it broke
+        virtual void handle_received(std::span<const char> data) {
+        }
+
+        // the number of bytes sent, or -errno
+        virtual void handle_sent(ssize_t bytes_sent) {
+        }
+
+        // with I/O threads, a handler that offloaded its receive or send to them does the system calls, parsing and
+        // serializing in these. they run on any of the threads, alongside other handlers' but nothing else of the
+        // loop's, so they must touch nothing but the handler's own state and the scratch buffer they are given
+
+        virtual void io_receive(std::span<char> buffer) {
+        }
+
+        virtual void io_send() {
+        }
+
+        // back on the loop's thread, once the I/O threads are done with every handler offloaded along with this one
+        virtual void handle_io_received() {
+        }
+
+        virtual void handle_io_sent() {
+        }
+
+        // heap memory the handler holds, itself included
+        [[nodiscard]] virtual size_t memory_usage() const { return 0; }
     };
 
-    explicit EventLoop();
+    enum class Backend {
+        epoll,
+        io_uring,
+    };
+
+    // only ever touched on the loop's own thread
+    struct Stats {
+        uint64_t accept_wakeups{0};
+        uint64_t accepted_connections{0};
+        uint64_t connected_clients{0};
+        // times a client ran out of budget and had to wait for the next iteration
+        uint64_t budget_yields{0};
+        // handlers whose receives and sends went through the I/O threads
+        uint64_t io_threaded_reads{0};
+        uint64_t io_threaded_writes{0};
+        // time spent busy polling, and how many of those spins found something to do before the loop went to sleep
+        uint64_t busy_poll_nanoseconds{0};
+        uint64_t busy_poll_hits{0};
+        // time spent handling events, timers and deferred tasks, from waking up to the end of the iteration
+        uint64_t work_nanoseconds{0};
+    };
+
+    // io_threads counts the loop's own thread, so 1 means there are none; only the epoll backend uses them. busy_poll is
+    // how long the loop keeps polling without blocking once it runs out of work, before going to sleep
+    explicit EventLoop(Backend backend = Backend::epoll, size_t io_threads = 1,
+                       std::chrono::microseconds busy_poll = std::chrono::microseconds::zero());
+
+    ~EventLoop();
+
+    [[noreturn]] void start();
+
+    [[nodiscard]] bool completion_based() const { return m_backend == Backend::io_uring; }
+
+    // whether handlers should leave their receives and sends to the I/O threads
+    [[nodiscard]] bool offloading() const { return m_io_threads != nullptr; }
+
+    [[nodiscard]] std::chrono::microseconds busy_poll() const { return m_busy_poll; }
+
+    Stats &stats() { return m_stats; }
+
+    BufferPool &buffers() { return m_buffers; }
+
+    // scratch space for readiness-based handlers to receive into; anything they keep must be copied out before they
+    // return
+    std::span<char> receive_buffer() { return m_receive_buffer; }
 
-    void start();
+    // what the registered handlers hold, added up
+    [[nodiscard]] size_t handler_memory() const;
+
+    // callbacks scheduled here run on the loop's thread
+    TimerWheel &timers() { return m_timers; }
+
+    // runs the task on the next loop iteration, after that iteration's events; the loop does not block while any are
+    // waiting
+    void defer(std::move_only_function<void()> task) { m_deferred.push_back(std::move(task)); }
+
+    // counts the passes through the loop, so handlers can tell one iteration from the next
+    [[nodiscard]] uint64_t iteration() const { return m_iteration; }
+
+    // the time the loop last woke up at, which is close enough for anything the handlers schedule or measure
+    [[nodiscard]] TimerWheel::Clock::time_point now() const { return m_now; }
 
     void add_handler(int fd, uint32_t events, std::unique_ptr<Handler> handler);
 
+    // a listening socket: readiness under epoll, a multishot accept under io_uring. the socket must already be
+    // non-blocking
+    void add_acceptor(int fd, std::unique_ptr<Handler> handler);
+
+    // a connected socket: readiness under epoll, a multishot receive into provided buffers under io_uring. the socket
+    // must already be non-blocking
+    void add_stream(int fd, std::unique_ptr<Handler> handler);
+
+    // completion-based backends only: queues a send of message, which must stay valid, along with everything it
+    // points to, until handle_sent
+    void send(int fd, const msghdr &message);
+
+    // I/O threads only: has the handler's io_receive run on them after this iteration's events, and its
+    // handle_io_received on the loop's thread after that
+    void offload_receive(int fd);
+
+    // I/O threads only: the same for io_send and handle_io_sent, at the very end of the iteration, so that everything
+    // the iteration produced goes out together
+    void offload_send(int fd);
+
     void remove_handler(int fd);
 
     void modify_handler(int fd, uint32_t events) const;
 
 private:
     static constexpr int max_events{1024};
+    static constexpr unsigned ring_entries{1024};
+    static constexpr uint16_t buffer_group{0};
+    static constexpr unsigned buffer_count{512};
+    static constexpr unsigned buffer_size{4096};
+    static constexpr size_t receive_buffer_size{64 * 1024};
+    static constexpr size_t max_spare_registrations{1024};
+
+    enum class Operation : uint64_t {
+        poll,
+        accept,
+        receive,
+        send,
+        // has no registration
+        timeout,
+    };
+
+    // the low bits of a completion's user data carry the operation, the rest is the registration it belongs to
+    static constexpr uint64_t operation_mask{0b111};
 
+    struct Registration {
+        int fd;
+        uint32_t events;
+        std::unique_ptr<Handler> handler;
+        // tells this registration apart from an earlier one for the same fd, whose events may still be in flight
+        uint32_t generation{0};
+        // operations the kernel still holds; a removed registration lives on until they have all completed
+        unsigned pending{0};
+        bool removed{false};
+    };
+
+    Backend m_backend;
+    std::chrono::microseconds m_busy_poll{};
+    Stats m_stats{};
+    BufferPool m_buffers{};
+    std::vector<char> m_receive_buffer{};
+    std::unique_ptr<IoThreads> m_io_threads{};
+    // one receive buffer for every I/O thread but the loop's own, which uses the one above
+    std::vector<std::vector<char> > m_io_buffers{};
+    std::vector<Registration *> m_offloaded_receives{};
+    std::vector<Registration *> m_offloaded_sends{};
+    // the batch the I/O threads are working on, kept around for its capacity
+    std::vector<Registration *> m_offloaded{};
+    TimerWheel::Clock::time_point m_now{TimerWheel::Clock::now()};
+    TimerWheel m_timers{TimerWheel::Clock::duration{std::chrono::milliseconds{10}}, m_now};
+    std::vector<std::move_only_function<void()> > m_deferred{};
+    uint64_t m_iteration{0};
+    // completion-based loops only: when the earliest timeout queued with the kernel expires
+    TimerWheel::Clock::time_point m_timeout_deadline{TimerWheel::Clock::time_point::max()};
     int m_epoll{-1};
-    std::unordered_map<int, std::unique_ptr<Handler> > m_handlers{};
-    std::vector<int> m_removed_fds{};
+    std::unique_ptr<Uring> m_ring{};
+    // indexed by fd, which the kernel keeps dense by always handing out the lowest free one
+    std::vector<std::unique_ptr<Registration> > m_handlers{};
+    uint32_t m_generation{0};
+    std::vector<std::unique_ptr<Registration> > m_removed{};
+    // registrations done with, kept for the next handlers to be added
+    std::vector<std::unique_ptr<Registration> > m_spare_registrations{};
+
+    void add(int fd, uint32_t events, std::unique_ptr<Handler> handler, Operation operation);
+
+    [[nodiscard]] Registration &registration(int fd) const;
+
+    void arm(Registration &registration, Operation operation) const;
+
+    // completion-based loops only: makes sure the wait for completions ends in time for the next timer
+    void arm_timeout();
+
+    void complete(const io_uring_cqe &cqe);
+
+    void run_deferred();
+
+    // busy polls until ready says there is work, the time is up or deadline passes, and tells whether there is work
+    bool spin(TimerWheel::Clock::time_point deadline, const std::function<bool()> &ready);
+
+    void run_offloaded_receives();
+
+    void run_offloaded_sends();
+
+    [[nodiscard]] std::span<char> io_buffer(size_t thread);
 };
 
 
@@ -0,0 +1,56 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef IO_THREADS_H
+#define IO_THREADS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that one owning thread hands batches of independent work to, and waits on until the whole
+// batch is done. The owning thread takes its share of every batch as well, so a pool of n threads starts n - 1.
+class IoThreads {
+public:
+    // called with the index of the item to work on, and the index of the thread doing it; the owner's is 0
+    using Work = std::function<void(size_t item, size_t thread)>;
+
+    explicit IoThreads(size_t threads);
+
+    ~IoThreads();
+
+    IoThreads(const IoThreads &) = delete;
+
+    IoThreads &operator=(const IoThreads &) = delete;
+
+    [[nodiscard]] size_t size() const { return m_workers.size() + 1; }
+
+    // calls work for every item in [0, items) and returns once it has been called for all of them. a batch too small to
+    // be worth waking the other threads for is worked through on the calling thread alone
+    void run(size_t items, const Work &work);
+
+private:
+    static constexpr size_t min_items_per_thread{2};
+
+    std::vector<std::jthread> m_workers{};
+    // the batch being worked on; only written while every worker is waiting for the next one
+    const Work *m_work{nullptr};
+    size_t m_items{0};
+    // the next item no thread has taken yet
+    std::atomic<size_t> m_next{0};
+    // bumped for every batch handed out, and waited on by the workers in between
+    std::atomic<uint64_t> m_batch{0};
+    // workers still on the current batch
+    std::atomic<size_t> m_busy{0};
+    std::atomic<bool> m_stopping{false};
+
+    void serve(size_t thread);
+
+    void work_through(size_t thread);
+};
+
+
+#endif //IO_THREADS_H
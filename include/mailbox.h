@@ -0,0 +1,45 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <atomic>
+#include <functional>
+
+#include "event_loop.h"
+
+// Lock-free multi-producer, single-consumer task queue. Any thread may post a task; the tasks are run in the order
+// they were posted by the thread whose event loop owns the mailbox, woken through an eventfd.
+class Mailbox final : public EventLoop::Handler {
+public:
+    using Task = std::move_only_function<void()>;
+
+    explicit Mailbox();
+
+    ~Mailbox() override;
+
+    Mailbox(const Mailbox &) = delete;
+
+    Mailbox &operator=(const Mailbox &) = delete;
+
+    [[nodiscard]] int fd() const { return m_event; }
+
+    void post(Task task);
+
+    void handle(uint32_t events) override;
+
+private:
+    struct Node {
+        Task task;
+        Node *next{nullptr};
+    };
+
+    int m_event{-1};
+    // tasks are pushed onto the head (newest first); the consumer takes the whole stack at once and reverses it
+    std::atomic<Node *> m_head{nullptr};
+};
+
+
+#endif //MAILBOX_H
@@ -0,0 +1,87 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+#include "buffer_pool.h"
+#include "resp.h"
+
+// Replies waiting to be sent: runs of serialized bytes, interleaved with references to shared strings, which go out
+// straight from where they are stored. A referenced string is kept alive until it has been sent in full. Large shared
+// arrays are streamed: their elements are only serialized a chunk at a time, as the bytes ahead of them are sent, so a
+// huge reply never sits in memory whole.
+class OutputBuffer {
+public:
+    // byte buffers come from the pool and go back to it once sent; without one, they are simply allocated and freed
+    explicit OutputBuffer(BufferPool *pool = nullptr): m_pool{pool} {
+    }
+
+    // aggregates and the RESP3 types are written out in the protocol the client speaks
+    void append(const resp::Value &value, resp::Protocol protocol = resp::Protocol::resp2);
+
+    [[nodiscard]] bool empty() const { return m_size == 0 && m_streams == 0; }
+
+    // bytes left to send, of those serialized so far
+    [[nodiscard]] size_t size() const { return m_size; }
+
+    // points iovecs at what is to be sent next, and returns how many of them were used. a streamed array on the way
+    // has its next chunk serialized
+    size_t gather(std::span<iovec> iovecs);
+
+    // drops bytes from the front, once they have been sent
+    void consume(size_t bytes);
+
+    // heap memory held, not counting the shared strings referred to
+    [[nodiscard]] size_t memory_usage() const;
+
+private:
+    // arrays of more elements than this are streamed
+    static constexpr size_t stream_elements{256};
+    // about how much of a streamed array is serialized at a time
+    static constexpr size_t stream_chunk{64 * 1024};
+
+    // the elements of an array still to be serialized
+    struct Stream {
+        resp::SharedArray array;
+        size_t next;
+        resp::Protocol protocol;
+    };
+
+    struct Segment {
+        std::vector<char> bytes{};
+        // when set, the segment is this string rather than its bytes
+        std::shared_ptr<const std::string> shared{};
+        // or the elements of this array, which become bytes segments ahead of it as they are serialized
+        std::optional<Stream> stream{};
+
+        [[nodiscard]] std::span<const char> data() const;
+    };
+
+    BufferPool *m_pool{nullptr};
+    std::vector<Segment> m_segments{};
+    // how much of the front segment has been sent already
+    size_t m_offset{0};
+    size_t m_size{0};
+    // streamed arrays not serialized in full yet
+    size_t m_streams{0};
+
+    std::vector<char> &tail();
+
+    // serializes the next chunk of the streamed array at index into a segment ahead of it, and drops the stream once
+    // it is done
+    void produce(size_t index);
+
+    void release(std::vector<char> bytes) const;
+};
+
+
+#endif //OUTPUT_BUFFER_H
@@ -5,48 +5,186 @@
 #ifndef REQUEST_HANDLER_H
 #define REQUEST_HANDLER_H
 
-#include "connection.h"
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "command_table.h"
 #include "dictionary.h"
 #include "resp.h"
+#include "script.h"
 #include "tokenizer.h"
+#include "tracking.h"
 
 class Connection;
+class Shard;
 
 class RequestHandler {
 public:
-    explicit RequestHandler(Dictionary &dictionary): m_dictionary{dictionary} {
+    // anything a command can reply to: a client connection, or a capture of a command run on behalf of another shard
+    class Client {
+    public:
+        virtual ~Client() = default;
+
+        virtual void send(const resp::Value &value) = 0;
+    };
+
+    // library holds the functions FCALL calls
+    RequestHandler(Dictionary &dictionary, script::Library &library, Shard *shard = nullptr)
+        : m_dictionary{dictionary}, m_library{library}, m_shard{shard} {
     }
 
-    void handle(const resp::Value &request, Connection &connection) const;
+    // a command's name followed by its arguments
+    using Arguments = std::span<const std::string_view>;
+
+    // a connection's MULTI: the commands queued for EXEC to run one after the other, and the keys WATCH has seen at
+    // a version EXEC expects them still to be at. with several shards, every key of it has to be on the same one
+    struct Transaction {
+        struct Watch {
+            std::string key;
+            uint64_t version;
+        };
+
+        bool active{false};
+        // a command could not be queued, so EXEC will refuse to run the rest
+        bool failed{false};
+        std::vector<resp::Array> commands{};
+        std::vector<Watch> watched{};
+        // the index of the shard its keys are on, once there is any
+        std::optional<size_t> shard{};
+    };
+
+    void handle(Arguments arguments, Connection &connection) const;
+
+    // starts loading the entries of the command's keys that this shard owns, ahead of handling it
+    void prefetch(Arguments arguments) const;
+
+    // whether prefetch does anything, which it only does once the keys no longer fit in the cache
+    [[nodiscard]] bool prefetching() const { return m_dictionary.worth_prefetching(); }
+
+    // enough for a function to do a great deal, yet not to hold up the shard for more than a few tens of milliseconds
+    static constexpr size_t default_function_budget{1'000'000};
+
+    // how many instructions a function may run before it is stopped; zero is unlimited
+    void set_function_budget(const size_t budget) { m_function_budget = budget; }
 
 private:
+    // how a command runs: on any client, or for the commands about the connection itself, on the connection
+    struct Handlers {
+        void (RequestHandler::*client)(Arguments, Client &) const;
+        void (RequestHandler::*connection)(Arguments, Connection &) const;
+    };
+
+    using Command = commands::Command<Handlers>;
+
+    // runs on the owning shard and produces the single reply of a forwarded command
+    using Work = std::move_only_function<resp::Value(Shard &)>;
+    // runs back on the originating shard once every piece of work has replied
+    using Reduce = std::move_only_function<resp::Value(std::vector<resp::Value> &)>;
+
+    // the commands a function calls, which go through the table the way a client's do
+    class FunctionHost;
+
     Dictionary &m_dictionary;
+    script::Library &m_library;
+    Shard *m_shard{nullptr};
+    size_t m_function_budget{default_function_budget};
+
+    // every command there is, see command_table.h
+    static const auto &command_table();
+
+    // the command arguments start with, once they are known to be as many as it takes; otherwise the client is told
+    // what is wrong, and there is none
+    static const Command *lookup(Arguments arguments, Client &client);
+
+    bool forward(const Command &command, Arguments arguments, Connection &connection) const;
+
+    void scatter(Connection &connection, std::vector<std::pair<Shard *, Work> > work, Reduce reduce) const;
+
+    // runs a command forwarded from another shard, and remembers the keys it reads for a client that tracks them
+    resp::Value execute(const Command &command, const resp::Array &arguments,
+                        const std::optional<Tracking::Subscriber> &subscriber = std::nullopt) const;
+
+    resp::Value execute(const Command &command, Arguments arguments,
+                        const std::optional<Tracking::Subscriber> &subscriber = std::nullopt) const;
+
+    // the client to remember the keys of a forwarded command for, if it is a read and the client is tracking
+    std::optional<Tracking::Subscriber> subscriber_of(const Command &command, const Connection &connection) const;
+
+    // the keys a read command has read, on this shard, for a client that tracks them
+    void remember(const Command &command, Arguments arguments, const Tracking::Subscriber &subscriber) const;
+
+    // queues a command after MULTI, or if it cannot be run as part of the transaction, dooms it
+    void queue(const Command &command, Arguments arguments, Connection &connection) const;
+
+    // whether key is on shard, which is taken to be the key's own if there is none yet; always with a single shard
+    bool claim(std::optional<size_t> &shard, std::string_view key) const;
+
+    // and every key of the command
+    bool claim(std::optional<size_t> &shard, const Command &command, Arguments arguments) const;
+
+    // EXEC on the shard the transaction's keys are on: the reply of each command, or a null array if a watched key has
+    // changed since
+    resp::Value run_transaction(const Transaction &transaction,
+                                const std::optional<Tracking::Subscriber> &subscriber) const;
+
+    // connection state rather than data, so these are never forwarded
+    void handle_hello(Arguments arguments, Connection &connection) const;
+
+    void handle_client(Arguments arguments, Connection &connection) const;
+
+    void handle_client_tracking(Arguments arguments, Connection &connection) const;
+
+    static void handle_client_reply(Arguments arguments, Connection &connection);
+
+    void handle_multi(Arguments arguments, Connection &connection) const;
+
+    void handle_exec(Arguments arguments, Connection &connection) const;
+
+    void handle_discard(Arguments arguments, Connection &connection) const;
+
+    void handle_watch(Arguments arguments, Connection &connection) const;
+
+    void handle_unwatch(Arguments arguments, Connection &connection) const;
+
+    void handle_ping(Arguments arguments, Client &client) const;
+
+    void handle_set(Arguments arguments, Client &client) const;
+
+    void handle_get(Arguments arguments, Client &client) const;
+
+    void handle_mget(Arguments arguments, Client &client) const;
+
+    void handle_mset(Arguments arguments, Client &client) const;
 
-    void handle_command(const resp::Array &command, Connection &connection) const;
+    void handle_msetnx(Arguments arguments, Client &client) const;
 
-    static void handle_ping(const Tokenizer &tokens, Connection &connection);
+    void handle_flushdb(Arguments arguments, Client &client) const;
 
-    void handle_set(const Tokenizer &tokens, Connection &connection) const;
+    void handle_exists(Arguments arguments, Client &client) const;
 
-    void handle_get(const Tokenizer &tokens, Connection &connection) const;
+    void handle_del(Arguments arguments, Client &client) const;
 
-    void handle_flushdb(const Tokenizer &tokens, Connection &connection) const;
+    void handle_incr(Arguments arguments, Client &client) const;
 
-    void handle_exists(const Tokenizer &tokens, Connection &connection) const;
+    void handle_decr(Arguments arguments, Client &client) const;
 
-    void handle_del(const Tokenizer &tokens, Connection &connection) const;
+    void handle_lpush(Arguments arguments, Client &client) const;
 
-    void handle_incr(const Tokenizer &tokens, Connection &connection) const;
+    void handle_rpush(Arguments arguments, Client &client) const;
 
-    void handle_decr(const Tokenizer &tokens, Connection &connection) const;
+    void handle_lrange(Arguments arguments, Client &client) const;
 
-    void handle_lpush(const Tokenizer &tokens, Connection &connection) const;
+    void handle_save(Arguments arguments, Client &client) const;
 
-    void handle_rpush(const Tokenizer &tokens, Connection &connection) const;
+    void handle_info(Arguments arguments, Client &client) const;
 
-    void handle_lrange(const Tokenizer &tokens, Connection &connection) const;
+    void handle_function(Arguments arguments, Client &client) const;
 
-    void handle_save(const Tokenizer &tokens, Connection &connection) const;
+    void handle_fcall(Arguments arguments, Client &client) const;
 };
 
 
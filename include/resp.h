@@ -5,12 +5,23 @@
 #ifndef RESP_H
 #define RESP_H
 
+#include <algorithm>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
 namespace resp {
+    // what a client has asked to be spoken to in with HELLO. the RESP3 types below are sent to RESP2 clients as the
+    // nearest RESP2 type
+    enum class Protocol {
+        resp2 = 2,
+        resp3 = 3,
+    };
+
     struct SimpleString {
         std::string value;
 
@@ -36,8 +47,47 @@ namespace resp {
         bool operator==(const BulkString &) const = default;
     };
 
+    // a bulk string in an immutable, reference counted buffer. copies share the buffer, so a reply can point at a stored
+    // value instead of copying it, and the value outlives the reply even if it is overwritten in the meantime
+    struct SharedString {
+        std::shared_ptr<const std::string> value;
+        // when set, value holds the string already encoded, "$<length>\r\n<contents>\r\n", and this is how long its
+        // header is, so that sending it is a single copy or iovec. see encode
+        size_t header{0};
+
+        // the string itself, without the encoding around it
+        [[nodiscard]] std::string_view contents() const {
+            const std::string_view all{*value};
+            return header == 0 ? all : all.substr(header, all.size() - header - 2);
+        }
+
+        bool operator==(const SharedString &other) const { return contents() == other.contents(); }
+    };
+
+    struct Null {
+        bool operator==(const Null &) const = default;
+    };
+
+    struct Boolean {
+        bool value;
+
+        bool operator==(const Boolean &) const = default;
+    };
+
+    struct Double {
+        double value;
+
+        bool operator==(const Double &) const = default;
+    };
+
     struct Array;
-    using Value = std::variant<SimpleString, SimpleError, Integer, BulkString, Array>;
+    struct Map;
+    struct Set;
+    struct Push;
+    struct SharedArray;
+    // new types go at the end, the index of each is its tag in a dump
+    using Value = std::variant<SimpleString, SimpleError, Integer, BulkString, Array, SharedString, Null, Boolean,
+        Double, Map, Set, Push, SharedArray>;
 
     struct Array {
         std::optional<std::vector<Value> > value;
@@ -45,11 +95,63 @@ namespace resp {
         bool operator==(const Array &) const = default;
     };
 
+    // keys and values taking turns
+    struct Map {
+        std::vector<Value> value;
+
+        bool operator==(const Map &) const = default;
+    };
+
+    struct Set {
+        std::vector<Value> value;
+
+        bool operator==(const Set &) const = default;
+    };
+
+    // out of band data, such as an invalidation message, which may arrive between any two replies
+    struct Push {
+        std::vector<Value> value;
+
+        bool operator==(const Push &) const = default;
+    };
+
+    // count elements from first on of a reference counted array, which is how lists are stored. whoever stores one
+    // copies the elements before changing them while they are shared, so a reply can refer to the stored elements, and
+    // they stay as they were for as long as it takes to send them
+    struct SharedArray {
+        std::shared_ptr<std::vector<Value> > values;
+        size_t first{0};
+        size_t count{0};
+
+        // none at all when there are no values
+        [[nodiscard]] std::span<const Value> elements() const {
+            return values ? std::span{*values}.subspan(first, count) : std::span<const Value>{};
+        }
+
+        bool operator==(const SharedArray &other) const { return std::ranges::equal(elements(), other.elements()); }
+    };
+
     inline constexpr Value nil{BulkString{std::nullopt}};
     inline constexpr Value ok{SimpleString{"OK"}};
     inline constexpr Value syntax_error{SimpleError{"ERR", "syntax error"}};
 
-    void serialize(const Value &value, std::vector<char> &out);
+    // strings at least this long are stored shared and sent from where they are stored; below it, copying is cheaper
+    inline constexpr size_t share_threshold{1024};
+
+    // the contents of a bulk string, shared or not, or nothing for anything else including nil
+    std::optional<std::string_view> string_of(const Value &value);
+
+    // contents as a shared string in its wire form, the way values are stored
+    SharedString encode(std::string_view contents);
+
+    // a string to be stored: encoded from threshold up, a plain bulk string below it
+    Value string_value(std::string_view contents, size_t threshold = share_threshold);
+
+    // strings from threshold up are encoded into a shared buffer, and arrays are moved into one; everything else is
+    // returned as is
+    Value share(Value value, size_t threshold = share_threshold);
+
+    void serialize(const Value &value, std::vector<char> &out, Protocol protocol = Protocol::resp2);
 
     void save(const Value &value, std::ostream &out);
 
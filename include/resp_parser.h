@@ -7,6 +7,8 @@
 
 #include <optional>
 #include <span>
+#include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -16,37 +18,71 @@ template<typename T>
 inline constexpr bool always_false = false;
 
 namespace resp {
+    // Decodes any RESP value incrementally: whatever a feed ends in the middle of, a line, a bulk string or an array,
+    // is picked up where it left off by the next one, so every byte is looked at once however the data is split up.
     class Parser {
     public:
-        explicit Parser(const size_t buffer_limit = 8192): m_buffer_limit{buffer_limit} {
+        // buffer_limit is how much memory an emptied line buffer may keep for the next incomplete line
+        explicit Parser(const size_t buffer_limit = 0): m_buffer_limit{buffer_limit} {
         }
 
         void feed(std::span<const char> data);
 
         std::vector<Value> take_values();
 
+        // set once the peer has broken the protocol; nothing after that is decoded
+        [[nodiscard]] bool failed() const { return m_failed; }
+
+        // heap memory held on to between feeds
+        [[nodiscard]] size_t memory_usage() const;
+
     private:
+        // the most a bulk string may announce, as in redis
+        static constexpr size_t max_bulk_length{512 * 1024 * 1024};
+        // how many elements an array gets room for up front, whatever it announces
+        static constexpr size_t max_reserved_elements{1024};
+
+        // an aggregate still waiting for some of its elements
+        struct Frame {
+            enum class Kind { array, map, set, push };
+
+            Kind kind;
+            std::vector<Value> values;
+            size_t remaining;
+        };
+
         std::vector<Value> m_values{};
-        std::vector<char> m_buffer{};
-        size_t m_parsed{0};
-        size_t m_position{0};
+        // the aggregates being filled in, innermost last
+        std::vector<Frame> m_frames{};
+        // a line whose CRLF has not arrived yet
+        std::vector<char> m_line{};
+        // a bulk string being filled in as its bytes arrive, with room for all of it from the start, and how many
+        // bytes it still needs, its CRLF included
+        std::optional<std::string> m_bulk{};
+        size_t m_bulk_remaining{0};
+        bool m_failed{false};
         size_t m_buffer_limit{};
 
-        char advance() { return m_buffer[m_position++]; }
+        // each of these takes what it can from data, and returns how much that was
+        size_t feed_line(std::span<const char> data);
+
+        size_t feed_bulk(std::span<const char> data);
 
-        [[nodiscard]] char peek() const { return m_buffer[m_position]; }
+        void decode_line(std::string_view line);
 
-        std::optional<Value> decode_next();
+        SimpleError decode_simple_error(std::string_view line);
 
-        std::optional<SimpleString> decode_simple_string();
+        std::optional<Integer> decode_integer(std::string_view line);
 
-        std::optional<SimpleError> decode_simple_error();
+        std::optional<Double> decode_double(std::string_view line);
 
-        std::optional<Integer> decode_integer();
+        // starts an aggregate of count elements, a map's keys and values counted separately
+        bool decode_aggregate(Frame::Kind kind, std::string_view line);
 
-        std::optional<BulkString> decode_bulk_string();
+        static Value complete(Frame frame);
 
-        std::optional<Array> decode_array();
+        // adds a complete value to the innermost aggregate waiting for one, or to the values decoded
+        void push(Value value);
     };
 }
 
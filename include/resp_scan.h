@@ -0,0 +1,40 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef RESP_SCAN_H
+#define RESP_SCAN_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+// The byte-level scanning both RESP parsers spend their time in: finding where a line ends, and reading the lengths
+// in array and bulk string headers.
+namespace resp {
+    // the instruction sets find_crlf has a kernel for, from slowest to fastest
+    enum class ScanKernel {
+        scalar,
+        sse2,
+        avx2,
+    };
+
+    // the fastest kernel this CPU supports, which is the one in use unless set_scan_kernel says otherwise
+    ScanKernel best_scan_kernel();
+
+    ScanKernel scan_kernel();
+
+    // for benchmarks and tests; a kernel the CPU does not support is refused
+    bool set_scan_kernel(ScanKernel kernel);
+
+    std::string_view to_string(ScanKernel kernel);
+
+    // the offset of the first CRLF in data, or std::string_view::npos if there is none
+    size_t find_crlf(std::span<const char> data);
+
+    // the decimal number digits holds in full, with an optional leading minus, or nothing if it holds anything else
+    std::optional<int64_t> parse_length(std::string_view digits);
+}
+
+#endif //RESP_SCAN_H
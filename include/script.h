@@ -0,0 +1,129 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "resp.h"
+
+// Server-side functions, for FUNCTION LOAD and FCALL: a small language compiled to bytecode for a stack machine that
+// runs on the shard's thread, sees nothing but the keys and arguments it is called with and the replies of the
+// commands it calls, and stops once it has run as many instructions as it was given, copying or comparing strings
+// counting as an instruction for every 64 bytes.
+//
+//   # comments run to the end of the line
+//   function transfer {
+//       let balance = int(call("GET", KEYS[1]));
+//       if balance < int(ARGV[1]) {
+//           return nil;
+//       }
+//       call("SET", KEYS[1], balance - ARGV[1]);
+//       call("SET", KEYS[2], int(call("GET", KEYS[2])) + ARGV[1]);
+//       return balance - ARGV[1];
+//   }
+//
+// Values are those of RESP: nil, integers, strings and arrays, indexed from 1, or from -1 at the end. nil and 0 are
+// false, anything else true. Arithmetic takes strings holding integers as the integers, and `..` joins strings. The
+// builtins are call, which aborts the function with the command's error if it fails, len, int, which takes nil for 0,
+// and str.
+namespace script {
+    // the arguments of a command a function calls, its name first
+    using Arguments = std::span<const std::string_view>;
+
+    // what a function calls its commands through
+    class Host {
+    public:
+        virtual ~Host() = default;
+
+        virtual resp::Value call(Arguments arguments) = 0;
+    };
+
+    enum class Op : uint8_t {
+        // pushes the operand-th constant
+        constant,
+        nil,
+        // the operand-th local, the first two being KEYS and ARGV
+        load,
+        store,
+        pop,
+        add,
+        subtract,
+        multiply,
+        divide,
+        modulo,
+        concat,
+        equal,
+        not_equal,
+        less,
+        less_equal,
+        greater,
+        greater_equal,
+        negate,
+        logical_not,
+        index,
+        // jumps to the operand-th instruction
+        jump,
+        // pops the condition
+        jump_if_false,
+        // for && and ||: jumps leaving the condition as the result, or pops it and carries on
+        jump_if_false_or_pop,
+        jump_if_true_or_pop,
+        // a command, with the operand as the number of its arguments, its name included
+        call,
+        length,
+        to_integer,
+        to_string,
+        ret,
+    };
+
+    struct Instruction {
+        Op op;
+        uint32_t operand;
+        // in the source, for errors
+        uint32_t line;
+    };
+
+    struct Function {
+        std::string name;
+        std::vector<Instruction> code;
+        std::vector<resp::Value> constants;
+        size_t locals;
+    };
+
+    // every function in source, or what is wrong with it
+    std::expected<std::vector<Function>, std::string> compile(std::string_view source);
+
+    // the value function returns, or an error if it fails, calls a command that fails, runs more than budget
+    // instructions or holds more than 64MB at once. the commands it has called by then have had their effect
+    resp::Value run(const Function &function, Arguments keys, Arguments arguments, Host &host, size_t budget);
+
+    // the functions loaded on a shard, by name
+    class Library {
+    public:
+        // adds the functions in source, all of them or none: if one fails to compile, or one is there already and
+        // replace is not set. their names, or what is wrong
+        std::expected<std::vector<std::string>, std::string> load(std::string_view source, bool replace);
+
+        bool remove(std::string_view name);
+
+        void flush() { m_functions.clear(); }
+
+        [[nodiscard]] const Function *find(std::string_view name) const;
+
+        [[nodiscard]] std::vector<std::string> names() const;
+
+    private:
+        std::map<std::string, Function, std::less<> > m_functions{};
+    };
+}
+
+#endif //SCRIPT_H
@@ -5,27 +5,60 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <chrono>
 #include <condition_variable>
 #include <queue>
+#include <string>
 #include <string_view>
 #include <unistd.h>
 #include <filesystem>
+#include <sys/types.h>
 
 #include "connection.h"
-#include "dictionary.h"
+#include "shard.h"
 
 class Server {
 public:
-    [[noreturn]] void start(std::string_view port = "6379", int backlog_size = 128);
+    struct Options {
+        // "0" turns the TCP listener off
+        std::string port{"6379"};
+        // a unix domain socket to listen on as well, for clients on the same host; none when empty
+        std::filesystem::path unix_socket{};
+        // a unix domain socket that hands out shared memory channels, for clients that want to skip the socket layer
+        // altogether; none when empty
+        std::filesystem::path shm_socket{};
+        // permissions of the socket files, which decide who may connect to them
+        mode_t unix_socket_permissions{0700};
+        int backlog_size{128};
+        // number of reactor threads, each serving its own shard of the keyspace
+        size_t threads{1};
+        EventLoop::Backend backend{EventLoop::Backend::epoll};
+        // threads each reactor shares its receiving, parsing, serializing and sending with, its own included; the
+        // commands themselves still run on the reactor's thread
+        size_t io_threads{1};
+        // how long each reactor keeps polling once it runs out of work before it goes to sleep, trading a core for the
+        // wakeup latency; client sockets are asked to busy poll their device queue for as long. zero never spins
+        std::chrono::microseconds busy_poll{0};
+        // clients that send nothing for this long are disconnected; zero keeps them around forever
+        std::chrono::seconds idle_timeout{0};
+        // how much one client may do per loop iteration before the others get their turn; zero is unlimited
+        size_t command_budget{1000};
+        size_t byte_budget{256 * 1024};
+        // strings from this long up are stored the way they are sent, see Dictionary::set_encode_threshold
+        size_t encode_threshold{resp::share_threshold};
+        // how many instructions a function run by FCALL may take; zero is unlimited
+        size_t function_budget{RequestHandler::default_function_budget};
+    };
 
-    ~Server() { close(m_socket); }
+    [[noreturn]] void start(const Options &options);
+
+    [[noreturn]] void start() { start(Options{}); }
 
     inline static std::filesystem::path dump_path{"dump.dish"};
 
 private:
-    int m_socket{};
     std::unordered_map<int, Connection> m_connections{};
-    Dictionary m_dictionary{};
+    std::vector<std::unique_ptr<Shard> > m_shards{};
 };
 
 
@@ -0,0 +1,70 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <chrono>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "connection_pool.h"
+#include "dictionary.h"
+#include "event_loop.h"
+#include "mailbox.h"
+#include "request_handler.h"
+#include "script.h"
+#include "tracking.h"
+
+// One reactor thread's share of the server: its own event loop, its own slice of the keyspace and the request handler
+// that serves it. Shards never touch each other's state; work for another shard is posted to its mailbox.
+class Shard {
+public:
+    Shard(size_t index, const std::vector<std::unique_ptr<Shard> > &shards, EventLoop::Backend backend,
+          size_t io_threads = 1, std::chrono::microseconds busy_poll = std::chrono::microseconds::zero());
+
+    Shard(const Shard &) = delete;
+
+    Shard &operator=(const Shard &) = delete;
+
+    [[noreturn]] void start();
+
+    // thread-safe: runs the task on this shard's thread
+    void post(Mailbox::Task task) const;
+
+    [[nodiscard]] Shard &owner(std::string_view key) const;
+
+    [[nodiscard]] bool owns(std::string_view key) const { return &owner(key) == this; }
+
+    [[nodiscard]] size_t index() const { return m_index; }
+
+    [[nodiscard]] const std::vector<std::unique_ptr<Shard> > &shards() const { return m_shards; }
+
+    EventLoop &event_loop() { return m_event_loop; }
+
+    ConnectionPool &connection_pool() { return m_connection_pool; }
+
+    Dictionary &dictionary() { return m_dictionary; }
+
+    RequestHandler &request_handler() { return m_request_handler; }
+
+    Tracking &tracking() { return m_tracking; }
+
+private:
+    size_t m_index{};
+    const std::vector<std::unique_ptr<Shard> > &m_shards;
+    // ahead of the loop, so it is still around when the loop's connections go back to it
+    ConnectionPool m_connection_pool{};
+    EventLoop m_event_loop;
+    Dictionary m_dictionary{};
+    Tracking m_tracking{this};
+    // every shard loads every function
+    script::Library m_library{};
+    RequestHandler m_request_handler{m_dictionary, m_library, this};
+    Mailbox *m_mailbox{nullptr};
+};
+
+
+#endif //SHARD_H
@@ -0,0 +1,99 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <sys/uio.h>
+
+// A transport for clients on the same host: two single-producer, single-consumer byte rings in one shared memory
+// region, one carrying requests to the server and one carrying replies back, plus an eventfd for each end to be woken
+// up through, its doorbell. Each ring is mapped twice in a row, so whatever is readable or writable is one contiguous
+// span even where it wraps around, and can be parsed or written in place.
+//
+// Neither end rings the other's doorbell unless the other has said it is about to wait: the consumer once it has found
+// its ring empty, the producer once it has found it full. While both ends are busy, the channel costs no system calls.
+class ShmChannel {
+public:
+    // per ring, rounded up to whole pages
+    static constexpr size_t default_capacity{1024 * 1024};
+
+    // the server's end of a new channel
+    static std::unique_ptr<ShmChannel> create(size_t capacity = default_capacity);
+
+    // the client's end, from the socket the server offered the channel over
+    static std::unique_ptr<ShmChannel> take(int socket);
+
+    ~ShmChannel();
+
+    ShmChannel(const ShmChannel &) = delete;
+
+    ShmChannel &operator=(const ShmChannel &) = delete;
+
+    // hands the client's end over a unix domain socket
+    void offer(int socket) const;
+
+    // what has arrived and not been consumed yet. this, like write, throws std::system_error if the peer has left the
+    // ring's indices in a state no ring can be in
+    [[nodiscard]] std::span<const char> readable() const;
+
+    void consume(size_t bytes);
+
+    // for once readable() has come back empty: asks the peer to ring once it has written more, and tells whether the
+    // ring is still empty, in which case it is safe to wait for the doorbell
+    bool expect_data();
+
+    // copies as much of data as fits into the outgoing ring and returns how much that was. when nothing fits, the peer
+    // is asked to ring once it has made room
+    size_t write(std::span<const iovec> data);
+
+    size_t write(std::span<const char> data);
+
+    // readable whenever there may be something to read, or room to write
+    [[nodiscard]] int doorbell() const { return m_own_event; }
+
+    void answer_doorbell() const;
+
+    // rings this end's own doorbell, to come back to a ring that still holds data
+    void ring_doorbell() const;
+
+    // blocks until the doorbell rings, and answers it
+    void wait() const;
+
+    [[nodiscard]] size_t capacity() const { return m_capacity; }
+
+    // the shared memory behind the channel
+    [[nodiscard]] size_t memory_size() const;
+
+private:
+    struct Ring;
+    struct Header;
+
+    int m_memory{-1};
+    int m_own_event{-1};
+    int m_peer_event{-1};
+    size_t m_capacity{0};
+    Header *m_header{nullptr};
+    char *m_requests{nullptr};
+    char *m_replies{nullptr};
+    Ring *m_in{nullptr};
+    Ring *m_out{nullptr};
+    char *m_in_data{nullptr};
+    char *m_out_data{nullptr};
+
+    ShmChannel(const int memory, const int own_event, const int peer_event,
+               const size_t capacity): m_memory{memory}, m_own_event{own_event}, m_peer_event{peer_event},
+                                       m_capacity{capacity} {
+    }
+
+    void map(bool server);
+
+    void ring_peer() const;
+};
+
+
+#endif //SHM_CHANNEL_H
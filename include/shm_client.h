@@ -0,0 +1,68 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef SHM_CLIENT_H
+#define SHM_CLIENT_H
+
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "resp.h"
+#include "resp_parser.h"
+#include "shm_channel.h"
+
+// A blocking client for the server's shared memory transport, for programs on the same host. Requests can be
+// pipelined: send as many as needed, then receive their replies in order. Requests are only written to the channel
+// once a reply is asked for, or enough of them have piled up, so a pipeline reaches the server in one go.
+class ShmClient {
+public:
+    // spin is how long to poll the ring for a reply before going to sleep on the doorbell, which saves both ends a
+    // system call per round trip when each has a core to itself
+    explicit ShmClient(const std::filesystem::path &socket,
+                       std::chrono::nanoseconds spin = std::chrono::nanoseconds::zero());
+
+    ~ShmClient();
+
+    ShmClient(const ShmClient &) = delete;
+
+    ShmClient &operator=(const ShmClient &) = delete;
+
+    void send(std::initializer_list<std::string_view> command);
+
+    void send(const std::vector<std::string_view> &command);
+
+    // the reply to the oldest request still waiting for one
+    resp::Value receive();
+
+    resp::Value execute(std::initializer_list<std::string_view> command) {
+        send(command);
+        return receive();
+    }
+
+private:
+    static constexpr size_t flush_threshold{64 * 1024};
+
+    int m_socket{-1};
+    std::unique_ptr<ShmChannel> m_channel{};
+    std::chrono::nanoseconds m_spin{};
+    resp::Parser m_parser{};
+    std::deque<resp::Value> m_replies{};
+    // requests not written to the channel yet
+    std::vector<char> m_requests{};
+
+    void send(std::span<const std::string_view> command);
+
+    void flush();
+
+    // takes whatever is in the ring, and tells whether there was anything
+    bool take_replies();
+};
+
+
+#endif //SHM_CLIENT_H
@@ -0,0 +1,76 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical timing wheel. Scheduling and cancelling are O(1); timers far out sit in coarse slots on the outer
+// levels and cascade inwards as their time approaches, so advancing the wheel only ever looks at the slots that are
+// due. Time moves in ticks, and a timer fires on the first tick at or after its deadline.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::move_only_function<void()>;
+    using Id = uint64_t;
+
+    explicit TimerWheel(Clock::duration tick = std::chrono::milliseconds{10}, Clock::time_point now = Clock::now());
+
+    Id schedule(Clock::duration delay, Callback callback);
+
+    Id schedule_every(Clock::duration period, Callback callback);
+
+    // cancelling a timer that has already fired, or cancelling it from its own callback, is fine
+    void cancel(Id id);
+
+    // runs every callback that is due by now
+    void advance(Clock::time_point now);
+
+    // how long until the wheel next needs advancing, or nothing if no timer is scheduled
+    [[nodiscard]] std::optional<Clock::duration> until_next(Clock::time_point now) const;
+
+    [[nodiscard]] size_t size() const { return m_timers.size(); }
+
+private:
+    static constexpr unsigned slot_bits{6};
+    static constexpr uint64_t slots{1 << slot_bits};
+    static constexpr uint64_t slot_mask{slots - 1};
+    static constexpr unsigned levels{4};
+
+    struct Timer {
+        uint64_t expires;
+        // in ticks; zero for one-shot timers
+        uint64_t period;
+        Callback callback;
+    };
+
+    Clock::duration m_tick;
+    Clock::time_point m_start;
+    // the last tick that has been run
+    uint64_t m_current{0};
+    Id m_next_id{1};
+    std::unordered_map<Id, Timer> m_timers{};
+    // slots hold ids only; a cancelled timer's id is left behind and skipped once its slot comes up
+    std::array<std::array<std::vector<Id>, slots>, levels> m_wheel{};
+
+    [[nodiscard]] uint64_t ticks(Clock::duration duration) const;
+
+    Id add(uint64_t delay, uint64_t period, Callback callback);
+
+    void place(Id id, uint64_t expires);
+
+    void cascade(unsigned level);
+
+    void run(uint64_t tick);
+};
+
+
+#endif //TIMER_WHEEL_H
@@ -0,0 +1,73 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef TRACKING_H
+#define TRACKING_H
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "dictionary.h"
+
+class Connection;
+class Shard;
+
+// Client side caching for one shard's keys: which clients have read which key, and which clients want to hear about
+// every key under a prefix. Once a key changes, each of them is sent an invalidation on its own shard's thread. A key
+// read by a client is forgotten once the client has been told, as in redis, so it is only remembered again once read
+// again. Not thread-safe; every call is made on the thread of the shard that owns the keys.
+class Tracking final : public Dictionary::Observer {
+public:
+    // a client, and the shard it is served on; without one, the client is on this shard's thread
+    struct Subscriber {
+        Shard *home;
+        std::shared_ptr<Connection *> connection;
+    };
+
+    // shard is where this table lives, and where clients that have gone away are cleaned up
+    explicit Tracking(Shard *shard = nullptr): m_shard{shard} {
+    }
+
+    void remember(std::string_view key, const Subscriber &subscriber);
+
+    // broadcast mode: every change to a key starting with prefix, which may be empty for all of them
+    void subscribe(std::string_view prefix, const Subscriber &subscriber);
+
+    void unsubscribe(Connection **connection);
+
+    void modified(std::string_view key) override;
+
+    void flushed() override;
+
+    [[nodiscard]] size_t keys() const { return m_keys.size(); }
+
+    [[nodiscard]] size_t prefixes() const { return m_prefixes.size(); }
+
+private:
+    // beyond this many keys, one of them is invalidated to make room, as with redis' tracking-table-max-keys
+    static constexpr size_t max_keys{1'000'000};
+
+    struct KeyHash {
+        using is_transparent = void;
+
+        size_t operator()(const std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+
+    // a client reading the same key twice is only told once, so subscribers are keyed by their token
+    using Subscribers = std::unordered_map<Connection **, Subscriber>;
+
+    Shard *m_shard{nullptr};
+    std::unordered_map<std::string, Subscribers, KeyHash, std::equal_to<> > m_keys{};
+    std::map<std::string, Subscribers, std::less<> > m_prefixes{};
+
+    // sends the invalidation on the subscriber's own thread, or nothing for all keys
+    void notify(const Subscriber &subscriber, std::optional<std::string_view> key);
+};
+
+
+#endif //TRACKING_H
@@ -0,0 +1,96 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#ifndef URING_H
+#define URING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper over the raw syscalls: a submission/completion queue pair plus one ring of provided
+// receive buffers. Entries are only handed to the kernel in submit(), so a whole loop iteration of work costs one
+// syscall.
+class Uring {
+public:
+    explicit Uring(unsigned entries);
+
+    ~Uring();
+
+    Uring(const Uring &) = delete;
+
+    Uring &operator=(const Uring &) = delete;
+
+    // a zeroed submission entry to fill in; if the queue is full, what is already queued is submitted first
+    io_uring_sqe &prepare();
+
+    // submits everything prepared so far and waits for at least wait_for completions, in a single io_uring_enter
+    void submit(unsigned wait_for = 0);
+
+    // submits everything prepared so far without waiting, and tells whether there are completions to reap; for busy
+    // polling
+    bool poll();
+
+    template<typename F>
+    void for_each_completion(F &&f) {
+        unsigned head{*m_cq_head};
+        const unsigned tail{std::atomic_ref{*m_cq_tail}.load(std::memory_order_acquire)};
+
+        while (head != tail) {
+            const io_uring_cqe cqe{m_cqes[head & m_cq_mask]};
+            // release the slot before running the callback, which may well submit more work
+            std::atomic_ref{*m_cq_head}.store(++head, std::memory_order_release);
+            f(cqe);
+        }
+    }
+
+    // queues a timeout that completes with -ETIME after the given time, so that waiting in submit cannot oversleep it.
+    // the kernel reads the time on submission, so only one timeout may be waiting to be submitted at once
+    void timeout(std::chrono::nanoseconds after, uint64_t user_data);
+
+    // registers count (a power of two) buffers of size bytes each that receives with IOSQE_BUFFER_SELECT draw from
+    void provide_buffers(uint16_t group, unsigned count, unsigned size);
+
+    [[nodiscard]] std::span<const char> buffer(uint16_t id, size_t length) const;
+
+    // hands a provided buffer back to the kernel once its contents have been consumed
+    void recycle(uint16_t id);
+
+private:
+    int m_fd{-1};
+
+    void *m_ring{nullptr};
+    size_t m_ring_size{0};
+    io_uring_sqe *m_sqes{nullptr};
+    size_t m_sqes_size{0};
+
+    unsigned *m_sq_head{nullptr};
+    unsigned *m_sq_tail{nullptr};
+    unsigned *m_sq_array{nullptr};
+    unsigned m_sq_mask{0};
+    unsigned m_sq_entries{0};
+    // entries prepared but not yet published to the kernel
+    unsigned m_sq_local_tail{0};
+
+    unsigned *m_cq_head{nullptr};
+    unsigned *m_cq_tail{nullptr};
+    unsigned m_cq_mask{0};
+    io_uring_cqe *m_cqes{nullptr};
+
+    // read by the kernel when the timeout is submitted
+    __kernel_timespec m_timeout{};
+
+    io_uring_buf_ring *m_buffer_ring{nullptr};
+    size_t m_buffer_ring_size{0};
+    std::vector<char> m_buffers{};
+    unsigned m_buffer_size{0};
+    unsigned m_buffer_mask{0};
+    uint16_t m_buffer_tail{0};
+};
+
+
+#endif //URING_H
@@ -3,35 +3,113 @@
 //
 
 #include "acceptor.h"
-#include "connection.h"
 
+#include <chrono>
 #include <format>
 #include <iostream>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <system_error>
+#include <utility>
 
 void Acceptor::handle(const uint32_t events) {
     if (!(events & EPOLLIN)) {
         return;
     }
 
+    EventLoop::Stats &stats = m_event_loop.stats();
+    ++stats.accept_wakeups;
 
-    sockaddr_storage client_address{};
-    socklen_t client_address_length{sizeof(client_address)};
+    // drain the backlog, but leave the rest of the loop a turn every so often; the listener is level-triggered, so
+    // whatever is left over wakes us up again straight away
+    for (size_t i{0}; i < max_accepts_per_wakeup; ++i) {
+        // accepted sockets come out non-blocking, so they can go straight into the event loop
+        const int client_socket = accept4(m_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
 
-    const int client_socket = accept(m_socket, reinterpret_cast<struct sockaddr *>(&client_address),
-                                     &client_address_length);
+        if (client_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
 
-    if (client_socket < 0) {
-        std::cerr << std::format("Warning: accept failed: {}\n", std::system_category().message(errno));
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << std::format("Warning: accept failed: {}\n", std::system_category().message(errno));
+            }
+            return;
+        }
+
+        ++stats.accepted_connections;
+        add_connection(client_socket);
+    }
+}
+
+void Acceptor::handle_accepted(const int socket) {
+    if (socket < 0) {
+        std::cerr << std::format("Warning: accept failed: {}\n", std::system_category().message(-socket));
+        return;
+    }
+
+    // every completion of the multishot accept carries exactly one connection, and those of one loop iteration make
+    // up one wakeup
+    EventLoop::Stats &stats = m_event_loop.stats();
+    if (m_wakeup_iteration != m_event_loop.iteration()) {
+        m_wakeup_iteration = m_event_loop.iteration();
+        m_wakeup_accepts = 0;
+        ++stats.accept_wakeups;
+    }
+    ++stats.accepted_connections;
+
+    // the kernel accepts the whole backlog by itself, so the cap can only put off setting the connections up, until the
+    // rest of the loop has had its turn
+    if (++m_wakeup_accepts <= max_accepts_per_wakeup) {
+        add_connection(socket);
         return;
     }
 
-    m_event_loop.add_handler(
-        client_socket,
-        EPOLLIN,
-        std::make_unique<Connection>(client_socket,
-                                     m_request_handler,
-                                     m_event_loop)
+    if (m_held.empty()) {
+        m_event_loop.defer([this] { add_held(); });
+    }
+    m_held.push_back(socket);
+}
+
+void Acceptor::add_held() {
+    for (const int socket: std::exchange(m_held, {})) {
+        add_connection(socket);
+    }
+}
+
+void Acceptor::add_connection(const int socket) {
+    std::unique_ptr<ShmChannel> channel{};
+    if (m_shared_memory) {
+        try {
+            channel = ShmChannel::create();
+            channel->offer(socket);
+        } catch (const std::system_error &error) {
+            std::cerr << std::format("Warning: could not set up a shared memory channel: {}\n", error.what());
+            close(socket);
+            return;
+        }
+    } else if (m_event_loop.busy_poll() > std::chrono::microseconds::zero()) {
+        set_busy_poll(socket);
+    }
+
+    m_event_loop.add_stream(
+        socket,
+        m_connection_pool.acquire(socket, m_request_handler, m_event_loop, m_connection_options, std::move(channel))
     );
 }
+
+void Acceptor::set_busy_poll(const int socket) {
+    if (!m_socket_busy_poll) {
+        return;
+    }
+
+    const int microseconds = static_cast<int>(m_event_loop.busy_poll().count());
+    constexpr int yes{1};
+    if (setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &microseconds, sizeof(microseconds)) == -1 ||
+        setsockopt(socket, SOL_SOCKET, SO_PREFER_BUSY_POLL, &yes, sizeof(yes)) == -1) {
+        // raising either above the system default takes CAP_NET_ADMIN; the event loop spins all the same
+        std::cerr << std::format("Warning: client sockets cannot busy poll: {}\n",
+                                 std::system_category().message(errno));
+        m_socket_busy_poll = false;
+    }
+}
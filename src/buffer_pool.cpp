@@ -0,0 +1,24 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "buffer_pool.h"
+
+std::vector<char> BufferPool::acquire() {
+    if (m_buffers.empty()) {
+        return {};
+    }
+
+    std::vector<char> buffer{std::move(m_buffers.back())};
+    m_buffers.pop_back();
+    return buffer;
+}
+
+void BufferPool::release(std::vector<char> buffer) {
+    if (buffer.capacity() == 0 || buffer.capacity() > max_capacity || m_buffers.size() >= max_buffers) {
+        return;
+    }
+
+    buffer.clear();
+    m_buffers.push_back(std::move(buffer));
+}
@@ -0,0 +1,165 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "command_parser.h"
+
+#include <algorithm>
+#include <format>
+
+#include "resp_scan.h"
+
+namespace resp {
+    void CommandParser::feed(const std::span<const char> data) {
+        // the caller's previous data may not be around for much longer, so anything still pending in it goes first
+        if (!m_buffered) {
+            keep();
+        }
+
+        if (!m_buffered) {
+            m_input = data;
+            m_position = 0;
+            return;
+        }
+
+        m_buffer.insert(m_buffer.end(), data.begin(), data.end());
+        m_input = m_buffer;
+    }
+
+    std::optional<CommandParser::Arguments> CommandParser::next() {
+        while (!m_error.has_value() && m_position < m_input.size()) {
+            size_t position{m_position + m_resume};
+
+            if (m_count == 0) {
+                const auto count = decode_length(position, '*', "multibulk");
+                if (!count.has_value()) {
+                    return std::nullopt;
+                }
+
+                // empty and null arrays are no command at all, and redis skips them just the same
+                if (*count <= 0) {
+                    m_position = position;
+                    continue;
+                }
+
+                if (*count > static_cast<int64_t>(max_arguments)) {
+                    fail("invalid multibulk length");
+                    return std::nullopt;
+                }
+
+                m_count = static_cast<size_t>(*count);
+                m_slices.clear();
+                m_resume = position - m_position;
+            }
+
+            while (m_slices.size() < m_count) {
+                const auto length = decode_length(position, '$', "bulk");
+                if (!length.has_value()) {
+                    return std::nullopt;
+                }
+
+                if (*length < 0 || *length > static_cast<int64_t>(max_bulk_length)) {
+                    fail("invalid bulk length");
+                    return std::nullopt;
+                }
+
+                const auto size = static_cast<size_t>(*length);
+                if (m_input.size() - position < size + 2) {
+                    m_needed = position + size + 2 - m_position;
+                    return std::nullopt;
+                }
+
+                const char *argument = m_input.data() + position;
+                if (argument[size] != '\r' || argument[size + 1] != '\n') {
+                    fail("expected CRLF after bulk string");
+                    return std::nullopt;
+                }
+
+                m_slices.push_back({position - m_position, size});
+                position += size + 2;
+                m_resume = position - m_position;
+            }
+
+            const char *command = m_input.data() + m_position;
+            m_arguments.clear();
+            for (const auto &[offset, size]: m_slices) {
+                m_arguments.emplace_back(command + offset, size);
+            }
+
+            m_position = position;
+            m_count = 0;
+            m_resume = 0;
+            m_needed = 0;
+            return Arguments{m_arguments};
+        }
+
+        return std::nullopt;
+    }
+
+    void CommandParser::rewind(const size_t mark) {
+        m_position = mark;
+        m_count = 0;
+        m_slices.clear();
+        m_resume = 0;
+        m_needed = 0;
+        m_error.reset();
+    }
+
+    void CommandParser::keep() {
+        if (m_buffered) {
+            m_buffer.erase(m_buffer.begin(), m_buffer.begin() + static_cast<std::ptrdiff_t>(m_position));
+        } else {
+            const auto pending = m_input.subspan(std::min(m_position, m_input.size()));
+            m_buffer.assign(pending.begin(), pending.end());
+        }
+
+        // once a large command has gone through, give its memory back rather than keeping it around for good
+        if (m_buffer.empty() && m_buffer.capacity() > m_buffer_limit) {
+            m_buffer = std::vector<char>{};
+        }
+
+        // and make room for all of a large argument at once, rather than growing into it as it arrives
+        if (m_needed > m_buffer.size()) {
+            m_buffer.reserve(m_needed);
+        }
+
+        m_buffered = !m_buffer.empty();
+        m_input = m_buffered ? std::span<const char>{m_buffer} : std::span<const char>{};
+        m_position = 0;
+    }
+
+    std::optional<int64_t> CommandParser::decode_length(size_t &position, const char type,
+                                                        const std::string_view what) {
+        if (position >= m_input.size()) {
+            return std::nullopt;
+        }
+
+        if (m_input[position] != type) {
+            fail(std::format("expected '{}', got '{}'", type, m_input[position]));
+            return std::nullopt;
+        }
+
+        // the line may not be much longer than any length a client could mean, or it is not a length
+        const auto line = m_input.subspan(position + 1);
+        const size_t end = find_crlf(line.first(std::min(line.size(), max_line_length + 2)));
+        if (end == std::string_view::npos) {
+            if (line.size() >= max_line_length + 2) {
+                fail(std::format("invalid {} length", what));
+            }
+            return std::nullopt;
+        }
+
+        const auto length = parse_length({line.data(), end});
+        if (!length.has_value()) {
+            fail(std::format("invalid {} length", what));
+            return std::nullopt;
+        }
+
+        position += 1 + end + 2;
+        return length;
+    }
+
+    void CommandParser::fail(std::string message) {
+        m_error = "Protocol error: " + std::move(message);
+    }
+}
@@ -4,6 +4,8 @@
 
 #include "connection.h"
 
+#include <algorithm>
+#include <atomic>
 #include <fcntl.h>
 #include <format>
 #include <iostream>
@@ -12,67 +14,596 @@
 #include <sys/epoll.h>
 #include <sys/socket.h>
 
+#include "connection_pool.h"
 #include "request_handler.h"
 
+namespace {
+    // the channel's eventfd, registered alongside the connection's socket
+    class Doorbell final : public EventLoop::Handler {
+    public:
+        explicit Doorbell(std::shared_ptr<Connection *> connection): m_connection{std::move(connection)} {
+        }
+
+        void handle(const uint32_t events) override {
+            if (Connection *connection = *m_connection) {
+                connection->handle_doorbell();
+            }
+        }
+
+    private:
+        std::shared_ptr<Connection *> m_connection;
+    };
+}
+
+void Connection::operator delete(Connection *connection, std::destroying_delete_t) {
+    ConnectionPool *pool = connection->m_pool;
+
+    // a token that nothing else holds on to can be handed to the next connection as it is
+    std::shared_ptr<Connection *> self{};
+    if (pool != nullptr && connection->m_self.use_count() == 1) {
+        self = std::move(connection->m_self);
+        *self = nullptr;
+    }
+
+    connection->~Connection();
+
+    if (pool != nullptr) {
+        pool->release(connection, std::move(self));
+    } else {
+        ::operator delete(connection);
+    }
+}
+
+uint64_t Connection::next_id() {
+    // connections are created on every shard's thread
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Connection::set_protocol(const resp::Protocol protocol) {
+    // with I/O threads, replies are only serialized once they are sent, so those already produced are written out now,
+    // in the protocol they were produced for
+    for (const resp::Value &reply: m_replies) {
+        m_write_buffer.append(reply, m_protocol);
+    }
+    m_replies.clear();
+
+    m_protocol = protocol;
+}
+
+void Connection::invalidate(const std::optional<std::string_view> key) {
+    // RESP2 has no way of telling a push from a reply
+    if (m_tracking == Tracking::off || m_protocol != resp::Protocol::resp3) {
+        return;
+    }
+
+    resp::Array keys{std::nullopt};
+    if (key.has_value()) {
+        keys = resp::Array{std::vector<resp::Value>{resp::BulkString{std::string{*key}}}};
+    }
+
+    // pushes are not replies, and go out whatever CLIENT REPLY says
+    queue(resp::Push{std::vector<resp::Value>{resp::BulkString{"invalidate"}, std::move(keys)}});
+    flush();
+}
+
 void Connection::handle(const uint32_t events) {
-    if (events & EPOLLIN) {
-        handle_receive();
-    } else if (events & EPOLLOUT) {
+    // a client on a channel has nothing more to say on its socket, so anything happening there means it has gone
+    if (m_channel) {
+        disconnect();
+        return;
+    }
+
+    dispatch(events & EPOLLOUT, events & EPOLLIN);
+}
+
+void Connection::handle_doorbell() {
+    m_channel->answer_doorbell();
+    dispatch(m_writable_armed, true);
+}
+
+void Connection::dispatch(const bool writable, bool readable) {
+    // while yielded, whatever is still waiting in the socket stays there until the held back requests are served
+    readable = readable && *m_self && !m_yielded;
+
+    if (m_event_loop.offloading()) {
+        if (writable && !m_send_offloaded) {
+            m_send_offloaded = true;
+            m_event_loop.offload_send(m_socket);
+        }
+
+        if (readable && !m_receive_offloaded) {
+            m_receive_offloaded = true;
+            m_event_loop.offload_receive(m_socket);
+        }
+        return;
+    }
+
+    if (writable) {
         handle_send();
     }
+
+    if (readable) {
+        handle_receive();
+    }
 }
 
 void Connection::handle_receive() {
-    while (true) {
-        const ssize_t bytes_received = recv(m_socket, m_read_buffer.data(), buffer_size, 0);
+    // the loop's buffer is shared by all its connections, so whatever the parser cannot serve yet it has to copy
+    finish_receive(receive(m_event_loop.receive_buffer(), [this](const std::span<const char> data) { process(data); }));
+}
+
+void Connection::io_receive(const std::span<char> buffer) {
+    // the buffer is this thread's scratch space, so the requests are copied out of it and served once back on the
+    // loop's thread
+    m_io_received = receive(buffer, [this](const std::span<const char> data) {
+        if (!m_closing) {
+            m_parser.feed(data);
+            m_parser.keep();
+        }
+    });
+}
+
+void Connection::handle_io_received() {
+    m_receive_offloaded = false;
+    execute();
+    finish_receive(m_io_received);
+}
+
+Connection::Received Connection::receive(const std::span<char> buffer,
+                                         const std::function<void(std::span<const char>)> &consume) {
+    size_t bytes_read{0};
+
+    while (!m_yielded && *m_self) {
+        // leave the rest for the next iteration; the socket is still readable then, so epoll reports it again
+        if (m_options.byte_budget > 0 && bytes_read >= m_options.byte_budget) {
+            return Received::out_of_budget;
+        }
+
+        if (m_channel) {
+            std::span<const char> data{};
+            try {
+                data = m_channel->readable();
+            } catch (const std::system_error &) {
+                // a client that has broken its ring is treated like one that has gone
+                return Received::closed;
+            }
+            if (data.empty()) {
+                if (m_channel->expect_data()) {
+                    return Received::drained;
+                }
+                continue;
+            }
+
+            // the requests are decoded straight out of the ring
+            if (m_options.byte_budget > 0) {
+                data = data.first(std::min(data.size(), m_options.byte_budget - bytes_read));
+            }
+            m_last_active = m_event_loop.now();
+            bytes_read += data.size();
+            consume(data);
+            m_channel->consume(data.size());
+            continue;
+        }
+
+        const ssize_t bytes_received = recv(m_socket, buffer.data(), buffer.size(), 0);
 
         if (bytes_received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-            // we have fully drained the buffer and there is no longer a read
-            return;
+            return Received::drained;
         }
 
         // either the connection was closed gracefully by the client, or the connection is broken in some way
         if (bytes_received <= 0) {
-            m_event_loop.remove_handler(m_socket);
-            return;
+            return Received::closed;
+        }
+
+        m_last_active = m_event_loop.now();
+        bytes_read += bytes_received;
+        consume(buffer.first(static_cast<size_t>(bytes_received)));
+    }
+
+    return Received::yielded;
+}
+
+void Connection::finish_receive(const Received received) {
+    if (received == Received::closed) {
+        disconnect();
+        return;
+    }
+
+    if (received == Received::out_of_budget) {
+        ++m_event_loop.stats().budget_yields;
+    }
+
+    // a socket stays readable for as long as it holds data, a ring has to be reminded
+    if (m_channel && received != Received::drained) {
+        m_channel->ring_doorbell();
+    }
+
+    // there is no longer a read, so answer everything it held at once
+    flush();
+}
+
+void Connection::handle_received(const std::span<const char> data) {
+    // on a channel's socket, even data means the client is not following the protocol
+    if (data.empty() || m_channel) {
+        disconnect();
+        return;
+    }
+
+    m_last_active = m_event_loop.now();
+
+    // the data is here already, so all the byte budget can do is hold it back: once this iteration's bytes are spent,
+    // what arrives is only parsed, and served in the next iteration
+    if (m_options.byte_budget > 0) {
+        renew_budget();
+        if (m_bytes_left == 0 && !m_yielded) {
+            yield();
+        }
+        m_bytes_left -= std::min(m_bytes_left, data.size());
+    }
+
+    process(data);
+    flush();
+}
+
+void Connection::process(const std::span<const char> data) {
+    if (m_closing) {
+        return;
+    }
+
+    m_parser.feed(data);
+    execute();
+}
+
+void Connection::execute() {
+    // an I/O thread is still feeding the parser; what it received is served once it is done
+    if (m_receive_offloaded || m_closing) {
+        return;
+    }
+
+    while (!m_suspended && !m_yielded) {
+        if (!has_budget()) {
+            if (m_parser.pending() || m_batch_next < m_batch.size()) {
+                yield();
+            }
+            break;
+        }
+
+        const auto arguments = next_command();
+        if (!arguments.has_value()) {
+            break;
+        }
+
+        spend_budget();
+
+        // the mode stays in force until CLIENT REPLY changes it again, except for SKIP, which only mutes this command
+        m_muted = m_reply != Reply::on;
+        if (m_reply == Reply::skip) {
+            m_reply = Reply::on;
+        }
+        m_request_handler.handle(*arguments, *this);
+    }
+    drop_batch();
+
+    // like redis, tell the client what it got wrong before hanging up on it. the error goes out behind the replies
+    // before it, with the flush every caller ends on, and the connection is only closed once it has
+    if (m_parser.error().has_value() && *m_self) {
+        queue(resp::SimpleError{"ERR", *m_parser.error()});
+        m_closing = true;
+    }
+
+    m_parser.keep();
+}
+
+void Connection::resume() {
+    m_suspended = false;
+    execute();
+    flush();
+}
+
+std::optional<RequestHandler::Arguments> Connection::next_command() {
+    if (m_batch_next == m_batch.size()) {
+        decode_batch();
+    }
+    if (m_batch_next == m_batch.size()) {
+        return std::nullopt;
+    }
+
+    const size_t begin = m_batch_next == 0 ? 0 : m_batch[m_batch_next - 1].end;
+    const size_t end = m_batch[m_batch_next++].end;
+    return RequestHandler::Arguments{m_batch_arguments}.subspan(begin, end - begin);
+}
+
+void Connection::decode_batch() {
+    m_batch_arguments.clear();
+    m_batch.clear();
+    m_batch_next = 0;
+
+    // no more than the budget lets run, and one at a time while there is nothing to prefetch
+    const size_t wanted = m_request_handler.prefetching() ? batch_size : 1;
+    const size_t limit = m_options.command_budget == 0 ? wanted : std::min(wanted, m_commands_left);
+    while (m_batch.size() < limit) {
+        const size_t mark = m_parser.mark();
+        const auto arguments = m_parser.next();
+        if (!arguments.has_value()) {
+            break;
+        }
+
+        // the arguments point into data the parser holds on to until it is next fed
+        m_batch_arguments.insert(m_batch_arguments.end(), arguments->begin(), arguments->end());
+        m_batch.push_back({mark, m_batch_arguments.size()});
+    }
+
+    // on a data set larger than the cache, every command's lookups miss it; with several commands at hand, the misses
+    // all get going together before the first command waits for its own
+    if (m_batch.size() > 1) {
+        for (size_t i{0}; i < m_batch.size(); ++i) {
+            const size_t begin = i == 0 ? 0 : m_batch[i - 1].end;
+            m_request_handler.prefetch(RequestHandler::Arguments{m_batch_arguments}.subspan(
+                begin, m_batch[i].end - begin));
+        }
+    }
+}
+
+void Connection::drop_batch() {
+    if (m_batch_next < m_batch.size()) {
+        m_parser.rewind(m_batch[m_batch_next].mark);
+    }
+
+    m_batch_arguments.clear();
+    m_batch.clear();
+    m_batch_next = 0;
+}
+
+void Connection::renew_budget() {
+    if (m_budget_iteration != m_event_loop.iteration()) {
+        m_budget_iteration = m_event_loop.iteration();
+        m_commands_left = m_options.command_budget;
+        m_bytes_left = m_options.byte_budget;
+    }
+}
+
+bool Connection::has_budget() {
+    if (m_options.command_budget == 0) {
+        return true;
+    }
+
+    renew_budget();
+    return m_commands_left > 0;
+}
+
+void Connection::spend_budget() {
+    if (m_options.command_budget > 0) {
+        --m_commands_left;
+    }
+}
+
+void Connection::yield() {
+    m_yielded = true;
+    ++m_event_loop.stats().budget_yields;
+
+    m_event_loop.defer([self = m_self] {
+        if (Connection *connection = *self) {
+            connection->m_yielded = false;
+            connection->execute();
+            connection->flush();
+
+            // a socket with data left in it is reported again by itself, but a ring that was left alone while yielded
+            // has to be come back to
+            if (connection->m_channel) {
+                connection->m_channel->ring_doorbell();
+            }
         }
+    });
+}
+
+void Connection::disconnect() {
+    // nothing may be sent to us from here on, even though we live until the end of the loop iteration
+    *m_self = nullptr;
+    m_event_loop.timers().cancel(m_idle_timer);
+    m_event_loop.remove_handler(m_socket);
+    if (m_channel) {
+        m_event_loop.remove_handler(m_channel->doorbell());
+    }
+}
 
-        m_parser.feed(std::span{m_read_buffer.data(), static_cast<size_t>(bytes_received)});
+void Connection::add_doorbell() {
+    m_event_loop.add_handler(m_channel->doorbell(), EPOLLIN, std::make_unique<Doorbell>(m_self));
+}
 
-        for (const resp::Value &value: m_parser.take_values()) {
-            m_request_handler.handle(value, *this);
+void Connection::schedule_idle_check(const TimerWheel::Clock::duration delay) {
+    m_idle_timer = m_event_loop.timers().schedule(delay, [self = m_self] {
+        if (Connection *connection = *self) {
+            connection->check_idle();
         }
+    });
+}
+
+void Connection::check_idle() {
+    const auto idle = m_event_loop.now() - m_last_active;
+
+    // a client waiting on another shard's reply is not idle, whatever it has or has not sent
+    if (m_suspended) {
+        schedule_idle_check(m_options.idle_timeout);
+        return;
     }
+
+    if (idle < m_options.idle_timeout) {
+        schedule_idle_check(m_options.idle_timeout - idle);
+        return;
+    }
+
+    disconnect();
 }
 
 void Connection::handle_send() {
-    while (m_bytes_remaining > 0) {
-        const ssize_t bytes_sent = ::send(m_socket, m_write_buffer.data() + m_bytes_sent, m_bytes_remaining, 0);
+    finish_send(send_written());
+}
+
+void Connection::io_send() {
+    for (const resp::Value &reply: m_replies) {
+        m_write_buffer.append(reply, m_protocol);
+    }
+    m_replies = std::vector<resp::Value>{};
 
-        // write not actually available
+    m_io_sent = send_written();
+}
+
+void Connection::handle_io_sent() {
+    m_send_offloaded = false;
+    finish_send(m_io_sent);
+}
+
+Connection::Sent Connection::send_written() {
+    while (m_channel && !m_write_buffer.empty()) {
+        iovec iovecs[max_iovecs];
+        size_t written{};
+        try {
+            written = m_channel->write(std::span{iovecs, m_write_buffer.gather(iovecs)});
+        } catch (const std::system_error &) {
+            return Sent::failed;
+        }
+
+        // the ring is full, and the client rings once it has made room
+        if (written == 0) {
+            return Sent::would_block;
+        }
+
+        m_write_buffer.consume(written);
+    }
+
+    while (!m_write_buffer.empty()) {
+        iovec iovecs[max_iovecs];
+        msghdr message{};
+        message.msg_iov = iovecs;
+        message.msg_iovlen = m_write_buffer.gather(iovecs);
+
+        const ssize_t bytes_sent = sendmsg(m_socket, &message, MSG_NOSIGNAL);
+
+        // the kernel buffer is full, so wait until it drains
         if (bytes_sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-            return;
+            return Sent::would_block;
         }
 
         // client has closed the connection, or connection is no longer good
         if (bytes_sent == -1) {
-            m_event_loop.remove_handler(m_socket);
-            return;
+            return Sent::failed;
+        }
+
+        m_write_buffer.consume(bytes_sent);
+    }
+
+    return Sent::all;
+}
+
+void Connection::finish_send(const Sent sent) {
+    if (sent == Sent::failed) {
+        disconnect();
+        return;
+    }
+
+    // a channel's doorbell rings for room in the ring anyway
+    if (sent == Sent::would_block) {
+        if (!m_writable_armed && !m_channel) {
+            m_event_loop.modify_handler(m_socket, EPOLLIN | EPOLLOUT);
         }
+        m_writable_armed = true;
+        return;
+    }
 
-        m_bytes_sent += bytes_sent;
-        m_bytes_remaining -= bytes_sent;
+    if (m_closing) {
+        disconnect();
+        return;
     }
 
-    m_write_buffer.clear();
-    m_bytes_sent = 0;
-    m_event_loop.modify_handler(m_socket, EPOLLIN);
+    if (m_writable_armed && !m_channel) {
+        m_event_loop.modify_handler(m_socket, EPOLLIN);
+    }
+    m_writable_armed = false;
+}
+
+void Connection::handle_sent(const ssize_t bytes_sent) {
+    if (bytes_sent < 0) {
+        disconnect();
+        return;
+    }
+
+    m_send_buffer.consume(bytes_sent);
+    if (!m_send_buffer.empty()) {
+        send_buffered();
+        return;
+    }
+
+    m_iovecs = std::vector<iovec>{};
+    m_sending = false;
+    flush();
+
+    if (m_closing && !m_sending) {
+        disconnect();
+    }
 }
 
 void Connection::send(const resp::Value &value) {
-    const size_t before = m_write_buffer.size();
-    serialize(value, m_write_buffer);
-    // subscribe to write events
-    m_event_loop.modify_handler(m_socket, EPOLLIN | EPOLLOUT);
-    m_bytes_remaining += m_write_buffer.size() - before;
+    if (!m_muted) {
+        queue(value);
+    }
+}
+
+void Connection::queue(const resp::Value &value) {
+    // replies are only gathered here; everything a batch of requests produced goes out together, see flush
+    if (m_event_loop.offloading()) {
+        // serialized on an I/O thread
+        m_replies.push_back(value);
+        return;
+    }
+
+    m_write_buffer.append(value, m_protocol);
+}
+
+size_t Connection::memory_usage() const {
+    return sizeof(*this) + (m_channel ? sizeof(ShmChannel) + m_channel->memory_size() : 0) +
+           m_parser.memory_usage() + m_write_buffer.memory_usage() + m_send_buffer.memory_usage() +
+           m_iovecs.capacity() * sizeof(iovec) + m_replies.capacity() * sizeof(resp::Value) +
+           m_batch_arguments.capacity() * sizeof(std::string_view) + m_batch.capacity() * sizeof(Decoded) +
+           m_transaction.commands.capacity() * sizeof(resp::Array);
+}
+
+void Connection::flush() {
+    if (m_event_loop.offloading()) {
+        // as below, while write readiness is armed the send is queued once the kernel buffer drains
+        if (!m_writable_armed && !m_send_offloaded && !m_replies.empty()) {
+            m_send_offloaded = true;
+            m_event_loop.offload_send(m_socket);
+        }
+        return;
+    }
+
+    // a channel is written to directly, whatever the loop's backend
+    if (m_channel || !m_event_loop.completion_based()) {
+        // while write readiness is armed the kernel buffer is still full, and handle_send picks these up once it drains
+        if (!m_writable_armed) {
+            handle_send();
+        }
+        return;
+    }
+
+    if (m_sending || m_write_buffer.empty()) {
+        return;
+    }
+
+    // replies produced while this send is in flight pile up in the write buffer and go out with the next one
+    std::swap(m_write_buffer, m_send_buffer);
+    m_sending = true;
+    send_buffered();
+}
+
+void Connection::send_buffered() {
+    m_iovecs.resize(max_iovecs);
+    m_iovecs.resize(m_send_buffer.gather(m_iovecs));
+
+    m_message = msghdr{};
+    m_message.msg_iov = m_iovecs.data();
+    m_message.msg_iovlen = m_iovecs.size();
+    m_event_loop.send(m_socket, m_message);
 }
@@ -0,0 +1,53 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "connection_pool.h"
+
+#include <new>
+
+ConnectionPool::~ConnectionPool() {
+    for (void *storage: m_storage) {
+        ::operator delete(storage);
+    }
+}
+
+std::unique_ptr<Connection> ConnectionPool::acquire(const int socket, RequestHandler &request_handler,
+                                                    EventLoop &event_loop, const Connection::Options &options,
+                                                    std::unique_ptr<ShmChannel> channel) {
+    void *storage{};
+    if (m_storage.empty()) {
+        storage = ::operator new(sizeof(Connection));
+    } else {
+        storage = m_storage.back();
+        m_storage.pop_back();
+    }
+
+    std::shared_ptr<Connection *> self{};
+    if (!m_tokens.empty()) {
+        self = std::move(m_tokens.back());
+        m_tokens.pop_back();
+    }
+
+    try {
+        return std::unique_ptr<Connection>{
+            new(storage) Connection{socket, request_handler, event_loop, options, std::move(channel), this,
+                                    std::move(self)}
+        };
+    } catch (...) {
+        ::operator delete(storage);
+        throw;
+    }
+}
+
+void ConnectionPool::release(void *storage, std::shared_ptr<Connection *> self) {
+    if (m_storage.size() >= max_connections) {
+        ::operator delete(storage);
+    } else {
+        m_storage.push_back(storage);
+    }
+
+    if (self && m_tokens.size() < max_connections) {
+        m_tokens.push_back(std::move(self));
+    }
+}
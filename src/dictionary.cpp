@@ -4,95 +4,137 @@
 
 #include "dictionary.h"
 
-#include <cassert>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <expected>
 #include <fstream>
 
-std::optional<std::reference_wrapper<resp::Value> > Dictionary::get(const std::string &key) {
-    if (!exists(key)) {
+std::optional<std::reference_wrapper<resp::Value> > Dictionary::get(const std::string_view key) {
+    const auto entry = find(key);
+    if (entry == m_map.end()) {
         return std::nullopt;
     }
 
-    return m_map.at(key).first;
+    return entry->second.value;
 }
 
-void Dictionary::set(const std::string &key, const resp::Value &value, const std::optional<Timestamp> &expiry) {
-    m_map[key] = {value, expiry};
+void Dictionary::prefetch(const std::string_view key) const {
+    if (!worth_prefetching()) {
+        return;
+    }
+
+    // the bucket both libstdc++ and libc++ put the key in. the bucket array is read to find the bucket's first entry,
+    // and nothing waits on that read but the prefetch of the entry, so one key's reads overlap with the next key's
+    const size_t bucket = m_map.hash_function()(key) % m_map.bucket_count();
+    if (const auto entry = m_map.begin(bucket); entry != m_map.end(bucket)) {
+        __builtin_prefetch(&*entry);
+    }
+}
+
+void Dictionary::set(const std::string_view key, resp::Value value, const std::optional<Timestamp> &expiry) {
+    Entry entry{resp::share(std::move(value), m_encode_threshold), expiry, ++m_version};
+
+    if (const auto existing = m_map.find(key); existing != m_map.end()) {
+        existing->second = std::move(entry);
+    } else {
+        m_map.emplace(std::string{key}, std::move(entry));
+    }
+    modified(key);
 }
 
 std::optional<resp::Value> Dictionary::set_and_get(
-    const std::string &key, const resp::Value &value, const std::optional<Timestamp> &expiry) {
+    const std::string_view key, resp::Value value, const std::optional<Timestamp> &expiry) {
     std::optional<resp::Value> previous = get(key);
 
-    set(key, value, expiry);
+    set(key, std::move(value), expiry);
     return previous;
 }
 
 void Dictionary::flush() {
     m_map.clear();
-}
-
-bool Dictionary::exists(const std::string &key) {
-    if (!m_map.contains(key)) {
-        return false;
+    m_last_deletion = ++m_version;
+    if (m_observer) {
+        m_observer->flushed();
     }
+}
 
-    if (expired(key)) {
-        m_map.erase(key);
-        return false;
-    }
+bool Dictionary::exists(const std::string_view key) {
+    return find(key) != m_map.end();
+}
 
-    return true;
+uint64_t Dictionary::version(const std::string_view key) {
+    const auto entry = find(key);
+    return entry == m_map.end() ? m_last_deletion : entry->second.version;
 }
 
-void Dictionary::del(const std::string &key) {
-    m_map.erase(key);
+void Dictionary::del(const std::string_view key) {
+    if (const auto entry = m_map.find(key); entry != m_map.end()) {
+        m_map.erase(entry);
+        deleted(key);
+    }
 }
 
-ssize_t Dictionary::push(const std::string &key, const std::span<const resp::Value> values, const bool reverse) {
-    const auto value = get(key);
+ssize_t Dictionary::push(const std::string_view key, const std::span<const std::string_view> values,
+                         const bool reverse) {
+    const auto to_value = [](const std::string_view value) { return resp::Value{resp::BulkString{std::string{value}}}; };
 
-    if (!value.has_value()) {
-        m_map[key] = {
-            resp::Array{
-                reverse
-                    ? std::vector<resp::Value>{values.rbegin(), values.rend()}
-                    : std::vector<resp::Value>{values.begin(), values.end()},
-            },
-            std::nullopt,
-        };
+    const auto entry = find(key);
+
+    if (entry == m_map.end()) {
+        std::vector<resp::Value> elements{};
+        elements.reserve(values.size());
+        if (reverse) {
+            std::ranges::transform(values.rbegin(), values.rend(), std::back_inserter(elements), to_value);
+        } else {
+            std::ranges::transform(values, std::back_inserter(elements), to_value);
+        }
+
+        set(key, resp::Array{std::move(elements)});
         return static_cast<ssize_t>(values.size());
     }
 
-    auto *array = std::get_if<resp::Array>(&value->get());
-    if (array == nullptr || !array->value.has_value()) {
+    auto *array = std::get_if<resp::SharedArray>(&entry->second.value);
+    if (array == nullptr) {
         return -1;
     }
 
+    // a reply may still be sending the elements as they are, so they are changed in a copy of their own. otherwise the
+    // fence makes sure whatever the last reply on another thread read of them is done with before they change
+    if (array->values.use_count() > 1) {
+        array->values = std::make_shared<std::vector<resp::Value> >(*array->values);
+    } else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    std::vector<resp::Value> &elements = *array->values;
     if (reverse) {
-        array->value->insert(array->value->begin(), values.rbegin(), values.rend());
+        elements.insert(elements.begin(), values.size(), resp::Value{});
+        std::ranges::transform(values.rbegin(), values.rend(), elements.begin(), to_value);
     } else {
-        array->value->insert(array->value->end(), values.begin(), values.end());
+        elements.reserve(elements.size() + values.size());
+        std::ranges::transform(values, std::back_inserter(elements), to_value);
     }
+    array->count = elements.size();
 
-    return static_cast<ssize_t>(array->value->size());
+    modified(entry);
+    return static_cast<ssize_t>(elements.size());
 }
 
-std::optional<std::span<const resp::Value> >
-Dictionary::range(const std::string &key, ptrdiff_t start, ptrdiff_t stop) {
+std::optional<resp::SharedArray>
+Dictionary::range(const std::string_view key, ptrdiff_t start, ptrdiff_t stop) {
     const auto value = get(key);
 
     if (!value.has_value()) {
-        return std::span<const resp::Value>{};
+        return resp::SharedArray{};
     }
 
-    auto *array = std::get_if<resp::Array>(&value->get());
-    if (array == nullptr || !array->value.has_value()) {
+    const auto *array = std::get_if<resp::SharedArray>(&value->get());
+    if (array == nullptr) {
         return std::nullopt;
     }
 
-    const auto size = static_cast<ptrdiff_t>(array->value->size());
+    const auto size = static_cast<ptrdiff_t>(array->count);
 
     if (start < 0) {
         start = size + start;
@@ -103,24 +145,25 @@ Dictionary::range(const std::string &key, ptrdiff_t start, ptrdiff_t stop) {
     }
 
     if (size == 0 || stop < start) {
-        return std::span<const resp::Value>{};
+        return resp::SharedArray{};
     }
 
     start = std::clamp(start, ptrdiff_t{0}, size - 1);
     stop = std::clamp(stop, start, size - 1);
 
-    return std::span{array->value->data() + start, static_cast<size_t>(stop - start + 1)};
+    return resp::SharedArray{array->values, static_cast<size_t>(start), static_cast<size_t>(stop - start + 1)};
 }
 
-std::expected<int64_t, Dictionary::incr_error> Dictionary::incr(const std::string &key, const int64_t amount) {
+std::expected<int64_t, Dictionary::incr_error> Dictionary::incr(const std::string_view key, const int64_t amount) {
     int64_t previous{0};
 
-    if (const auto &value = get(key)) {
-        if (!std::holds_alternative<resp::BulkString>(value->get())) {
+    if (const auto entry = find(key); entry != m_map.end()) {
+        resp::Value &stored = entry->second.value;
+        if (!std::holds_alternative<resp::BulkString>(stored) && !std::holds_alternative<resp::SharedString>(stored)) {
             return std::unexpected{incr_error::non_bulk_string_value};
         }
 
-        std::optional<std::string> &string = std::get<resp::BulkString>(value->get()).value;
+        const auto string = resp::string_of(stored);
 
         if (!string.has_value()) {
             return std::unexpected{incr_error::null_bulk_string_value};
@@ -132,12 +175,9 @@ std::expected<int64_t, Dictionary::incr_error> Dictionary::incr(const std::strin
             return std::unexpected{incr_error::non_numeric_value};
         }
 
-        // enough for 64-bit integer
-        string->resize_and_overwrite(20, [&](char *buffer, size_t) -> size_t {
-            auto [ptr, ec] = std::to_chars(buffer, buffer + 20, previous + 1);
-            assert(ec == std::errc()); // this should never fail (in theory)
-            return static_cast<size_t>(ptr - buffer); // number of chars written
-        });
+        // a shared string may still be on its way out to a client, so the number is replaced rather than rewritten
+        stored = resp::BulkString{std::to_string(previous + amount)};
+        modified(entry);
 
         return previous + amount;
     }
@@ -149,14 +189,18 @@ std::expected<int64_t, Dictionary::incr_error> Dictionary::incr(const std::strin
 void Dictionary::save(std::ostream &stream) const {
     const size_t size{m_map.size()};
     stream.write(reinterpret_cast<const char *>(&size), sizeof(size));
-    for (const auto &[key, value]: m_map) {
+    save_entries(stream);
+}
+
+void Dictionary::save_entries(std::ostream &stream) const {
+    for (const auto &[key, entry]: m_map) {
         const auto key_size{static_cast<std::streamsize>(key.size())};
         stream.write(reinterpret_cast<const char *>(&key_size), sizeof(key_size));
         stream.write(key.data(), key_size);
 
-        resp::save(value.first, stream);
+        resp::save(entry.value, stream);
 
-        const auto timestamp = value.second;
+        const auto timestamp = entry.expiry;
         const bool has_timestamp = timestamp.has_value();
         stream.write(reinterpret_cast<const char *>(&has_timestamp), sizeof(bool));
 
@@ -167,7 +211,7 @@ void Dictionary::save(std::ostream &stream) const {
     }
 }
 
-void Dictionary::load(std::istream &stream) {
+void Dictionary::load(std::istream &stream, const std::function<bool(const std::string &)> &keep) {
     size_t size{};
     stream.read(reinterpret_cast<char *>(&size), sizeof(size));
 
@@ -185,17 +229,24 @@ void Dictionary::load(std::istream &stream) {
             stream.read(reinterpret_cast<char *>(&count), sizeof(count));
             timestamp = Timestamp{Clock::duration{count}};
         }
-        set(key, value, timestamp);
+        if (!keep || keep(key)) {
+            set(key, value, timestamp);
+        }
     }
 }
 
-bool Dictionary::expired(const std::string &key) const {
-    if (!m_map.contains(key)) {
-        return false;
+Dictionary::Map::iterator Dictionary::find(const std::string_view key) {
+    const auto entry = m_map.find(key);
+    if (entry == m_map.end()) {
+        return entry;
     }
 
-    const auto timestamp = m_map.at(key).second;
+    if (const auto &expiry = entry->second.expiry; expiry.has_value() && Clock::now() >= *expiry) {
+        m_map.erase(entry);
+        deleted(key);
+        return m_map.end();
+    }
 
-    return timestamp.has_value() && Clock::now() >= *timestamp;
+    return entry;
 }
 
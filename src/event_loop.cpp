@@ -4,76 +4,482 @@
 
 #include "event_loop.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <fcntl.h>
 #include <format>
 #include <iostream>
+#include <stdexcept>
 #include <system_error>
+#include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "uring.h"
+
+namespace {
+    // what epoll hands back with every event: the fd to find the registration by, and the generation to check it with
+    uint64_t epoll_data_of(const int fd, const uint32_t generation) {
+        return static_cast<uint64_t>(generation) << 32 | static_cast<uint32_t>(fd);
+    }
+
+    void set_non_blocking(const int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags == -1) {
+            throw std::system_error(errno, std::system_category(), "EventLoop::add_handler fcntl");
+        }
+
+        flags |= O_NONBLOCK;
+        if (fcntl(fd, F_SETFL, flags) == -1) {
+            throw std::system_error(errno, std::system_category(), "EventLoop::add_handler fcntl");
+        }
+    }
+}
+
+EventLoop::EventLoop(const Backend backend, const size_t io_threads,
+                     const std::chrono::microseconds busy_poll): m_backend{backend}, m_busy_poll{busy_poll} {
+    if (m_backend == Backend::io_uring) {
+        m_ring = std::make_unique<Uring>(ring_entries);
+        m_ring->provide_buffers(buffer_group, buffer_count, buffer_size);
+        return;
+    }
+
+    m_receive_buffer.resize(receive_buffer_size);
+
+    if (io_threads > 1) {
+        m_io_threads = std::make_unique<IoThreads>(io_threads);
+        m_io_buffers.resize(io_threads - 1, std::vector<char>(receive_buffer_size));
+    }
 
-EventLoop::EventLoop() {
     m_epoll = epoll_create1(EPOLL_CLOEXEC);
     if (m_epoll == -1) {
         throw std::system_error(errno, std::system_category(), "Server::start epoll_create");
     }
 }
 
+EventLoop::~EventLoop() {
+    if (m_epoll != -1) {
+        close(m_epoll);
+    }
+}
+
 void EventLoop::start() {
     while (true) {
+        // whatever was removed during the last iteration can go, unless the kernel still has operations in flight for
+        // it
+        std::erase_if(m_removed, [this](std::unique_ptr<Registration> &registration) {
+            if (registration->pending > 0) {
+                return false;
+            }
+
+            if (m_spare_registrations.size() < max_spare_registrations) {
+                registration->handler.reset();
+                m_spare_registrations.push_back(std::move(registration));
+            }
+            return true;
+        });
+        ++m_iteration;
+
+        if (m_ring) {
+            arm_timeout();
+            // the timeout armed above completes when the next timer is due, which ends the spin in time for it
+            const bool ready = !m_deferred.empty() ||
+                               spin(TimerWheel::Clock::time_point::max(), [this] { return m_ring->poll(); });
+            m_ring->submit(ready ? 0 : 1);
+            m_now = TimerWheel::Clock::now();
+            m_ring->for_each_completion([this](const io_uring_cqe &cqe) { complete(cqe); });
+            m_timers.advance(m_now);
+            run_deferred();
+            m_stats.work_nanoseconds += (TimerWheel::Clock::now() - m_now) / std::chrono::nanoseconds{1};
+            continue;
+        }
+
+        int timeout{-1};
+        auto deadline = TimerWheel::Clock::time_point::max();
+        if (!m_deferred.empty()) {
+            timeout = 0;
+        } else if (const auto until_next = m_timers.until_next(m_now)) {
+            // round up, or we would wake up just before the timer is due and spin
+            timeout = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(*until_next).count());
+            deadline = m_now + *until_next;
+        }
+
         epoll_event events[max_events];
-        for (const int fd: m_removed_fds) {
-            m_handlers.erase(fd);
+        int number_of_events{0};
+        if (timeout != 0) {
+            const bool ready = spin(deadline, [&] {
+                number_of_events = epoll_wait(m_epoll, events, max_events, 0);
+                return number_of_events != 0;
+            });
+
+            // a spin that ran into the next timer leaves nothing to wait for
+            if (!ready && TimerWheel::Clock::now() >= deadline) {
+                timeout = 0;
+            }
+        }
+
+        if (number_of_events == 0) {
+            number_of_events = epoll_wait(m_epoll, events, max_events, timeout);
         }
-        m_removed_fds.clear();
-        const int number_of_events = epoll_wait(m_epoll, events, max_events, -1);
 
         if (number_of_events == -1) {
             throw std::system_error(errno, std::system_category(), "EventLoop::start epoll_wait");
         }
 
+        m_now = TimerWheel::Clock::now();
+
         for (size_t i{0}; i < number_of_events; ++i) {
-            const int fd = events[i].data.fd;
+            const auto fd = static_cast<uint32_t>(events[i].data.u64);
+            const auto generation = static_cast<uint32_t>(events[i].data.u64 >> 32);
+
+            // an earlier handler in this batch may have removed the fd, and maybe even registered a new handler under
+            // the same number
+            if (fd >= m_handlers.size() || !m_handlers[fd] || m_handlers[fd]->generation != generation) { continue; }
+
+            m_handlers[fd]->handler->handle(events[i].events);
+        }
+
+        run_offloaded_receives();
+        m_timers.advance(m_now);
+        run_deferred();
+        run_offloaded_sends();
+        m_stats.work_nanoseconds += (TimerWheel::Clock::now() - m_now) / std::chrono::nanoseconds{1};
+    }
+}
+
+bool EventLoop::spin(const TimerWheel::Clock::time_point deadline, const std::function<bool()> &ready) {
+    if (m_busy_poll == std::chrono::microseconds::zero()) {
+        return false;
+    }
+
+    const auto start = TimerWheel::Clock::now();
+    const auto until = std::min(deadline, start + m_busy_poll);
+
+    bool found{false};
+    auto now = start;
+    while (!found && now < until) {
+        found = ready();
+        now = TimerWheel::Clock::now();
+    }
+
+    m_stats.busy_poll_nanoseconds += (now - start) / std::chrono::nanoseconds{1};
+    if (found) {
+        ++m_stats.busy_poll_hits;
+    }
+    return found;
+}
+
+void EventLoop::run_deferred() {
+    // whatever these defer in turn waits for the iteration after
+    std::vector<std::move_only_function<void()> > deferred{};
+    std::swap(deferred, m_deferred);
+
+    for (auto &task: deferred) {
+        task();
+    }
+}
+
+void EventLoop::run_offloaded_receives() {
+    if (m_offloaded_receives.empty()) {
+        return;
+    }
+
+    std::swap(m_offloaded, m_offloaded_receives);
+    m_stats.io_threaded_reads += m_offloaded.size();
+
+    m_io_threads->run(m_offloaded.size(), [this](const size_t item, const size_t thread) {
+        if (!m_offloaded[item]->removed) {
+            m_offloaded[item]->handler->io_receive(io_buffer(thread));
+        }
+    });
+
+    // executing what was received is left to the loop's thread, in the order the events came in
+    for (Registration *registration: m_offloaded) {
+        if (!registration->removed) {
+            registration->handler->handle_io_received();
+        }
+    }
+
+    m_offloaded.clear();
+}
+
+void EventLoop::run_offloaded_sends() {
+    if (m_offloaded_sends.empty()) {
+        return;
+    }
+
+    std::swap(m_offloaded, m_offloaded_sends);
+    m_stats.io_threaded_writes += m_offloaded.size();
+
+    m_io_threads->run(m_offloaded.size(), [this](const size_t item, size_t) {
+        if (!m_offloaded[item]->removed) {
+            m_offloaded[item]->handler->io_send();
+        }
+    });
+
+    for (Registration *registration: m_offloaded) {
+        if (!registration->removed) {
+            registration->handler->handle_io_sent();
+        }
+    }
+
+    m_offloaded.clear();
+}
 
-            if (!m_handlers.contains(fd)) { continue; }
+std::span<char> EventLoop::io_buffer(const size_t thread) {
+    return thread == 0 ? std::span<char>{m_receive_buffer} : std::span<char>{m_io_buffers[thread - 1]};
+}
 
-            m_handlers.at(fd)->handle(events[i].events);
+size_t EventLoop::handler_memory() const {
+    size_t usage{0};
+    for (const auto &registration: m_handlers) {
+        if (registration) {
+            usage += sizeof(Registration) + registration->handler->memory_usage();
         }
     }
+    return usage;
 }
 
 void EventLoop::add_handler(const int fd, const uint32_t events, std::unique_ptr<Handler> handler) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    if (flags == -1) {
-        throw std::system_error(errno, std::system_category(), "EventLoop::add_handler fcntl");
+    add(fd, events, std::move(handler), Operation::poll);
+}
+
+void EventLoop::add_acceptor(const int fd, std::unique_ptr<Handler> handler) {
+    add(fd, EPOLLIN, std::move(handler), Operation::accept);
+}
+
+void EventLoop::add_stream(const int fd, std::unique_ptr<Handler> handler) {
+    add(fd, EPOLLIN, std::move(handler), Operation::receive);
+}
+
+void EventLoop::add(const int fd, const uint32_t events, std::unique_ptr<Handler> handler, const Operation operation) {
+    std::unique_ptr<Registration> registration{};
+    if (m_spare_registrations.empty()) {
+        registration = std::make_unique<Registration>(fd, events, std::move(handler));
+    } else {
+        registration = std::move(m_spare_registrations.back());
+        m_spare_registrations.pop_back();
+        *registration = Registration{fd, events, std::move(handler)};
+    }
+    registration->generation = ++m_generation;
+
+    if (m_handlers.size() <= static_cast<size_t>(fd)) {
+        m_handlers.resize(fd + 1);
     }
 
-    flags |= O_NONBLOCK;
-    if (fcntl(fd, F_SETFL, flags) == -1) {
-        throw std::system_error(errno, std::system_category(), "EventLoop::add_handler fcntl");
+    if (m_ring) {
+        arm(*registration, operation);
+        m_handlers[fd] = std::move(registration);
+        return;
+    }
+
+    // listeners and accepted sockets are created non-blocking; only arbitrary descriptors need switching over
+    if (operation == Operation::poll) {
+        set_non_blocking(fd);
     }
 
     epoll_event event{};
     event.events = events;
-    event.data.fd = fd;
+    event.data.u64 = epoll_data_of(fd, registration->generation);
     if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) == -1) {
         throw std::system_error(errno, std::system_category(), "EventLoop::add_handler epoll_ctl");
     }
 
-    m_handlers[fd] = std::move(handler);
+    m_handlers[fd] = std::move(registration);
+}
+
+void EventLoop::send(const int fd, const msghdr &message) {
+    if (!m_ring) {
+        throw std::logic_error("EventLoop::send requires a completion-based backend");
+    }
+
+    Registration &registration = this->registration(fd);
+
+    io_uring_sqe &sqe = m_ring->prepare();
+    sqe.opcode = IORING_OP_SENDMSG;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(&message);
+    sqe.len = 1;
+    sqe.msg_flags = MSG_NOSIGNAL;
+    sqe.user_data = reinterpret_cast<uint64_t>(&registration) | static_cast<uint64_t>(Operation::send);
+    ++registration.pending;
+}
+
+void EventLoop::offload_receive(const int fd) {
+    if (!m_io_threads) {
+        throw std::logic_error("EventLoop::offload_receive requires I/O threads");
+    }
+
+    m_offloaded_receives.push_back(&registration(fd));
+}
+
+void EventLoop::offload_send(const int fd) {
+    if (!m_io_threads) {
+        throw std::logic_error("EventLoop::offload_send requires I/O threads");
+    }
+
+    m_offloaded_sends.push_back(&registration(fd));
 }
 
 void EventLoop::remove_handler(const int fd) {
-    if (epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+    if (static_cast<size_t>(fd) >= m_handlers.size() || !m_handlers[fd]) {
+        return;
+    }
+
+    auto registration = std::move(m_handlers[fd]);
+    registration->removed = true;
+
+    if (m_ring) {
+        if (registration->pending > 0) {
+            io_uring_sqe &sqe = m_ring->prepare();
+            sqe.opcode = IORING_OP_ASYNC_CANCEL;
+            sqe.fd = fd;
+            sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        }
+    } else if (epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr) == -1) {
         throw std::system_error(errno, std::system_category(), "EventLoop::remove_handler epoll_ctl");
     }
 
-    m_removed_fds.push_back(fd);
+    m_removed.push_back(std::move(registration));
 }
 
 void EventLoop::modify_handler(const int fd, const uint32_t events) const {
+    Registration &registration = this->registration(fd);
+    registration.events = events;
+
+    if (m_ring) {
+        io_uring_sqe &sqe = m_ring->prepare();
+        sqe.opcode = IORING_OP_POLL_REMOVE;
+        sqe.addr = reinterpret_cast<uint64_t>(&registration) | static_cast<uint64_t>(Operation::poll);
+        sqe.len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+        sqe.poll32_events = events;
+        return;
+    }
+
     epoll_event event{};
     event.events = events;
-    event.data.fd = fd;
+    event.data.u64 = epoll_data_of(fd, registration.generation);
     if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &event) == -1) {
         throw std::system_error(errno, std::system_category(), "EventLoop::modify_handler epoll_ctl");
     }
 }
+
+EventLoop::Registration &EventLoop::registration(const int fd) const {
+    if (static_cast<size_t>(fd) >= m_handlers.size() || !m_handlers[fd]) {
+        throw std::out_of_range(std::format("EventLoop: no handler registered for fd {}", fd));
+    }
+
+    return *m_handlers[fd];
+}
+
+void EventLoop::arm(Registration &registration, const Operation operation) const {
+    io_uring_sqe &sqe = m_ring->prepare();
+    sqe.fd = registration.fd;
+    sqe.user_data = reinterpret_cast<uint64_t>(&registration) | static_cast<uint64_t>(operation);
+
+    switch (operation) {
+        case Operation::poll:
+            sqe.opcode = IORING_OP_POLL_ADD;
+            sqe.len = IORING_POLL_ADD_MULTI;
+            sqe.poll32_events = registration.events;
+            break;
+        case Operation::accept:
+            sqe.opcode = IORING_OP_ACCEPT;
+            sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+            // like accept4 under epoll, so that a direct send or receive on the socket never blocks the loop
+            sqe.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            break;
+        case Operation::receive:
+            sqe.opcode = IORING_OP_RECV;
+            sqe.ioprio = IORING_RECV_MULTISHOT;
+            sqe.flags = IOSQE_BUFFER_SELECT;
+            sqe.buf_group = buffer_group;
+            break;
+        case Operation::send:
+            throw std::logic_error("EventLoop::arm sends are queued through EventLoop::send");
+        case Operation::timeout:
+            throw std::logic_error("EventLoop::arm timeouts are queued through EventLoop::arm_timeout");
+    }
+
+    ++registration.pending;
+}
+
+void EventLoop::arm_timeout() {
+    const auto until_next = m_timers.until_next(m_now);
+    if (!until_next.has_value()) {
+        return;
+    }
+
+    // a timeout that is already queued and ends sooner will do
+    const auto deadline = m_now + *until_next;
+    if (deadline >= m_timeout_deadline) {
+        return;
+    }
+
+    m_timeout_deadline = deadline;
+    m_ring->timeout(*until_next, static_cast<uint64_t>(Operation::timeout));
+}
+
+void EventLoop::complete(const io_uring_cqe &cqe) {
+    // cancellations and poll updates are fire and forget
+    if (cqe.user_data == 0) {
+        return;
+    }
+
+    // the wait has been cut short, which is all a timeout is for. any later one still queued is superseded by whatever
+    // arm_timeout queues next
+    if (cqe.user_data == static_cast<uint64_t>(Operation::timeout)) {
+        if (m_now >= m_timeout_deadline) {
+            m_timeout_deadline = TimerWheel::Clock::time_point::max();
+        }
+        return;
+    }
+
+    auto &registration = *reinterpret_cast<Registration *>(cqe.user_data & ~operation_mask);
+    const auto operation = static_cast<Operation>(cqe.user_data & operation_mask);
+    const bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    if (!more) {
+        --registration.pending;
+    }
+
+    switch (operation) {
+        case Operation::poll:
+            if (!registration.removed && cqe.res >= 0) {
+                registration.handler->handle(static_cast<uint32_t>(cqe.res));
+            }
+            break;
+        case Operation::accept:
+            if (!registration.removed) {
+                registration.handler->handle_accepted(cqe.res);
+            }
+            break;
+        case Operation::receive:
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                const auto id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                if (!registration.removed) {
+                    registration.handler->handle_received(m_ring->buffer(id, cqe.res));
+                }
+                // the handler has consumed the data by now, so the buffer can go straight back to the kernel
+                m_ring->recycle(id);
+            } else if (!registration.removed && cqe.res != -ENOBUFS) {
+                registration.handler->handle_received({});
+            }
+            break;
+        case Operation::send:
+            if (!registration.removed) {
+                registration.handler->handle_sent(cqe.res);
+            }
+            return;
+        case Operation::timeout:
+            return;
+    }
+
+    // a multishot operation ends on errors (running out of provided buffers, for one), so start it again unless the
+    // handler has gone away or the peer has
+    const bool closed = operation == Operation::receive && cqe.res <= 0 && cqe.res != -ENOBUFS;
+    if (!more && !registration.removed && !closed) {
+        arm(registration, operation);
+    }
+}
@@ -0,0 +1,75 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "io_threads.h"
+
+#include <algorithm>
+
+IoThreads::IoThreads(const size_t threads) {
+    for (size_t i{1}; i < std::max<size_t>(threads, 1); ++i) {
+        m_workers.emplace_back([this, i] { serve(i); });
+    }
+}
+
+IoThreads::~IoThreads() {
+    m_stopping.store(true, std::memory_order_relaxed);
+    m_batch.fetch_add(1, std::memory_order_release);
+    m_batch.notify_all();
+    m_workers.clear();
+}
+
+void IoThreads::run(const size_t items, const Work &work) {
+    if (m_workers.empty() || items < size() * min_items_per_thread) {
+        for (size_t i{0}; i < items; ++i) {
+            work(i, 0);
+        }
+        return;
+    }
+
+    m_work = &work;
+    m_items = items;
+    m_next.store(0, std::memory_order_relaxed);
+    m_busy.store(m_workers.size(), std::memory_order_relaxed);
+
+    // publishes the batch along with whatever the caller did to the items beforehand
+    m_batch.fetch_add(1, std::memory_order_release);
+    m_batch.notify_all();
+
+    work_through(0);
+
+    // and the other way around: once the workers are done, what they did to the items is visible here
+    for (size_t busy = m_busy.load(std::memory_order_acquire); busy != 0;
+         busy = m_busy.load(std::memory_order_acquire)) {
+        m_busy.wait(busy, std::memory_order_acquire);
+    }
+
+    m_work = nullptr;
+}
+
+void IoThreads::serve(const size_t thread) {
+    uint64_t seen{0};
+
+    while (true) {
+        m_batch.wait(seen, std::memory_order_acquire);
+        seen = m_batch.load(std::memory_order_acquire);
+
+        if (m_stopping.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        work_through(thread);
+
+        if (m_busy.fetch_sub(1, std::memory_order_release) == 1) {
+            m_busy.notify_one();
+        }
+    }
+}
+
+void IoThreads::work_through(const size_t thread) {
+    // items are taken one at a time rather than split up front, so one slow item does not hold up a whole share
+    for (size_t item = m_next.fetch_add(1, std::memory_order_relaxed); item < m_items;
+         item = m_next.fetch_add(1, std::memory_order_relaxed)) {
+        (*m_work)(item, thread);
+    }
+}
@@ -0,0 +1,73 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "mailbox.h"
+
+#include <memory>
+#include <system_error>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+Mailbox::Mailbox() {
+    m_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_event == -1) {
+        throw std::system_error(errno, std::system_category(), "Mailbox::Mailbox eventfd");
+    }
+}
+
+Mailbox::~Mailbox() {
+    Node *node = m_head.exchange(nullptr, std::memory_order_acquire);
+    while (node != nullptr) {
+        const std::unique_ptr<Node> current{node};
+        node = node->next;
+    }
+    close(m_event);
+}
+
+void Mailbox::post(Task task) {
+    auto *node = new Node{std::move(task)};
+
+    Node *head = m_head.load(std::memory_order_relaxed);
+    do {
+        node->next = head;
+    } while (!m_head.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+
+    // only the producer that finds the mailbox empty needs to wake the consumer; anyone after it is picked up by the
+    // same drain
+    if (head == nullptr) {
+        constexpr uint64_t one{1};
+        if (write(m_event, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+            throw std::system_error(errno, std::system_category(), "Mailbox::post write");
+        }
+    }
+}
+
+void Mailbox::handle(const uint32_t events) {
+    if (!(events & EPOLLIN)) {
+        return;
+    }
+
+    // reset the eventfd before taking the tasks, so a post racing with the drain always leaves a wakeup behind
+    uint64_t count{};
+    if (read(m_event, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        throw std::system_error(errno, std::system_category(), "Mailbox::handle read");
+    }
+
+    Node *node = m_head.exchange(nullptr, std::memory_order_acquire);
+
+    Node *ordered{nullptr};
+    while (node != nullptr) {
+        Node *next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+    }
+
+    while (ordered != nullptr) {
+        const std::unique_ptr<Node> current{ordered};
+        ordered = ordered->next;
+        current->task();
+    }
+}
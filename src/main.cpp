@@ -4,8 +4,120 @@
 
 #include "server.h"
 
-int main() {
+#include <charconv>
+#include <format>
+#include <iostream>
+
+namespace {
+    template<typename T>
+    std::optional<T> try_parse_numeric(const std::string_view string, const int base = 10) {
+        T result;
+        auto [ptr, ec] = std::from_chars(string.data(), string.data() + string.size(), result, base);
+
+        if (ec == std::errc() && ptr == string.data() + string.size()) {
+            return result;
+        }
+        return std::nullopt;
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    Server::Options options{};
+
+    for (int i{1}; i < argc; i += 2) {
+        const std::string_view flag{argv[i]};
+
+        if (i + 1 >= argc) {
+            std::cerr << std::format("Missing value for option '{}'\n", flag);
+            return 1;
+        }
+
+        const std::string_view value{argv[i + 1]};
+
+        if (flag == "--port") {
+            options.port = value;
+        } else if (flag == "--unix-socket") {
+            options.unix_socket = value;
+        } else if (flag == "--shm-socket") {
+            options.shm_socket = value;
+        } else if (flag == "--unix-socket-perm") {
+            // octal, the way chmod takes it
+            const auto permissions = try_parse_numeric<mode_t>(value, 8);
+            if (!permissions.has_value() || *permissions > 0777) {
+                std::cerr << std::format("Invalid socket permissions '{}'\n", value);
+                return 1;
+            }
+            options.unix_socket_permissions = *permissions;
+        } else if (flag == "--threads") {
+            const auto threads = try_parse_numeric<size_t>(value);
+            if (!threads.has_value() || *threads == 0) {
+                std::cerr << std::format("Invalid thread count '{}'\n", value);
+                return 1;
+            }
+            options.threads = *threads;
+        } else if (flag == "--io-threads") {
+            const auto io_threads = try_parse_numeric<size_t>(value);
+            if (!io_threads.has_value() || *io_threads == 0) {
+                std::cerr << std::format("Invalid I/O thread count '{}'\n", value);
+                return 1;
+            }
+            options.io_threads = *io_threads;
+        } else if (flag == "--busy-poll") {
+            const auto microseconds = try_parse_numeric<int64_t>(value);
+            if (!microseconds.has_value() || *microseconds < 0) {
+                std::cerr << std::format("Invalid busy poll time '{}'\n", value);
+                return 1;
+            }
+            options.busy_poll = std::chrono::microseconds{*microseconds};
+        } else if (flag == "--backend") {
+            if (value == "epoll") {
+                options.backend = EventLoop::Backend::epoll;
+            } else if (value == "io_uring") {
+                options.backend = EventLoop::Backend::io_uring;
+            } else {
+                std::cerr << std::format("Unknown backend '{}'\n", value);
+                return 1;
+            }
+        } else if (flag == "--timeout") {
+            const auto seconds = try_parse_numeric<int64_t>(value);
+            if (!seconds.has_value() || *seconds < 0) {
+                std::cerr << std::format("Invalid timeout '{}'\n", value);
+                return 1;
+            }
+            options.idle_timeout = std::chrono::seconds{*seconds};
+        } else if (flag == "--command-budget" || flag == "--byte-budget") {
+            const auto budget = try_parse_numeric<size_t>(value);
+            if (!budget.has_value()) {
+                std::cerr << std::format("Invalid budget '{}'\n", value);
+                return 1;
+            }
+            (flag == "--command-budget" ? options.command_budget : options.byte_budget) = *budget;
+        } else if (flag == "--function-budget") {
+            const auto budget = try_parse_numeric<size_t>(value);
+            if (!budget.has_value()) {
+                std::cerr << std::format("Invalid function budget '{}'\n", value);
+                return 1;
+            }
+            options.function_budget = *budget;
+        } else if (flag == "--encode-threshold") {
+            const auto threshold = try_parse_numeric<size_t>(value);
+            if (!threshold.has_value()) {
+                std::cerr << std::format("Invalid encode threshold '{}'\n", value);
+                return 1;
+            }
+            options.encode_threshold = *threshold;
+        } else {
+            std::cerr << std::format("Unknown option '{}'\n", flag);
+            return 1;
+        }
+    }
+
+    if (options.port == "0" && options.unix_socket.empty() && options.shm_socket.empty()) {
+        std::cerr << "Nothing to listen on: the TCP port is 0 and there is no unix or shared memory socket\n";
+        return 1;
+    }
+
     Server server{};
 
-    server.start();
+    server.start(options);
 }
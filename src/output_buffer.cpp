@@ -0,0 +1,165 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "output_buffer.h"
+
+#include <algorithm>
+#include <charconv>
+
+void OutputBuffer::append(const resp::Value &value, const resp::Protocol protocol) {
+    if (const auto *array = std::get_if<resp::SharedArray>(&value); array && array->count > stream_elements) {
+        std::vector<char> &header = tail();
+        char count[21];
+        const auto [end, ec] = std::to_chars(count, count + sizeof(count), array->count);
+        header.push_back('*');
+        header.insert(header.end(), count, end);
+        header.insert(header.end(), {'\r', '\n'});
+        m_size += 3 + (end - count);
+
+        m_segments.push_back(Segment{{}, nullptr, Stream{*array, 0, protocol}});
+        ++m_streams;
+        return;
+    }
+
+    const auto *shared = std::get_if<resp::SharedString>(&value);
+    if (!shared) {
+        std::vector<char> &bytes = tail();
+        const size_t before{bytes.size()};
+        serialize(value, bytes, protocol);
+        m_size += bytes.size() - before;
+        return;
+    }
+
+    // an encoded string is sent as it is stored, copied if it is small and referred to otherwise
+    if (shared->header != 0) {
+        if (shared->value->size() < resp::share_threshold) {
+            std::vector<char> &bytes = tail();
+            bytes.insert(bytes.end(), shared->value->begin(), shared->value->end());
+        } else {
+            m_segments.push_back(Segment{{}, shared->value});
+        }
+        m_size += shared->value->size();
+        return;
+    }
+
+    // the header and trailer are copied, the string in between is only referred to
+    std::vector<char> &header = tail();
+    char length[21];
+    const auto [end, ec] = std::to_chars(length, length + sizeof(length), shared->value->size());
+    header.push_back('$');
+    header.insert(header.end(), length, end);
+    header.insert(header.end(), {'\r', '\n'});
+    m_size += 3 + (end - length);
+
+    m_segments.push_back(Segment{{}, shared->value});
+    m_size += shared->value->size();
+
+    std::vector<char> &trailer = tail();
+    trailer.insert(trailer.end(), {'\r', '\n'});
+    m_size += 2;
+}
+
+size_t OutputBuffer::gather(const std::span<iovec> iovecs) {
+    size_t count{0};
+    size_t offset{m_offset};
+    size_t gathered{0};
+
+    for (size_t i{0}; i < m_segments.size() && count < iovecs.size(); ++i) {
+        // with a chunk's worth on its way already, the rest of the array can wait for the next send
+        if (m_segments[i].stream) {
+            if (gathered >= stream_chunk) {
+                break;
+            }
+            produce(i);
+        }
+
+        const auto data = m_segments[i].data().subspan(offset);
+        offset = 0;
+        if (data.empty()) {
+            continue;
+        }
+
+        iovecs[count++] = iovec{const_cast<char *>(data.data()), data.size()};
+        gathered += data.size();
+    }
+
+    return count;
+}
+
+void OutputBuffer::consume(size_t bytes) {
+    m_size -= bytes;
+
+    if (m_size == 0 && m_streams == 0) {
+        for (Segment &segment: m_segments) {
+            release(std::move(segment.bytes));
+        }
+        m_segments.clear();
+        m_offset = 0;
+        return;
+    }
+
+    size_t done{0};
+    bytes += m_offset;
+    // a stream has no bytes of its own yet, and stays until it has produced them all
+    while (bytes > 0 && !m_segments[done].stream && bytes >= m_segments[done].data().size()) {
+        bytes -= m_segments[done].data().size();
+        ++done;
+    }
+
+    for (size_t i{0}; i < done; ++i) {
+        release(std::move(m_segments[i].bytes));
+    }
+    m_segments.erase(m_segments.begin(), m_segments.begin() + static_cast<ptrdiff_t>(done));
+    m_offset = bytes;
+}
+
+size_t OutputBuffer::memory_usage() const {
+    size_t usage{m_segments.capacity() * sizeof(Segment)};
+    for (const Segment &segment: m_segments) {
+        usage += segment.bytes.capacity();
+    }
+    return usage;
+}
+
+std::vector<char> &OutputBuffer::tail() {
+    if (m_segments.empty() || m_segments.back().shared || m_segments.back().stream) {
+        m_segments.push_back(Segment{m_pool ? m_pool->acquire() : std::vector<char>{}, nullptr});
+    }
+
+    return m_segments.back().bytes;
+}
+
+void OutputBuffer::produce(const size_t index) {
+    Stream &stream = *m_segments[index].stream;
+    const auto elements = stream.array.elements();
+
+    // a new segment, as iovecs of a send still in flight may point into the one before
+    std::vector<char> bytes{m_pool ? m_pool->acquire() : std::vector<char>{}};
+    while (stream.next < elements.size() && bytes.size() < stream_chunk) {
+        serialize(elements[stream.next++], bytes, stream.protocol);
+    }
+    m_size += bytes.size();
+
+    if (stream.next == elements.size()) {
+        m_segments[index] = Segment{std::move(bytes), nullptr, std::nullopt};
+        --m_streams;
+        return;
+    }
+
+    m_segments.insert(m_segments.begin() + static_cast<ptrdiff_t>(index), Segment{std::move(bytes), nullptr, std::nullopt});
+}
+
+void OutputBuffer::release(std::vector<char> bytes) const {
+    if (m_pool) {
+        m_pool->release(std::move(bytes));
+    }
+}
+
+std::span<const char> OutputBuffer::Segment::data() const {
+    if (shared) {
+        return *shared;
+    }
+
+    return bytes;
+}
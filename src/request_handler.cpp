@@ -6,11 +6,19 @@
 #include "resp.h"
 #include "dictionary.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <format>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <utility>
 
+#include "connection.h"
 #include "server.h"
+#include "shard.h"
 #include "tokenizer.h"
 
 namespace {
@@ -66,361 +74,1331 @@ namespace {
         }
         return table.at(static_cast<Dictionary::incr_error>(-1));
     }
+
+    // what HELLO reports, the same as the project's version
+    constexpr std::string_view server_version{"0.1.0"};
+
+    // holds on to the reply of a command that is run on behalf of another shard
+    class Capture final : public RequestHandler::Client {
+    public:
+        void send(const resp::Value &value) override {
+            reply = value;
+        }
+
+        resp::Value reply{};
+    };
+
+    // an owned copy of the arguments, for running the command on another shard
+    resp::Array to_command(const RequestHandler::Arguments arguments) {
+        std::vector<resp::Value> command{};
+        command.reserve(arguments.size());
+        for (const std::string_view argument: arguments) {
+            command.emplace_back(resp::BulkString{std::string{argument}});
+        }
+        return resp::Array{std::move(command)};
+    }
+
+    resp::Value sum_integers(std::vector<resp::Value> &replies) {
+        int64_t sum{0};
+        for (auto &reply: replies) {
+            const auto *integer = std::get_if<resp::Integer>(&reply);
+            if (!integer) {
+                return std::move(reply);
+            }
+            sum += integer->value;
+        }
+
+        return resp::Integer{sum};
+    }
+
+    resp::Value only_reply(std::vector<resp::Value> &replies) {
+        return std::move(replies.front());
+    }
+
+    // puts the values each shard replied with back where their keys were, given as positions for each shard
+    resp::Value merge_values(const std::vector<std::vector<size_t> > &positions, const size_t count,
+                             std::vector<resp::Value> &replies) {
+        std::vector<resp::Value> values(count);
+        for (size_t i{0}; i < replies.size(); ++i) {
+            auto *array = std::get_if<resp::Array>(&replies[i]);
+            if (array == nullptr || !array->value.has_value() || array->value->size() != positions[i].size()) {
+                return std::move(replies[i]);
+            }
+
+            for (size_t j{0}; j < positions[i].size(); ++j) {
+                values[positions[i][j]] = std::move((*array->value)[j]);
+            }
+        }
+
+        return resp::Array{std::move(values)};
+    }
+
+    const resp::SimpleError cross_slot_error{"CROSSSLOT", "Keys in request don't hash to the same shard"};
+
+    const resp::SimpleError function_not_found{"ERR", "Function not found"};
+
+    // every shard replies the same unless one of them fails
+    resp::Value first_error_or_first(std::vector<resp::Value> &replies) {
+        for (auto &reply: replies) {
+            if (std::holds_alternative<resp::SimpleError>(reply)) {
+                return std::move(reply);
+            }
+        }
+
+        return std::move(replies.front());
+    }
+
+    resp::Value first_error_or_ok(std::vector<resp::Value> &replies) {
+        for (auto &reply: replies) {
+            if (std::holds_alternative<resp::SimpleError>(reply)) {
+                return std::move(reply);
+            }
+        }
+
+        return resp::ok;
+    }
+
+    // every shard replies with [entry count, serialized entries]; stitch them into a single dump laid out exactly like
+    // Dictionary::save, so it can be loaded back with any number of shards
+    resp::Value save_shards(std::vector<resp::Value> &replies) {
+        size_t size{0};
+        for (const auto &reply: replies) {
+            size += std::get<resp::Integer>(std::get<resp::Array>(reply).value->at(0)).value;
+        }
+
+        std::ofstream file{Server::dump_path};
+        file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+
+        for (const auto &reply: replies) {
+            const auto &entries = *std::get<resp::BulkString>(std::get<resp::Array>(reply).value->at(1)).value;
+            file.write(entries.data(), static_cast<std::streamsize>(entries.size()));
+        }
+
+        return resp::ok;
+    }
+
+    struct InfoSections {
+        bool clients;
+        bool stats;
+    };
+
+    // INFO takes an optional section name, and reports every section without one
+    InfoSections info_sections(const RequestHandler::Arguments arguments) {
+        if (arguments.size() < 2) {
+            return {true, true};
+        }
+
+        const auto section = arguments[1];
+        if (iequals(section, "default") || iequals(section, "all") || iequals(section, "everything")) {
+            return {true, true};
+        }
+
+        return {iequals(section, "clients"), iequals(section, "stats")};
+    }
+
+    // a shard's share of what INFO reports, as [accept wakeups, accepted connections, connected clients, client memory,
+    // budget yields, I/O threaded reads, I/O threaded writes, busy poll time, busy poll hits, work time, tracked keys,
+    // tracked prefixes]
+    resp::Value collect_info(Shard &shard) {
+        EventLoop &event_loop = shard.event_loop();
+        const EventLoop::Stats &stats = event_loop.stats();
+        return resp::Array{
+            std::vector<resp::Value>{
+                resp::Integer{static_cast<int64_t>(stats.accept_wakeups)},
+                resp::Integer{static_cast<int64_t>(stats.accepted_connections)},
+                resp::Integer{static_cast<int64_t>(stats.connected_clients)},
+                resp::Integer{static_cast<int64_t>(event_loop.handler_memory())},
+                resp::Integer{static_cast<int64_t>(stats.budget_yields)},
+                resp::Integer{static_cast<int64_t>(stats.io_threaded_reads)},
+                resp::Integer{static_cast<int64_t>(stats.io_threaded_writes)},
+                resp::Integer{static_cast<int64_t>(stats.busy_poll_nanoseconds / 1000)},
+                resp::Integer{static_cast<int64_t>(stats.busy_poll_hits)},
+                resp::Integer{static_cast<int64_t>(stats.work_nanoseconds / 1000)},
+                resp::Integer{static_cast<int64_t>(shard.tracking().keys())},
+                resp::Integer{static_cast<int64_t>(shard.tracking().prefixes())},
+            }
+        };
+    }
+
+    // adds up every shard's share and lays it out the way redis does, one field:value per line
+    resp::Value render_info(const InfoSections sections, const std::vector<resp::Value> &replies) {
+        std::array<int64_t, 12> totals{};
+        for (const auto &reply: replies) {
+            const auto &counters = *std::get<resp::Array>(reply).value;
+            for (size_t i{0}; i < totals.size(); ++i) {
+                const int64_t counter = std::get<resp::Integer>(counters.at(i)).value;
+
+                // every shard has each broadcast prefix, so they are counted once
+                totals[i] = i == 11 ? std::max(totals[i], counter) : totals[i] + counter;
+            }
+        }
+        const auto [accept_wakeups, accepted_connections, connected_clients, client_memory, budget_yields,
+            io_threaded_reads, io_threaded_writes, busy_poll_us, busy_poll_hits, work_us, tracking_keys,
+            tracking_prefixes] = totals;
+
+        std::string info{};
+        if (sections.clients) {
+            info += std::format("# Clients\r\n"
+                                "connected_clients:{}\r\n"
+                                "mem_clients:{}\r\n"
+                                "mem_per_client:{}\r\n",
+                                connected_clients, client_memory,
+                                connected_clients == 0 ? 0 : client_memory / connected_clients);
+        }
+
+        if (sections.stats) {
+            const double accepts_per_wakeup = accept_wakeups == 0
+                                                  ? 0.0
+                                                  : static_cast<double>(accepted_connections) / accept_wakeups;
+
+            info += std::format("{}# Stats\r\n"
+                                "total_connections_received:{}\r\n"
+                                "accept_wakeups:{}\r\n"
+                                "accepts_per_wakeup:{:.2f}\r\n"
+                                "budget_yields:{}\r\n"
+                                "io_threaded_reads_processed:{}\r\n"
+                                "io_threaded_writes_processed:{}\r\n"
+                                "busy_poll_us:{}\r\n"
+                                "busy_poll_hits:{}\r\n"
+                                "event_loop_work_us:{}\r\n"
+                                "tracking_total_keys:{}\r\n"
+                                "tracking_total_prefixes:{}\r\n",
+                                info.empty() ? "" : "\r\n", accepted_connections, accept_wakeups,
+                                accepts_per_wakeup, budget_yields, io_threaded_reads, io_threaded_writes,
+                                busy_poll_us, busy_poll_hits, work_us, tracking_keys, tracking_prefixes);
+        }
+
+        return resp::BulkString{std::move(info)};
+    }
+}
+
+const auto &RequestHandler::command_table() {
+    using enum commands::Flag;
+
+    // name, arity, flags, first key, last key, step, where the number of keys is if it is given, and how to run it
+    static constexpr commands::Table table{
+        std::to_array<Command>({
+            {{"ping", -1, 0, 0, 0, 0}, {&RequestHandler::handle_ping, nullptr}},
+            {{"set", -3, write, 1, 1, 1}, {&RequestHandler::handle_set, nullptr}},
+            {{"get", 2, read, 1, 1, 1}, {&RequestHandler::handle_get, nullptr}},
+            {{"mget", -2, read, 1, -1, 1}, {&RequestHandler::handle_mget, nullptr}},
+            {{"mset", -3, write, 1, -1, 2}, {&RequestHandler::handle_mset, nullptr}},
+            {{"msetnx", -3, write, 1, -1, 2}, {&RequestHandler::handle_msetnx, nullptr}},
+            {{"flushdb", -1, write | all_shards, 0, 0, 0}, {&RequestHandler::handle_flushdb, nullptr}},
+            {{"exists", -2, read, 1, -1, 1}, {&RequestHandler::handle_exists, nullptr}},
+            {{"del", -2, write, 1, -1, 1}, {&RequestHandler::handle_del, nullptr}},
+            {{"incr", 2, write, 1, 1, 1}, {&RequestHandler::handle_incr, nullptr}},
+            {{"decr", 2, write, 1, 1, 1}, {&RequestHandler::handle_decr, nullptr}},
+            {{"lpush", -3, write, 1, 1, 1}, {&RequestHandler::handle_lpush, nullptr}},
+            {{"rpush", -3, write, 1, 1, 1}, {&RequestHandler::handle_rpush, nullptr}},
+            {{"lrange", 4, read, 1, 1, 1}, {&RequestHandler::handle_lrange, nullptr}},
+            {{"save", 1, admin | all_shards, 0, 0, 0}, {&RequestHandler::handle_save, nullptr}},
+            {{"info", -1, all_shards, 0, 0, 0}, {&RequestHandler::handle_info, nullptr}},
+            {{"function", -2, admin | all_shards | noscript, 0, 0, 0}, {&RequestHandler::handle_function, nullptr}},
+            {{"fcall", -3, noscript, 0, 0, 0, 2}, {&RequestHandler::handle_fcall, nullptr}},
+            {{"hello", -1, connection, 0, 0, 0}, {nullptr, &RequestHandler::handle_hello}},
+            {{"client", -2, connection, 0, 0, 0}, {nullptr, &RequestHandler::handle_client}},
+            {{"multi", 1, connection | transaction, 0, 0, 0}, {nullptr, &RequestHandler::handle_multi}},
+            {{"exec", 1, connection | transaction, 0, 0, 0}, {nullptr, &RequestHandler::handle_exec}},
+            {{"discard", 1, connection | transaction, 0, 0, 0}, {nullptr, &RequestHandler::handle_discard}},
+            {{"watch", -2, connection | transaction, 1, -1, 1}, {nullptr, &RequestHandler::handle_watch}},
+            {{"unwatch", 1, connection | transaction, 0, 0, 0}, {nullptr, &RequestHandler::handle_unwatch}},
+        })
+    };
+    return table;
 }
 
-void RequestHandler::handle(const resp::Value &request, Connection &connection) const {
-    if (const auto command = std::get_if<resp::Array>(&request)) {
-        handle_command(*command, connection);
+const RequestHandler::Command *RequestHandler::lookup(const Arguments arguments, Client &client) {
+    if (arguments.empty()) {
+        client.send(resp::syntax_error);
+        return nullptr;
     }
+
+    const Command *command = command_table().find(arguments[0]);
+    if (command == nullptr) {
+        client.send(resp::SimpleError{"ERR", std::format("unknown command '{}'", arguments[0])});
+        return nullptr;
+    }
+
+    // so that no handler has to check for the arguments it cannot do without
+    if (!command->accepts(arguments.size())) {
+        client.send(resp::SimpleError{"ERR", std::format("wrong number of arguments for '{}' command",
+                                                         command->name)});
+        return nullptr;
+    }
+
+    return command;
 }
 
-void RequestHandler::handle_command(const resp::Array &command, Connection &connection) const {
-    if (!command.value.has_value()) {
-        connection.send(resp::syntax_error);
+void RequestHandler::handle(const Arguments arguments, Connection &connection) const {
+    const Command *command = lookup(arguments, connection);
+    if (command == nullptr) {
+        // as in redis, a command that cannot even be queued dooms the transaction
+        if (connection.transaction().active) {
+            connection.transaction().failed = true;
+        }
+        return;
+    }
+
+    if (connection.transaction().active && !command->has(commands::transaction)) {
+        queue(*command, arguments, connection);
+        return;
+    }
+
+    if (command->has(commands::connection)) {
+        (this->*command->handler.connection)(arguments, connection);
+        return;
+    }
+
+    if (m_shard != nullptr && forward(*command, arguments, connection)) {
         return;
     }
 
-    const auto tokens = Tokenizer{*command.value};
+    (this->*command->handler.client)(arguments, connection);
+
+    // anything not forwarded only had keys of this shard's
+    if (m_shard != nullptr && connection.tracking() == Connection::Tracking::on) {
+        remember(*command, arguments, Tracking::Subscriber{m_shard, connection.self()});
+    }
+}
+
+void RequestHandler::prefetch(const Arguments arguments) const {
+    if (arguments.empty() || !m_dictionary.worth_prefetching()) {
+        return;
+    }
+
+    const Command *command = command_table().find(arguments[0]);
+    if (command == nullptr || !command->accepts(arguments.size())) {
+        return;
+    }
+
+    command->for_each_key(arguments, [this](const std::string_view key) {
+        if (m_shard == nullptr || m_shard->owns(key)) {
+            m_dictionary.prefetch(key);
+        }
+    });
+}
+
+bool RequestHandler::forward(const Command &command, const Arguments arguments, Connection &connection) const {
+    if (m_shard->shards().size() == 1) {
+        return false;
+    }
 
-    for (const auto &token: tokens) {
+    // the commands about every shard's data
+    if (command.name == "flushdb" || command.name == "save" || command.name == "function") {
+        const bool save = command.name == "save";
+        const resp::Array copy = to_command(arguments);
+        std::vector<std::pair<Shard *, Work> > work{};
+
+        for (const auto &shard: m_shard->shards()) {
+            if (save) {
+                work.emplace_back(shard.get(), [](Shard &owner) -> resp::Value {
+                    std::ostringstream stream{};
+                    owner.dictionary().save_entries(stream);
+                    return resp::Array{
+                        std::vector<resp::Value>{
+                            resp::Integer{static_cast<int64_t>(owner.dictionary().size())},
+                            resp::BulkString{std::move(stream).str()}
+                        }
+                    };
+                });
+            } else {
+                work.emplace_back(shard.get(), [&command, copy](Shard &owner) {
+                    return owner.request_handler().execute(command, copy);
+                });
+            }
+        }
+
+        scatter(connection, std::move(work), save
+                                                 ? save_shards
+                                                 : command.name == "function"
+                                                       ? first_error_or_first
+                                                       : first_error_or_ok);
+        return true;
+    }
+
+    if (command.name == "info" && arguments.size() <= 2) {
+        std::vector<std::pair<Shard *, Work> > work{};
+        for (const auto &shard: m_shard->shards()) {
+            work.emplace_back(shard.get(), collect_info);
+        }
+
+        scatter(connection, std::move(work), [sections = info_sections(arguments)](std::vector<resp::Value> &replies) {
+            return render_info(sections, replies);
+        });
+        return true;
+    }
+
+    // a function runs where the keys it is called with are, which has to be the one shard
+    if (command.key_count != 0) {
+        std::optional<size_t> shard{};
+        if (!claim(shard, command, arguments)) {
+            connection.send(cross_slot_error);
+            return true;
+        }
+        if (!shard.has_value() || *shard == m_shard->index()) {
+            return false;
+        }
+
+        std::vector<std::pair<Shard *, Work> > work{};
+        work.emplace_back(m_shard->shards()[*shard].get(), [&command, copy = to_command(arguments)](Shard &owner) {
+            return owner.request_handler().execute(command, copy);
+        });
+        scatter(connection, std::move(work), only_reply);
+        return true;
+    }
+
+    if (command.first_key == 0) {
+        return false;
+    }
+
+    if (command.last_key != command.first_key) {
+        const auto step = static_cast<size_t>(command.step);
+
+        // a key without its value is for the handler to reply to
+        if ((arguments.size() - 1) % step != 0) {
+            return false;
+        }
+
+        // split the keys, along with the values that follow them, into one sub-command per owning shard, and note
+        // where each key was for the commands that reply with a value per key
+        std::vector<std::vector<resp::Value> > commands(m_shard->shards().size());
+        std::vector<std::vector<size_t> > positions(m_shard->shards().size());
+        for (size_t i{1}; i < arguments.size(); i += step) {
+            const size_t index = m_shard->owner(arguments[i]).index();
+            auto &sub_command = commands[index];
+            if (sub_command.empty()) {
+                sub_command.emplace_back(resp::BulkString{std::string{arguments[0]}});
+            }
+            for (size_t j{i}; j < i + step; ++j) {
+                sub_command.emplace_back(resp::BulkString{std::string{arguments[j]}});
+            }
+            positions[index].push_back((i - 1) / step);
+        }
+
+        const auto local = commands[m_shard->index()].size();
+        if (local == arguments.size()) {
+            return false;
+        }
+
+        // all or nothing cannot be had across shards without coordinating them, so as in redis cluster, every key
+        // has to be in the same place
+        const bool one_shard = std::ranges::count_if(commands, [](const auto &sub_command) {
+            return !sub_command.empty();
+        }) == 1;
+        if (command.name == "msetnx" && !one_shard) {
+            connection.send(cross_slot_error);
+            return true;
+        }
+
+        const auto subscriber = subscriber_of(command, connection);
+        std::vector<std::pair<Shard *, Work> > work{};
+        std::vector<std::vector<size_t> > order{};
+        for (size_t i{0}; i < commands.size(); ++i) {
+            if (commands[i].empty()) {
+                continue;
+            }
+
+            work.emplace_back(m_shard->shards()[i].get(),
+                              [&command, copy = resp::Array{std::move(commands[i])}, subscriber](Shard &owner) {
+                                  return owner.request_handler().execute(command, copy, subscriber);
+                              });
+            order.push_back(std::move(positions[i]));
+        }
+
+        if (command.name == "mget") {
+            scatter(connection, std::move(work), [order = std::move(order), count = arguments.size() - 1
+                    ](std::vector<resp::Value> &replies) {
+                        return merge_values(order, count, replies);
+                    });
+        } else if (command.name == "del" || command.name == "exists") {
+            scatter(connection, std::move(work), sum_integers);
+        } else {
+            scatter(connection, std::move(work), one_shard ? only_reply : first_error_or_ok);
+        }
+        return true;
+    }
+
+    Shard &owner = m_shard->owner(arguments[1]);
+    if (&owner == m_shard) {
+        return false;
+    }
+
+    // the arguments point into the connection's receive buffer, so the command travels as a copy
+    std::vector<std::pair<Shard *, Work> > work{};
+    work.emplace_back(&owner, [&command, copy = to_command(arguments), subscriber = subscriber_of(command, connection)
+            ](Shard &shard) {
+                return shard.request_handler().execute(command, copy, subscriber);
+            });
+    scatter(connection, std::move(work), only_reply);
+    return true;
+}
+
+void RequestHandler::scatter(Connection &connection, std::vector<std::pair<Shard *, Work> > work,
+                             Reduce reduce) const {
+    // only ever touched on this shard's thread; the other shards just pass it back along with their reply
+    struct Gather {
+        std::shared_ptr<Connection *> connection;
+        std::vector<resp::Value> replies;
+        size_t remaining;
+        Reduce reduce;
+    };
+
+    const auto gather = std::make_shared<Gather>(connection.self(),
+                                                 std::vector<resp::Value>(work.size()),
+                                                 work.size(),
+                                                 std::move(reduce));
+
+    // replies must go out in request order, so hold back the rest of the pipeline until this one completes
+    connection.suspend();
+
+    Shard *origin = m_shard;
+    for (size_t i{0}; i < work.size(); ++i) {
+        auto &[owner, task] = work[i];
+        owner->post([origin, owner, i, gather, task = std::move(task)]() mutable {
+            resp::Value reply = task(*owner);
+
+            origin->post([i, gather = std::move(gather), reply = std::move(reply)]() mutable {
+                gather->replies[i] = std::move(reply);
+
+                if (--gather->remaining > 0) {
+                    return;
+                }
+
+                // the client may have disconnected while the command was in flight
+                if (Connection *client = *gather->connection) {
+                    client->send(gather->reduce(gather->replies));
+                    client->resume();
+                }
+            });
+        });
+    }
+}
+
+resp::Value RequestHandler::execute(const Command &command, const resp::Array &arguments,
+                                    const std::optional<Tracking::Subscriber> &subscriber) const {
+    if (!arguments.value.has_value()) {
+        return resp::syntax_error;
+    }
+
+    std::vector<std::string_view> views{};
+    views.reserve(arguments.value->size());
+    for (const auto &token: Tokenizer{*arguments.value}) {
         if (!token.has_value()) {
-            connection.send(resp::syntax_error);
-            return;
+            return resp::syntax_error;
         }
+        views.push_back(*token);
     }
 
-    const auto name = **tokens.begin();
-
-    if (iequals(name, "PING")) {
-        handle_ping(tokens, connection);
-    } else if (iequals(name, "SET")) {
-        handle_set(tokens, connection);
-    } else if (iequals(name, "GET")) {
-        handle_get(tokens, connection);
-    } else if (iequals(name, "FLUSHDB")) {
-        handle_flushdb(tokens, connection);
-    } else if (iequals(name, "EXISTS")) {
-        handle_exists(tokens, connection);
-    } else if (iequals(name, "DEL")) {
-        handle_del(tokens, connection);
-    } else if (iequals(name, "INCR")) {
-        handle_incr(tokens, connection);
-    } else if (iequals(name, "DECR")) {
-        handle_decr(tokens, connection);
-    } else if (iequals(name, "LPUSH")) {
-        handle_lpush(tokens, connection);
-    } else if (iequals(name, "RPUSH")) {
-        handle_rpush(tokens, connection);
-    } else if (iequals(name, "LRANGE")) {
-        handle_lrange(tokens, connection);
-    } else if (iequals(name, "SAVE")) {
-        handle_save(tokens, connection);
-    } else {
-        connection.send(resp::SimpleError{std::format("ERR unknown command '{}'", name)});
+    return execute(command, views, subscriber);
+}
+
+resp::Value RequestHandler::execute(const Command &command, const Arguments arguments,
+                                    const std::optional<Tracking::Subscriber> &subscriber) const {
+    // the arity has been checked already
+    Capture capture{};
+    (this->*command.handler.client)(arguments, capture);
+    if (subscriber.has_value()) {
+        remember(command, arguments, *subscriber);
     }
+    return std::move(capture.reply);
 }
 
-void RequestHandler::handle_ping(const Tokenizer &tokens, Connection &connection) {
-    if (tokens.size() == 1) {
-        connection.send(resp::SimpleString{"PONG"});
-    } else if (tokens.size() == 2) {
-        const resp::Value &argument = tokens.get_value(1);
-        connection.send(argument);
-    } else {
-        connection.send(resp::syntax_error);
+std::optional<Tracking::Subscriber> RequestHandler::subscriber_of(const Command &command,
+                                                                  const Connection &connection) const {
+    if (connection.tracking() != Connection::Tracking::on || !command.has(commands::read)) {
+        return std::nullopt;
     }
+
+    return Tracking::Subscriber{m_shard, connection.self()};
 }
 
-void RequestHandler::handle_set(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() < 3) {
-        connection.send(resp::syntax_error);
+void RequestHandler::remember(const Command &command, const Arguments arguments,
+                              const Tracking::Subscriber &subscriber) const {
+    // only the replies of reads may be cached
+    if (!command.has(commands::read)) {
         return;
     }
 
-    const auto key = tokens.get_string(1);
+    command.for_each_key(arguments, [this, &subscriber](const std::string_view key) {
+        m_shard->tracking().remember(key, subscriber);
+    });
+}
+
+void RequestHandler::queue(const Command &command, const Arguments arguments, Connection &connection) const {
+    Transaction &transaction = connection.transaction();
+    const auto refuse = [&transaction, &connection](const resp::SimpleError &error) {
+        transaction.failed = true;
+        connection.send(error);
+    };
+
+    if (command.has(commands::connection)) {
+        refuse(resp::SimpleError{"ERR", "Command not allowed inside a transaction"});
+        return;
+    }
+
+    // the transaction runs on one shard, which would leave the others out
+    if (command.has(commands::all_shards) && m_shard != nullptr && m_shard->shards().size() > 1) {
+        refuse(resp::SimpleError{"ERR", std::format("'{}' is not allowed inside a transaction with several shards",
+                                                    command.name)});
+        return;
+    }
+
+    std::optional<size_t> shard = transaction.shard;
+    if (!claim(shard, command, arguments)) {
+        refuse(cross_slot_error);
+        return;
+    }
+
+    // the arguments point into the connection's receive buffer, which moves on before EXEC
+    transaction.shard = shard;
+    transaction.commands.push_back(to_command(arguments));
+    connection.send(resp::SimpleString{"QUEUED"});
+}
+
+bool RequestHandler::claim(std::optional<size_t> &shard, const std::string_view key) const {
+    if (m_shard == nullptr || m_shard->shards().size() == 1) {
+        return true;
+    }
+
+    const size_t index = m_shard->owner(key).index();
+    if (!shard.has_value()) {
+        shard = index;
+    }
+    return *shard == index;
+}
+
+bool RequestHandler::claim(std::optional<size_t> &shard, const Command &command, const Arguments arguments) const {
+    bool claimed{true};
+    command.for_each_key(arguments, [this, &shard, &claimed](const std::string_view key) {
+        claimed = claim(shard, key) && claimed;
+    });
+    return claimed;
+}
+
+resp::Value RequestHandler::run_transaction(const Transaction &transaction,
+                                            const std::optional<Tracking::Subscriber> &subscriber) const {
+    for (const auto &[key, version]: transaction.watched) {
+        if (m_dictionary.version(key) != version) {
+            return resp::Array{std::nullopt};
+        }
+    }
+
+    // nothing else runs on this shard until they are all done, which is what makes them atomic
+    std::vector<resp::Value> replies{};
+    replies.reserve(transaction.commands.size());
+    for (const resp::Array &queued: transaction.commands) {
+        const auto &name = std::get<resp::BulkString>(queued.value->front()).value;
+        replies.push_back(execute(*command_table().find(*name), queued, subscriber));
+    }
+    return resp::Array{std::move(replies)};
+}
+
+void RequestHandler::handle_ping(const Arguments arguments, Client &client) const {
+    if (arguments.size() == 1) {
+        client.send(resp::SimpleString{"PONG"});
+    } else if (arguments.size() == 2) {
+        client.send(resp::BulkString{std::string{arguments[1]}});
+    } else {
+        client.send(resp::syntax_error);
+    }
+}
+
+void RequestHandler::handle_set(const Arguments arguments, Client &client) const {
+    const auto key = arguments[1];
 
     bool nx{false};
     bool xx{false};
     bool get{false};
     std::optional<Timestamp> expiry{std::nullopt};
-    for (size_t i{3}; i < tokens.size(); ++i) {
-        const auto option = *tokens.get_string(i);
+    for (size_t i{3}; i < arguments.size(); ++i) {
+        const auto option = arguments[i];
 
         if (iequals(option, "NX")) {
             if (xx) {
-                connection.send(resp::syntax_error);
+                client.send(resp::syntax_error);
                 return;
             }
             nx = true;
         } else if (iequals(option, "XX")) {
             if (nx) {
-                connection.send(resp::syntax_error);
+                client.send(resp::syntax_error);
                 return;
             }
             xx = true;
         } else if (iequals(option, "GET")) {
             get = true;
         } else if (iequals(option, "EX")) {
-            if (expiry.has_value() || i == tokens.size() - 1) {
-                connection.send(resp::syntax_error);
+            if (expiry.has_value() || i == arguments.size() - 1) {
+                client.send(resp::syntax_error);
                 return;
             }
 
-            const auto duration = try_parse_positive_int(*tokens.get_string(++i));
+            const auto duration = try_parse_positive_int(arguments[++i]);
             if (!duration.has_value()) {
-                connection.send(resp::syntax_error);
+                client.send(resp::syntax_error);
                 return;
             }
             expiry = Clock::now() + std::chrono::seconds(*duration);
         } else if (iequals(option, "PX")) {
-            if (expiry.has_value() || i == tokens.size() - 1) {
-                connection.send(resp::syntax_error);
+            if (expiry.has_value() || i == arguments.size() - 1) {
+                client.send(resp::syntax_error);
                 return;
             }
 
-            const auto duration = try_parse_positive_int(*tokens.get_string(++i));
+            const auto duration = try_parse_positive_int(arguments[++i]);
             if (!duration.has_value()) {
-                connection.send(resp::syntax_error);
+                client.send(resp::syntax_error);
                 return;
             }
             expiry = Clock::now() + std::chrono::milliseconds(*duration);
         } else if (iequals(option, "EXAT")) {
-            if (expiry.has_value() || i == tokens.size() - 1) {
-                connection.send(resp::syntax_error);
+            if (expiry.has_value() || i == arguments.size() - 1) {
+                client.send(resp::syntax_error);
                 return;
             }
 
-            const auto timestamp = try_parse_positive_int(*tokens.get_string(++i));
+            const auto timestamp = try_parse_positive_int(arguments[++i]);
             if (!timestamp.has_value()) {
-                connection.send(resp::syntax_error);
+                client.send(resp::syntax_error);
                 return;
             }
             expiry = Timestamp{std::chrono::seconds(*timestamp)};
         } else if (iequals(option, "PXAT")) {
-            if (expiry.has_value() || i == tokens.size() - 1) {
-                connection.send(resp::syntax_error);
+            if (expiry.has_value() || i == arguments.size() - 1) {
+                client.send(resp::syntax_error);
                 return;
             }
 
-            const auto timestamp = try_parse_positive_int(*tokens.get_string(++i));
+            const auto timestamp = try_parse_positive_int(arguments[++i]);
             if (!timestamp.has_value()) {
-                connection.send(resp::syntax_error);
+                client.send(resp::syntax_error);
                 return;
             }
             expiry = Timestamp{std::chrono::milliseconds(*timestamp)};
         } else {
-            connection.send(resp::syntax_error);
+            client.send(resp::syntax_error);
             return;
         }
     }
 
-    const bool exists = m_dictionary.exists(key->data());
+    const bool exists = m_dictionary.exists(key);
     if (nx && exists || xx && !exists) {
-        connection.send(resp::nil);
+        client.send(resp::nil);
         return;
     }
 
-    const auto &value = tokens.get_value(2);
+    // the only copy the value gets: into the dictionary, in the form it is stored in
+    resp::Value value{m_dictionary.string_value(arguments[2])};
     if (get) {
-        const auto response = m_dictionary.set_and_get(key->data(), value, expiry);
+        const auto response = m_dictionary.set_and_get(key, std::move(value), expiry);
 
-        if (response.has_value() && std::holds_alternative<resp::BulkString>(*response)) {
-            connection.send(*response);
+        if (response.has_value() && (std::holds_alternative<resp::BulkString>(*response) ||
+                                     std::holds_alternative<resp::SharedString>(*response))) {
+            client.send(*response);
             return;
         }
-        connection.send(resp::nil);
+        client.send(resp::nil);
         return;
     }
 
-    m_dictionary.set(key->data(), value, expiry);
-    connection.send(resp::ok);
+    m_dictionary.set(key, std::move(value), expiry);
+    client.send(resp::ok);
 }
 
-void RequestHandler::handle_get(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() < 2) {
-        connection.send(resp::syntax_error);
+void RequestHandler::handle_get(const Arguments arguments, Client &client) const {
+    const auto key = arguments[1];
+
+    const auto value = m_dictionary.get(key);
+    if (!value) {
+        client.send(resp::nil);
         return;
     }
 
-    const auto key = tokens.get_string(1);
+    if (!std::holds_alternative<resp::BulkString>(value->get()) &&
+        !std::holds_alternative<resp::SharedString>(value->get())) {
+        client.send(resp::SimpleError{"ERR", "cannot get non-string type"});
+        return;
+    }
 
-    const auto value = m_dictionary.get(key->data());
-    if (!value) {
-        connection.send(resp::nil);
+    client.send(*value);
+}
+
+void RequestHandler::handle_mget(const Arguments arguments, Client &client) const {
+    const auto keys = arguments.subspan(1);
+
+    // on a data set larger than the cache, every lookup misses it, so they all get going before any is waited for
+    for (const std::string_view key: keys) {
+        m_dictionary.prefetch(key);
+    }
+
+    // as in redis, anything that is not a string reads as nil
+    std::vector<resp::Value> values{};
+    values.reserve(keys.size());
+    for (const std::string_view key: keys) {
+        const auto value = m_dictionary.get(key);
+        if (value && (std::holds_alternative<resp::BulkString>(value->get()) ||
+                      std::holds_alternative<resp::SharedString>(value->get()))) {
+            values.push_back(*value);
+        } else {
+            values.push_back(resp::nil);
+        }
+    }
+
+    client.send(resp::Array{std::move(values)});
+}
+
+void RequestHandler::handle_mset(const Arguments arguments, Client &client) const {
+    if (arguments.size() % 2 == 0) {
+        client.send(resp::SimpleError{"ERR", "wrong number of arguments for 'mset' command"});
         return;
     }
 
-    if (!std::holds_alternative<resp::BulkString>(value->get())) {
-        connection.send(resp::SimpleError{"ERR", "cannot get non-string type"});
+    for (size_t i{1}; i < arguments.size(); i += 2) {
+        m_dictionary.prefetch(arguments[i]);
+    }
+    for (size_t i{1}; i < arguments.size(); i += 2) {
+        m_dictionary.set(arguments[i], m_dictionary.string_value(arguments[i + 1]));
+    }
+
+    client.send(resp::ok);
+}
+
+void RequestHandler::handle_msetnx(const Arguments arguments, Client &client) const {
+    if (arguments.size() % 2 == 0) {
+        client.send(resp::SimpleError{"ERR", "wrong number of arguments for 'msetnx' command"});
         return;
     }
 
-    connection.send(*value);
+    for (size_t i{1}; i < arguments.size(); i += 2) {
+        m_dictionary.prefetch(arguments[i]);
+    }
+
+    // nothing is set if any of the keys exists
+    for (size_t i{1}; i < arguments.size(); i += 2) {
+        if (m_dictionary.exists(arguments[i])) {
+            client.send(resp::Integer{0});
+            return;
+        }
+    }
+    for (size_t i{1}; i < arguments.size(); i += 2) {
+        m_dictionary.set(arguments[i], m_dictionary.string_value(arguments[i + 1]));
+    }
+
+    client.send(resp::Integer{1});
 }
 
-void RequestHandler::handle_flushdb(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() > 2) {
-        connection.send(resp::syntax_error);
+void RequestHandler::handle_flushdb(const Arguments arguments, Client &client) const {
+    if (arguments.size() > 2) {
+        client.send(resp::syntax_error);
         return;
     }
     m_dictionary.flush();
-    connection.send(resp::ok);
+    client.send(resp::ok);
 }
 
-void RequestHandler::handle_exists(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() < 2) {
-        connection.send(resp::syntax_error);
-        return;
+void RequestHandler::handle_exists(const Arguments arguments, Client &client) const {
+    for (const std::string_view key: arguments.subspan(1)) {
+        m_dictionary.prefetch(key);
     }
 
     int count{0};
-    for (size_t i{1}; i < tokens.size(); ++i) {
-        const auto key = tokens.get_string(i);
+    for (size_t i{1}; i < arguments.size(); ++i) {
+        const auto key = arguments[i];
 
-        if (m_dictionary.exists(key->data())) {
+        if (m_dictionary.exists(key)) {
             ++count;
         }
     }
 
-    connection.send(resp::Integer{count});
+    client.send(resp::Integer{count});
 }
 
-void RequestHandler::handle_del(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() < 2) {
-        connection.send(resp::syntax_error);
-        return;
+void RequestHandler::handle_del(const Arguments arguments, Client &client) const {
+    for (const std::string_view key: arguments.subspan(1)) {
+        m_dictionary.prefetch(key);
     }
 
     int count{0};
-    for (size_t i{1}; i < tokens.size(); ++i) {
-        const auto key = tokens.get_string(i);
+    for (size_t i{1}; i < arguments.size(); ++i) {
+        const auto key = arguments[i];
 
-        if (m_dictionary.exists(key->data())) {
-            m_dictionary.del(key->data());
+        if (m_dictionary.exists(key)) {
+            m_dictionary.del(key);
             ++count;
         }
     }
 
-    connection.send(resp::Integer{count});
+    client.send(resp::Integer{count});
 }
 
-void RequestHandler::handle_incr(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() != 2) {
-        connection.send(resp::syntax_error);
+void RequestHandler::handle_incr(const Arguments arguments, Client &client) const {
+    const auto key = arguments[1];
+
+    const auto result = m_dictionary.incr(key);
+
+    if (!result.has_value()) {
+        client.send(get_incr_error_message(result.error()));
         return;
     }
 
-    const auto key = tokens.get_string(1);
+    client.send(resp::Integer{result.value()});
+}
+
+void RequestHandler::handle_decr(const Arguments arguments, Client &client) const {
+    const auto key = arguments[1];
 
-    const auto result = m_dictionary.incr(key->data());
+    const auto result = m_dictionary.incr(key, -1);
 
     if (!result.has_value()) {
-        connection.send(get_incr_error_message(result.error()));
+        client.send(get_incr_error_message(result.error()));
         return;
     }
 
-    connection.send(resp::Integer{result.value()});
+    client.send(resp::Integer{result.value()});
 }
 
-void RequestHandler::handle_decr(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() != 2) {
-        connection.send(resp::syntax_error);
+void RequestHandler::handle_lpush(const Arguments arguments, Client &client) const {
+    const auto key = arguments[1];
+    const auto values = arguments.subspan(2);
+    constexpr bool reverse = true;
+
+    const ssize_t new_size = m_dictionary.push(key, values, reverse);
+    if (new_size == -1) {
+        client.send(resp::SimpleError{"ERR", "cannot push to non-array value"});
         return;
     }
 
-    const auto key = tokens.get_string(1);
+    client.send(resp::Integer{new_size});
+}
 
-    const auto result = m_dictionary.incr(key->data(), -1);
+void RequestHandler::handle_rpush(const Arguments arguments, Client &client) const {
+    const auto key = arguments[1];
+    const auto values = arguments.subspan(2);
+    constexpr bool reverse = false;
 
-    if (!result.has_value()) {
-        connection.send(get_incr_error_message(result.error()));
+    const ssize_t new_size = m_dictionary.push(key, values, reverse);
+    if (new_size == -1) {
+        client.send(resp::SimpleError{"ERR", "cannot push to non-array value"});
         return;
     }
 
-    connection.send(resp::Integer{result.value()});
+    client.send(resp::Integer{new_size});
 }
 
-void RequestHandler::handle_lpush(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() < 2) {
-        connection.send(resp::syntax_error);
+void RequestHandler::handle_lrange(const Arguments arguments, Client &client) const {
+    const auto key = arguments[1];
+    const auto start = try_parse_numeric<ptrdiff_t>(arguments[2]);
+    const auto stop = try_parse_numeric<ptrdiff_t>(arguments[3]);
+
+    if (!start || !stop) {
+        client.send(resp::syntax_error);
         return;
     }
 
-    const auto key = tokens.get_string(1);
-    const resp::Value *ptr = &tokens.get_value(2);
-    const std::span values{ptr, tokens.size() - 2};
-    constexpr bool reverse = true;
+    const auto range = m_dictionary.range(key, *start, *stop);
 
-    const ssize_t new_size = m_dictionary.push(key->data(), values, reverse);
-    if (new_size == -1) {
-        connection.send(resp::SimpleError{"ERR", "cannot push to non-array value"});
+    if (!range.has_value()) {
+        client.send(resp::SimpleError{"ERR", "cannot get range of non-array type"});
         return;
     }
 
-    connection.send(resp::Integer{new_size});
+    // refers to the stored elements, which the connection serializes as it gets to them
+    client.send(*range);
 }
 
-void RequestHandler::handle_rpush(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() < 2) {
-        connection.send(resp::syntax_error);
+void RequestHandler::handle_save(const Arguments, Client &client) const {
+    std::ofstream file{Server::dump_path};
+
+    m_dictionary.save(file);
+
+    client.send(resp::ok);
+}
+
+
+
+
+
+
+void RequestHandler::handle_info(const Arguments arguments, Client &client) const {
+    if (arguments.size() > 2) {
+        client.send(resp::syntax_error);
         return;
     }
 
-    const auto key = tokens.get_string(1);
-    const resp::Value *ptr = &tokens.get_value(2);
-    const std::span values{ptr, tokens.size() - 2};
-    constexpr bool reverse = false;
+    std::vector<resp::Value> replies{};
+    if (m_shard != nullptr) {
+        replies.push_back(collect_info(*m_shard));
+    }
 
-    const ssize_t new_size = m_dictionary.push(key->data(), values, reverse);
-    if (new_size == -1) {
-        connection.send(resp::SimpleError{"ERR", "cannot push to non-array value"});
+    client.send(render_info(info_sections(arguments), replies));
+}
+
+void RequestHandler::handle_hello(const Arguments arguments, Connection &connection) const {
+    if (arguments.size() > 2) {
+        connection.send(resp::SimpleError{"ERR", "HELLO options are not supported"});
         return;
     }
 
-    connection.send(resp::Integer{new_size});
+    resp::Protocol protocol = connection.protocol();
+    if (arguments.size() == 2) {
+        const auto version = try_parse_numeric<int64_t>(arguments[1]);
+        if (!version.has_value()) {
+            connection.send(resp::SimpleError{"ERR", "Protocol version is not an integer or out of range"});
+            return;
+        }
+        if (*version != 2 && *version != 3) {
+            connection.send(resp::SimpleError{"NOPROTO", "unsupported protocol version"});
+            return;
+        }
+        protocol = static_cast<resp::Protocol>(*version);
+    }
+
+    // the reply already goes out in the protocol asked for
+    connection.set_protocol(protocol);
+    connection.send(resp::Map{
+        std::vector<resp::Value>{
+            resp::BulkString{"server"}, resp::BulkString{"redish"},
+            resp::BulkString{"version"}, resp::BulkString{std::string{server_version}},
+            resp::BulkString{"proto"}, resp::Integer{static_cast<int64_t>(protocol)},
+            resp::BulkString{"id"}, resp::Integer{static_cast<int64_t>(connection.id())},
+            resp::BulkString{"mode"}, resp::BulkString{"standalone"},
+            resp::BulkString{"role"}, resp::BulkString{"master"},
+            resp::BulkString{"modules"}, resp::Array{std::vector<resp::Value>{}},
+        }
+    });
+}
+
+void RequestHandler::handle_client(const Arguments arguments, Connection &connection) const {
+    const auto subcommand = arguments[1];
+    if (iequals(subcommand, "ID") && arguments.size() == 2) {
+        connection.send(resp::Integer{static_cast<int64_t>(connection.id())});
+    } else if (iequals(subcommand, "TRACKING")) {
+        handle_client_tracking(arguments, connection);
+    } else if (iequals(subcommand, "REPLY") && arguments.size() == 3) {
+        handle_client_reply(arguments, connection);
+    } else {
+        connection.send(resp::SimpleError{"ERR", std::format("unknown subcommand or wrong number of arguments for '{}'",
+                                                             subcommand)});
+    }
 }
 
-void RequestHandler::handle_lrange(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() != 4) {
+void RequestHandler::handle_client_tracking(const Arguments arguments, Connection &connection) const {
+    if (arguments.size() < 3) {
         connection.send(resp::syntax_error);
         return;
     }
 
-    const auto key = tokens.get_string(1);
-    const auto start = try_parse_numeric<ptrdiff_t>(*tokens.get_string(2));
-    const auto stop = try_parse_numeric<ptrdiff_t>(*tokens.get_string(3));
-
-    if (!start || !stop) {
+    bool on{false};
+    if (iequals(arguments[2], "ON")) {
+        on = true;
+    } else if (!iequals(arguments[2], "OFF")) {
         connection.send(resp::syntax_error);
         return;
     }
 
-    const auto range = m_dictionary.range(key->data(), *start, *stop);
+    bool broadcast{false};
+    std::vector<std::string_view> prefixes{};
+    for (size_t i{3}; i < arguments.size(); ++i) {
+        const auto option = arguments[i];
+
+        if (iequals(option, "BCAST")) {
+            broadcast = true;
+        } else if (iequals(option, "PREFIX") && i + 1 < arguments.size()) {
+            prefixes.push_back(arguments[++i]);
+        } else if (iequals(option, "REDIRECT") || iequals(option, "OPTIN") || iequals(option, "OPTOUT") ||
+                   iequals(option, "NOLOOP")) {
+            connection.send(resp::SimpleError{"ERR", std::format("the {} option is not supported", option)});
+            return;
+        } else {
+            connection.send(resp::syntax_error);
+            return;
+        }
+    }
 
-    if (!range.has_value()) {
-        connection.send(resp::SimpleError{"ERR", "cannot get range of non-array type"});
+    if (!prefixes.empty() && !broadcast) {
+        connection.send(resp::SimpleError{"ERR", "PREFIX option requires BCAST mode to be enabled"});
         return;
     }
 
-    connection.send(resp::Array{
-        std::vector<resp::Value>{range->begin(), range->end()}
-    });
+    // the keys live in the shards' tables
+    if (m_shard == nullptr) {
+        connection.send(resp::SimpleError{"ERR", "client tracking is not available"});
+        return;
+    }
+
+    const Connection::Tracking current = connection.tracking();
+    const Connection::Tracking wanted = !on
+                                            ? Connection::Tracking::off
+                                            : broadcast
+                                                  ? Connection::Tracking::broadcast
+                                                  : Connection::Tracking::on;
+
+    // invalidations are pushes, which only RESP3 can tell apart from replies
+    if (on && connection.protocol() != resp::Protocol::resp3) {
+        connection.send(resp::SimpleError{"ERR", "client tracking requires RESP3, switch to it with HELLO 3"});
+        return;
+    }
+
+    if (on && current != Connection::Tracking::off && current != wanted) {
+        connection.send(resp::SimpleError{
+            "ERR", "You can't switch BCAST mode on/off before disabling tracking for this client, and then "
+            "re-enabling it with a different mode."
+        });
+        return;
+    }
+
+    connection.set_tracking(wanted);
+
+    // keys read in the default mode are forgotten as they change, but prefixes stay until taken back, on every shard.
+    // the reply waits until every shard has taken them in, so a change made right after is not missed
+    if (wanted != Connection::Tracking::broadcast && current != Connection::Tracking::broadcast) {
+        connection.send(resp::ok);
+        return;
+    }
+
+    if (prefixes.empty()) {
+        prefixes.emplace_back();
+    }
+
+    const Tracking::Subscriber subscriber{m_shard, connection.self()};
+    std::vector<std::string> owned{prefixes.begin(), prefixes.end()};
+    std::vector<std::pair<Shard *, Work> > work{};
+    for (const auto &shard: m_shard->shards()) {
+        work.emplace_back(shard.get(), [subscriber, owned, on](Shard &owner) -> resp::Value {
+            if (!on) {
+                owner.tracking().unsubscribe(subscriber.connection.get());
+                return resp::ok;
+            }
+
+            for (const std::string &prefix: owned) {
+                owner.tracking().subscribe(prefix, subscriber);
+            }
+            return resp::ok;
+        });
+    }
+
+    scatter(connection, std::move(work), first_error_or_ok);
 }
 
-void RequestHandler::handle_save(const Tokenizer &tokens, Connection &connection) const {
-    if (tokens.size() != 1) {
+void RequestHandler::handle_client_reply(const Arguments arguments, Connection &connection) {
+    const auto mode = arguments[2];
+
+    // like redis, OFF and SKIP are not replied to, as they are about not getting replies
+    if (iequals(mode, "ON")) {
+        connection.set_reply(Connection::Reply::on);
+        connection.send(resp::ok);
+    } else if (iequals(mode, "OFF")) {
+        connection.set_reply(Connection::Reply::off);
+    } else if (iequals(mode, "SKIP")) {
+        connection.set_reply(Connection::Reply::skip);
+    } else {
         connection.send(resp::syntax_error);
+    }
+}
+
+void RequestHandler::handle_multi(const Arguments, Connection &connection) const {
+    Transaction &transaction = connection.transaction();
+    if (transaction.active) {
+        connection.send(resp::SimpleError{"ERR", "MULTI calls can not be nested"});
         return;
     }
 
-    std::ofstream file{Server::dump_path};
+    transaction.active = true;
+    connection.send(resp::ok);
+}
 
-    m_dictionary.save(file);
+void RequestHandler::handle_exec(const Arguments, Connection &connection) const {
+    if (!connection.transaction().active) {
+        connection.send(resp::SimpleError{"ERR", "EXEC without MULTI"});
+        return;
+    }
+
+    // whatever happens, the connection is done with it, watched keys included
+    Transaction transaction = std::exchange(connection.transaction(), Transaction{});
+    if (transaction.failed) {
+        connection.send(resp::SimpleError{"EXECABORT", "Transaction discarded because of previous errors."});
+        return;
+    }
+
+    std::optional<Tracking::Subscriber> subscriber{};
+    if (m_shard != nullptr && connection.tracking() == Connection::Tracking::on) {
+        subscriber = Tracking::Subscriber{m_shard, connection.self()};
+    }
+
+    // a shard is only claimed when there are several
+    if (!transaction.shard.has_value() || *transaction.shard == m_shard->index()) {
+        connection.send(run_transaction(transaction, subscriber));
+        return;
+    }
+
+    std::vector<std::pair<Shard *, Work> > work{};
+    work.emplace_back(m_shard->shards()[*transaction.shard].get(),
+                      [transaction = std::move(transaction), subscriber](Shard &owner) {
+                          return owner.request_handler().run_transaction(transaction, subscriber);
+                      });
+    scatter(connection, std::move(work), only_reply);
+}
+
+void RequestHandler::handle_discard(const Arguments, Connection &connection) const {
+    if (!connection.transaction().active) {
+        connection.send(resp::SimpleError{"ERR", "DISCARD without MULTI"});
+        return;
+    }
+
+    connection.transaction() = Transaction{};
+    connection.send(resp::ok);
+}
+
+void RequestHandler::handle_watch(const Arguments arguments, Connection &connection) const {
+    Transaction &transaction = connection.transaction();
+    if (transaction.active) {
+        connection.send(resp::SimpleError{"ERR", "WATCH inside MULTI is not allowed"});
+        return;
+    }
+
+    const auto keys = arguments.subspan(1);
+    std::optional<size_t> shard = transaction.shard;
+    for (const std::string_view key: keys) {
+        if (!claim(shard, key)) {
+            connection.send(cross_slot_error);
+            return;
+        }
+    }
+    transaction.shard = shard;
 
+    if (!shard.has_value() || *shard == m_shard->index()) {
+        for (const std::string_view key: keys) {
+            transaction.watched.push_back({std::string{key}, m_dictionary.version(key)});
+        }
+        connection.send(resp::ok);
+        return;
+    }
+
+    // the versions are the owner's to tell, and are noted down once they are back
+    std::vector<std::string> owned(keys.begin(), keys.end());
+    std::vector<std::pair<Shard *, Work> > work{};
+    work.emplace_back(m_shard->shards()[*shard].get(), [owned](Shard &owner) {
+        std::vector<resp::Value> versions{};
+        versions.reserve(owned.size());
+        for (const std::string &key: owned) {
+            versions.emplace_back(resp::Integer{static_cast<int64_t>(owner.dictionary().version(key))});
+        }
+        return resp::Array{std::move(versions)};
+    });
+
+    scatter(connection, std::move(work), [self = connection.self(), owned = std::move(owned)
+            ](std::vector<resp::Value> &replies) mutable -> resp::Value {
+                const auto &versions = *std::get<resp::Array>(replies.front()).value;
+                auto &watched = (*self)->transaction().watched;
+                for (size_t i{0}; i < owned.size(); ++i) {
+                    watched.push_back({
+                        std::move(owned[i]), static_cast<uint64_t>(std::get<resp::Integer>(versions[i]).value)
+                    });
+                }
+                return resp::ok;
+            });
+}
+
+void RequestHandler::handle_unwatch(const Arguments, Connection &connection) const {
+    Transaction &transaction = connection.transaction();
+    if (transaction.active) {
+        connection.send(resp::SimpleError{"ERR", "UNWATCH inside MULTI is not allowed"});
+        return;
+    }
+
+    transaction = Transaction{};
     connection.send(resp::ok);
 }
 
+class RequestHandler::FunctionHost final : public script::Host {
+public:
+    explicit FunctionHost(const RequestHandler &handler): m_handler{handler} {
+    }
+
+    resp::Value call(const script::Arguments arguments) override {
+        Capture capture{};
+        const Command *command = lookup(arguments, capture);
+        if (command == nullptr) {
+            return std::move(capture.reply);
+        }
+
+        if (command->has(commands::connection) || command->has(commands::all_shards) ||
+            command->has(commands::noscript)) {
+            return resp::SimpleError{"ERR", std::format("'{}' cannot be called from a function", command->name)};
+        }
+
+        // a function runs on the shard of the keys it is called with, and only gets at the keys there
+        const Shard *shard = m_handler.m_shard;
+        bool local{true};
+        command->for_each_key(arguments, [shard, &local](const std::string_view key) {
+            local = local && (shard == nullptr || shard->owns(key));
+        });
+        if (!local) {
+            return cross_slot_error;
+        }
+
+        return m_handler.execute(*command, arguments);
+    }
 
+private:
+    const RequestHandler &m_handler;
+};
 
+void RequestHandler::handle_function(const Arguments arguments, Client &client) const {
+    const auto subcommand = arguments[1];
 
+    if (iequals(subcommand, "LOAD") &&
+        (arguments.size() == 3 || (arguments.size() == 4 && iequals(arguments[2], "REPLACE")))) {
+        const auto loaded = m_library.load(arguments.back(), arguments.size() == 4);
+        if (!loaded.has_value()) {
+            client.send(resp::SimpleError{"ERR", std::format("Error compiling function: {}", loaded.error())});
+            return;
+        }
 
+        std::vector<resp::Value> names{};
+        for (const std::string &name: *loaded) {
+            names.emplace_back(resp::BulkString{name});
+        }
+        client.send(resp::Array{std::move(names)});
+    } else if (iequals(subcommand, "DELETE") && arguments.size() == 3) {
+        if (m_library.remove(arguments[2])) {
+            client.send(resp::ok);
+        } else {
+            client.send(function_not_found);
+        }
+    } else if (iequals(subcommand, "FLUSH") && arguments.size() == 2) {
+        m_library.flush();
+        client.send(resp::ok);
+    } else if (iequals(subcommand, "LIST") && arguments.size() == 2) {
+        std::vector<resp::Value> names{};
+        for (std::string &name: m_library.names()) {
+            names.emplace_back(resp::BulkString{std::move(name)});
+        }
+        client.send(resp::Array{std::move(names)});
+    } else {
+        client.send(resp::syntax_error);
+    }
+}
+
+void RequestHandler::handle_fcall(const Arguments arguments, Client &client) const {
+    const auto count = try_parse_numeric<size_t>(arguments[2]);
+    if (!count.has_value()) {
+        client.send(resp::SimpleError{"ERR", "value is not an integer or out of range"});
+        return;
+    }
+    if (*count > arguments.size() - 3) {
+        client.send(resp::SimpleError{"ERR", "Number of keys can't be greater than number of args"});
+        return;
+    }
+
+    const script::Function *function = m_library.find(arguments[1]);
+    if (function == nullptr) {
+        client.send(function_not_found);
+        return;
+    }
+
+    FunctionHost host{*this};
+    const size_t budget = m_function_budget == 0 ? std::numeric_limits<size_t>::max() : m_function_budget;
+    client.send(script::run(*function, arguments.subspan(3, *count), arguments.subspan(3 + *count), host, budget));
+}
@@ -1,7 +1,9 @@
 #include "resp.h"
 
+#include <array>
 #include <assert.h>
 #include <charconv>
+#include <format>
 #include <istream>
 #include <ostream>
 
@@ -24,13 +26,42 @@ namespace {
         out.insert(out.end(), buf, ptr);
     }
 
-    void serialize(const SimpleString &s, std::vector<char> &out) {
+    // ":0\r\n" to ":9999\r\n" back to back, and where each of them starts: the counts and lengths most integer replies
+    // are, sent without working out their digits
+    constexpr int64_t encoded_integers{10'000};
+
+    struct EncodedIntegers {
+        std::string bytes{};
+        std::array<uint32_t, encoded_integers + 1> offsets{};
+
+        EncodedIntegers() {
+            for (int64_t i{0}; i < encoded_integers; ++i) {
+                offsets[i] = static_cast<uint32_t>(bytes.size());
+                bytes += std::format(":{}\r\n", i);
+            }
+            offsets[encoded_integers] = static_cast<uint32_t>(bytes.size());
+        }
+
+        [[nodiscard]] std::string_view operator[](const int64_t i) const {
+            return std::string_view{bytes}.substr(offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    };
+
+    const EncodedIntegers g_integers{};
+
+    void serialize(const SimpleString &s, std::vector<char> &out, Protocol) {
+        // the reply to nearly every write
+        if (s.value == "OK") {
+            append(out, "+OK\r\n");
+            return;
+        }
+
         out.push_back('+');
         append(out, s.value);
         append_crlf(out);
     }
 
-    void serialize(const SimpleError &e, std::vector<char> &out) {
+    void serialize(const SimpleError &e, std::vector<char> &out, Protocol) {
         out.push_back('-');
         append(out, e.prefix);
         append(out, " ");
@@ -38,15 +69,24 @@ namespace {
         append_crlf(out);
     }
 
-    void serialize(const Integer &i, std::vector<char> &out) {
+    void serialize(const Integer &i, std::vector<char> &out, Protocol) {
+        if (i.value >= 0 && i.value < encoded_integers) {
+            append(out, g_integers[i.value]);
+            return;
+        }
+
         out.push_back(':');
         append_int(out, i.value);
         append_crlf(out);
     }
 
-    void serialize(const BulkString &b, std::vector<char> &out) {
+    void serialize(const Null &, std::vector<char> &out, const Protocol protocol) {
+        append(out, protocol == Protocol::resp3 ? "_\r\n" : "$-1\r\n");
+    }
+
+    void serialize(const BulkString &b, std::vector<char> &out, const Protocol protocol) {
         if (!b.value) {
-            append(out, "$-1\r\n");
+            serialize(Null{}, out, protocol);
             return;
         }
         append(out, "$");
@@ -56,19 +96,92 @@ namespace {
         append_crlf(out);
     }
 
-    void serialize(const Array &a, std::vector<char> &out) {
+    void serialize(const SharedString &s, std::vector<char> &out, Protocol) {
+        if (s.header != 0) {
+            append(out, *s.value);
+            return;
+        }
+
+        append(out, "$");
+        append_int(out, static_cast<int64_t>(s.value->size()));
+        append_crlf(out);
+        append(out, *s.value);
+        append_crlf(out);
+    }
+
+    void serialize(const Boolean &b, std::vector<char> &out, const Protocol protocol) {
+        if (protocol == Protocol::resp3) {
+            append(out, b.value ? "#t\r\n" : "#f\r\n");
+        } else {
+            append(out, b.value ? ":1\r\n" : ":0\r\n");
+        }
+    }
+
+    void serialize(const Double &d, std::vector<char> &out, const Protocol protocol) {
+        // the shortest text that reads back as the same double, and inf, -inf or nan for the rest
+        char buf[32];
+        auto [ptr, ec] = std::to_chars(buf, buf + sizeof(buf), d.value);
+        const std::string_view text{buf, static_cast<size_t>(ptr - buf)};
+
+        if (protocol == Protocol::resp3) {
+            out.push_back(',');
+            append(out, text);
+            append_crlf(out);
+            return;
+        }
+
+        out.push_back('$');
+        append_int(out, static_cast<int64_t>(text.size()));
+        append_crlf(out);
+        append(out, text);
+        append_crlf(out);
+    }
+
+    // an aggregate's header, and then its elements, which are sent in the same protocol
+    void serialize_elements(const char type, const size_t size, const std::vector<Value> &elements,
+                            std::vector<char> &out, const Protocol protocol) {
+        out.push_back(type);
+        append_int(out, static_cast<int64_t>(size));
+        append_crlf(out);
+        for (const auto &v: elements) {
+            resp::serialize(v, out, protocol);
+        }
+    }
+
+    void serialize(const Array &a, std::vector<char> &out, const Protocol protocol) {
         if (!a.value) {
-            append(out, "*-1\r\n");
+            append(out, protocol == Protocol::resp3 ? "_\r\n" : "*-1\r\n");
             return;
         }
-        append(out, "*");
-        append_int(out, static_cast<int64_t>(a.value->size()));
+        serialize_elements('*', a.value->size(), *a.value, out, protocol);
+    }
+
+    void serialize(const SharedArray &a, std::vector<char> &out, const Protocol protocol) {
+        out.push_back('*');
+        append_int(out, static_cast<int64_t>(a.count));
         append_crlf(out);
-        for (const auto &v: *a.value) {
-            serialize(v, out);
+        for (const auto &v: a.elements()) {
+            resp::serialize(v, out, protocol);
         }
     }
 
+    // RESP2 has only arrays, so a map goes out flattened, as its keys and values taking turns
+    void serialize(const Map &m, std::vector<char> &out, const Protocol protocol) {
+        if (protocol == Protocol::resp3) {
+            serialize_elements('%', m.value.size() / 2, m.value, out, protocol);
+        } else {
+            serialize_elements('*', m.value.size(), m.value, out, protocol);
+        }
+    }
+
+    void serialize(const Set &s, std::vector<char> &out, const Protocol protocol) {
+        serialize_elements(protocol == Protocol::resp3 ? '~' : '*', s.value.size(), s.value, out, protocol);
+    }
+
+    void serialize(const Push &p, std::vector<char> &out, const Protocol protocol) {
+        serialize_elements(protocol == Protocol::resp3 ? '>' : '*', p.value.size(), p.value, out, protocol);
+    }
+
     void save_int(const int64_t value, std::ostream &out) {
         out.write(reinterpret_cast<const char *>(&value), sizeof(value));
     }
@@ -101,9 +214,14 @@ namespace {
         save_string(*string.value, out);
     }
 
+    void save(const SharedString &string, std::ostream &out) {
+        save_string(string.contents(), out);
+    }
+
     void save(const Array &array, std::ostream &out) {
         if (!array.value.has_value()) {
             save_int(-1, out);
+            return;
         }
         const int64_t size{static_cast<int64_t>(array.value->size())};
         save_int(size, out);
@@ -112,6 +230,43 @@ namespace {
         }
     }
 
+    void save(const SharedArray &array, std::ostream &out) {
+        save_int(static_cast<int64_t>(array.count), out);
+        for (const Value &val: array.elements()) {
+            save(val, out);
+        }
+    }
+
+    void save(const Null &, std::ostream &) {
+    }
+
+    void save(const Boolean &boolean, std::ostream &out) {
+        save_int(boolean.value ? 1 : 0, out);
+    }
+
+    void save(const Double &number, std::ostream &out) {
+        out.write(reinterpret_cast<const char *>(&number.value), sizeof(number.value));
+    }
+
+    void save_elements(const std::vector<Value> &elements, std::ostream &out) {
+        save_int(static_cast<int64_t>(elements.size()), out);
+        for (const Value &val: elements) {
+            resp::save(val, out);
+        }
+    }
+
+    void save(const Map &map, std::ostream &out) {
+        save_elements(map.value, out);
+    }
+
+    void save(const Set &set, std::ostream &out) {
+        save_elements(set.value, out);
+    }
+
+    void save(const Push &push, std::ostream &out) {
+        save_elements(push.value, out);
+    }
+
     template<typename T, typename V, size_t I = 0>
     constexpr size_t variant_index() {
         if constexpr (I >= std::variant_size_v<V>) {
@@ -159,6 +314,23 @@ namespace {
         return {load_string(in)};
     }
 
+    Double load_double(std::istream &in) {
+        double result{};
+        in.read(reinterpret_cast<char *>(&result), sizeof(result));
+        return {result};
+    }
+
+    std::vector<Value> load_elements(std::istream &in) {
+        const int64_t size{load_int(in)};
+
+        std::vector<Value> result{};
+        result.reserve(size);
+        for (int64_t i{0}; i < size; ++i) {
+            result.emplace_back(load(in));
+        }
+        return result;
+    }
+
     Array load_array(std::istream &in) {
         std::vector<Value> result{};
 
@@ -168,7 +340,7 @@ namespace {
             return {std::nullopt};
         }
 
-        assert(size > 0);
+        assert(size >= 0);
         result.reserve(size);
 
         for (size_t i{0}; i < size; ++i) {
@@ -180,14 +352,69 @@ namespace {
 }
 
 namespace resp {
-    void serialize(const Value &value, std::vector<char> &out) {
-        std::visit([&out](auto &&arg) {
-            ::serialize(arg, out);
+    std::optional<std::string_view> string_of(const Value &value) {
+        if (const auto *string = std::get_if<BulkString>(&value); string && string->value.has_value()) {
+            return *string->value;
+        }
+
+        if (const auto *string = std::get_if<SharedString>(&value)) {
+            return string->contents();
+        }
+
+        return std::nullopt;
+    }
+
+    SharedString encode(const std::string_view contents) {
+        char length[21];
+        const auto [end, ec] = std::to_chars(length, length + sizeof(length), contents.size());
+        const size_t header = 1 + static_cast<size_t>(end - length) + 2;
+
+        std::string wire{};
+        wire.reserve(header + contents.size() + 2);
+        wire += '$';
+        wire.append(length, end);
+        wire += "\r\n";
+        wire += contents;
+        wire += "\r\n";
+        return SharedString{std::make_shared<const std::string>(std::move(wire)), header};
+    }
+
+    Value string_value(const std::string_view contents, const size_t threshold) {
+        if (contents.size() < threshold) {
+            return BulkString{std::string{contents}};
+        }
+
+        return encode(contents);
+    }
+
+    Value share(Value value, const size_t threshold) {
+        if (auto *array = std::get_if<Array>(&value); array && array->value.has_value()) {
+            const size_t count{array->value->size()};
+            return SharedArray{std::make_shared<std::vector<Value> >(std::move(*array->value)), 0, count};
+        }
+
+        const auto *string = std::get_if<BulkString>(&value);
+        if (!string || !string->value.has_value() || string->value->size() < threshold) {
+            return value;
+        }
+
+        return encode(*string->value);
+    }
+
+    void serialize(const Value &value, std::vector<char> &out, const Protocol protocol) {
+        std::visit([&out, protocol](auto &&arg) {
+            ::serialize(arg, out, protocol);
         }, value);
     }
 
     void save(const Value &value, std::ostream &out) {
-        const size_t tag = value.index();
+        // how a string or an array is held in memory is no concern of the dump, which has it as a plain one
+        size_t tag{value.index()};
+        if (std::holds_alternative<SharedString>(value)) {
+            tag = variant_index<BulkString, Value>();
+        } else if (std::holds_alternative<SharedArray>(value)) {
+            tag = variant_index<Array, Value>();
+        }
         out.write(reinterpret_cast<const char *>(&tag), sizeof(tag));
         std::visit([&out](const auto &v) {
             ::save(v, out);
@@ -209,6 +436,18 @@ namespace resp {
                 return load_bulk_string(in);
             case variant_index<Array, Value>():
                 return load_array(in);
+            case variant_index<Null, Value>():
+                return Null{};
+            case variant_index<Boolean, Value>():
+                return Boolean{load_int(in) != 0};
+            case variant_index<Double, Value>():
+                return load_double(in);
+            case variant_index<Map, Value>():
+                return Map{load_elements(in)};
+            case variant_index<Set, Value>():
+                return Set{load_elements(in)};
+            case variant_index<Push, Value>():
+                return Push{load_elements(in)};
             default:
                 throw std::runtime_error("resp::load: invalid tag encountered");
         }
@@ -4,33 +4,22 @@
 
 #include "resp_parser.h"
 #include "resp.h"
+#include "resp_scan.h"
 
+#include <algorithm>
 #include <charconv>
-#include <format>
-#include <iostream>
 
 namespace resp {
-    void Parser::feed(const std::span<const char> data) {
-        m_buffer.insert(m_buffer.end(), data.begin(), data.end());
-
-        // while we can decode values, decode them
-        while (std::optional<Value> value = decode_next()) {
-            m_values.emplace_back(std::move(*value));
-            // if we get a successful parse, increment the parsed offset to the new position
-            m_parsed = m_position;
-
-            // if we have expanded over an internal limit, compact the buffer by erasing the parsed portion
-            if (m_parsed > m_buffer_limit) {
-                m_buffer.erase(m_buffer.begin(),
-                               m_buffer.begin() + static_cast<std::vector<char>::difference_type>(m_parsed));
-                m_parsed = 0;
-                m_position = 0;
-            }
+    void Parser::feed(std::span<const char> data) {
+        while (!m_failed && !data.empty()) {
+            const size_t consumed = m_bulk.has_value() ? feed_bulk(data) : feed_line(data);
+            data = data.subspan(consumed);
         }
 
-        // if we are left with an incomplete parse, this resets the position to the last successful parse.
-        // otherwise, m_position == m_parsed already, so this does nothing.
-        m_position = m_parsed;
+        // once a long line has gone through, give its memory back rather than keeping it around for good
+        if (m_line.empty() && m_line.capacity() > m_buffer_limit) {
+            m_line = std::vector<char>{};
+        }
     }
 
     std::vector<Value> Parser::take_values() {
@@ -39,188 +28,240 @@ namespace resp {
         return values;
     }
 
-    std::optional<Value> Parser::decode_next() {
-        if (m_position >= m_buffer.size()) {
-            return std::nullopt;
+    size_t Parser::memory_usage() const {
+        size_t usage{m_values.capacity() * sizeof(Value) + m_frames.capacity() * sizeof(Frame) + m_line.capacity()};
+        for (const Frame &frame: m_frames) {
+            usage += frame.values.capacity() * sizeof(Value);
         }
-
-        std::optional<Value> value{};
-
-        switch (advance()) {
-            case '+':
-                value = decode_simple_string();
-                break;
-            case '-':
-                value = decode_simple_error();
-                break;
-            case ':':
-                value = decode_integer();
-                break;
-            case '$':
-                value = decode_bulk_string();
-                break;
-            case '*':
-                value = decode_array();
-                break;
-            default:
-                value = std::nullopt;
+        if (m_bulk.has_value()) {
+            usage += m_bulk->capacity();
         }
-
-        return value;
+        return usage;
     }
 
-    std::optional<SimpleString> Parser::decode_simple_string() {
-        const size_t start{m_position};
-
-        while (m_position + 1 < m_buffer.size()) {
-            if (advance() == '\r' && peek() == '\n') {
-                const size_t size{m_position - start - 1};
-                advance(); // consume newline
-                std::string value{m_buffer.data() + start, size};
-                return SimpleString{std::move(value)};
+    size_t Parser::feed_line(const std::span<const char> data) {
+        if (m_line.empty()) {
+            const size_t end = find_crlf(data);
+            if (end == std::string_view::npos) {
+                m_line.assign(data.begin(), data.end());
+                return data.size();
             }
-        }
-
-        return std::nullopt;
-    }
 
-    std::optional<SimpleError> Parser::decode_simple_error() {
-        const size_t prefix_start{m_position};
-        SimpleError error{};
-        bool prefix_parsed{false};
-
-        while (m_position + 1 < m_buffer.size()) {
-            const char c = advance();
-            if (c == ' ') {
-                const size_t size{m_position - prefix_start - 1};
-                std::string prefix{m_buffer.data() + prefix_start, size};
-                error.prefix = std::move(prefix);
-                prefix_parsed = true;
-                break;
-            }
-            if (c == '\r' && peek() == '\n') {
-                const size_t size{m_position - prefix_start - 1};
-                std::string prefix{m_buffer.data() + prefix_start, size};
-                advance(); // consume newline
-                error.prefix = std::move(prefix);
-                return error;
-            }
+            decode_line({data.data(), end});
+            return end + 2;
         }
 
-        if (!prefix_parsed) {
-            return std::nullopt;
+        // the last feed may have stopped right between the CR and the LF
+        if (m_line.back() == '\r' && data.front() == '\n') {
+            m_line.pop_back();
+            decode_line({m_line.data(), m_line.size()});
+            m_line.clear();
+            return 1;
         }
 
-        const size_t value_start{m_position};
-        while (m_position + 1 < m_buffer.size()) {
-            if (advance() == '\r' && peek() == '\n') {
-                const size_t size{m_position - value_start - 1};
-                std::string value{m_buffer.data() + value_start, size};
-                advance(); // consume newline
-                error.value = std::move(value);
-                return error;
-            }
+        const size_t end = find_crlf(data);
+        if (end == std::string_view::npos) {
+            m_line.insert(m_line.end(), data.begin(), data.end());
+            return data.size();
         }
 
-        return std::nullopt;
+        m_line.insert(m_line.end(), data.begin(), data.begin() + static_cast<std::ptrdiff_t>(end));
+        decode_line({m_line.data(), m_line.size()});
+        m_line.clear();
+        return end + 2;
     }
 
-    std::optional<Integer> Parser::decode_integer() {
-        size_t start{};
-        bool start_set{false};
+    size_t Parser::feed_bulk(const std::span<const char> data) {
+        size_t consumed{0};
 
-        while (m_position + 1 < m_buffer.size()) {
-            const char c = advance();
-            if (!start_set && c != '+') {
-                start = m_position - 1;
-                start_set = true;
-            }
-            if (c == '\r' && peek() == '\n') {
-                const size_t size{m_position - start - 1};
-                advance(); // consume newline
-                const std::string_view value{m_buffer.data() + start, size};
-                int int_value{};
-                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), int_value);
-
-                if (ec != std::errc() || ptr != value.end()) {
-                    return std::nullopt;
-                }
-                return Integer{int_value};
+        // the payload goes straight into the string, which already has room for it
+        if (m_bulk_remaining > 2) {
+            consumed = std::min(data.size(), m_bulk_remaining - 2);
+            m_bulk->append(data.data(), consumed);
+            m_bulk_remaining -= consumed;
+        }
+
+        // then its CRLF, which may be split up just the same
+        while (m_bulk_remaining <= 2 && m_bulk_remaining > 0 && consumed < data.size()) {
+            if (data[consumed] != (m_bulk_remaining == 2 ? '\r' : '\n')) {
+                m_failed = true;
+                return data.size();
             }
+            ++consumed;
+            --m_bulk_remaining;
         }
 
-        return std::nullopt;
-    }
+        if (m_bulk_remaining == 0) {
+            BulkString bulk{std::move(m_bulk)};
+            m_bulk.reset();
+            push(std::move(bulk));
+        }
 
-    std::optional<BulkString> Parser::decode_bulk_string() {
-        const size_t start{m_position};
-        size_t size{};
+        return consumed;
+    }
 
-        while (m_position + 1 < m_buffer.size()) {
-            if (advance() == '\r' && peek() == '\n') {
-                const std::string_view value{m_buffer.data() + start, m_position - start - 1};
-                advance(); // consume newline
+    void Parser::decode_line(const std::string_view line) {
+        if (line.empty()) {
+            m_failed = true;
+            return;
+        }
 
-                if (value == "-1") {
-                    return BulkString{std::nullopt};
+        const std::string_view rest = line.substr(1);
+        switch (line.front()) {
+            case '+':
+                push(SimpleString{std::string{rest}});
+                return;
+            case '-':
+                push(decode_simple_error(rest));
+                return;
+            case ':':
+                if (const auto integer = decode_integer(rest)) {
+                    push(*integer);
+                    return;
+                }
+                break;
+            case '$': {
+                const auto length = parse_length(rest);
+                if (length == -1) {
+                    push(BulkString{std::nullopt});
+                    return;
+                }
+                if (!length.has_value() || *length < 0 || *length > static_cast<int64_t>(max_bulk_length)) {
+                    break;
                 }
 
-                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), size);
-
-                if (ec != std::errc()) {
-                    return std::nullopt;
+                m_bulk.emplace();
+                m_bulk->reserve(static_cast<size_t>(*length));
+                m_bulk_remaining = static_cast<size_t>(*length) + 2;
+                return;
+            }
+            case '*':
+                if (rest == "-1") {
+                    push(Array{std::nullopt});
+                    return;
+                }
+                if (decode_aggregate(Frame::Kind::array, rest)) {
+                    return;
                 }
                 break;
-            }
+            case '%':
+                if (decode_aggregate(Frame::Kind::map, rest)) {
+                    return;
+                }
+                break;
+            case '~':
+                if (decode_aggregate(Frame::Kind::set, rest)) {
+                    return;
+                }
+                break;
+            case '>':
+                if (decode_aggregate(Frame::Kind::push, rest)) {
+                    return;
+                }
+                break;
+            case '_':
+                if (rest.empty()) {
+                    push(Null{});
+                    return;
+                }
+                break;
+            case '#':
+                if (rest == "t" || rest == "f") {
+                    push(Boolean{rest == "t"});
+                    return;
+                }
+                break;
+            case ',':
+                if (const auto number = decode_double(rest)) {
+                    push(*number);
+                    return;
+                }
+                break;
+            default:
+                break;
         }
 
+        m_failed = true;
+    }
 
-        std::string value{m_buffer.data() + m_position, size};
-        m_position += size;
+    SimpleError Parser::decode_simple_error(const std::string_view line) {
+        // the prefix is the first word, the message whatever follows it
+        const size_t space = line.find(' ');
+        if (space == std::string_view::npos) {
+            return SimpleError{std::string{line}, {}};
+        }
 
+        return SimpleError{std::string{line.substr(0, space)}, std::string{line.substr(space + 1)}};
+    }
 
-        if (m_position >= m_buffer.size() || advance() != '\r' || peek() != '\n') {
-            return std::nullopt;
+    std::optional<Integer> Parser::decode_integer(std::string_view line) {
+        while (line.starts_with('+')) {
+            line.remove_prefix(1);
         }
 
-        advance(); // consume newline
+        int value{};
+        const auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), value);
+        if (ec != std::errc() || ptr != line.data() + line.size()) {
+            return std::nullopt;
+        }
+        return Integer{value};
+    }
 
-        return BulkString{std::move(value)};
+    std::optional<Double> Parser::decode_double(const std::string_view line) {
+        double value{};
+        const auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), value);
+        if (ec != std::errc() || ptr != line.data() + line.size()) {
+            return std::nullopt;
+        }
+        return Double{value};
     }
 
-    std::optional<Array> Parser::decode_array() {
-        const size_t start{m_position};
-        size_t size{};
+    bool Parser::decode_aggregate(const Frame::Kind kind, const std::string_view line) {
+        const auto count = parse_length(line);
+        if (!count.has_value() || *count < 0) {
+            return false;
+        }
 
-        while (m_position + 1 < m_buffer.size()) {
-            if (advance() == '\r' && peek() == '\n') {
-                const std::string_view value{m_buffer.data() + start, m_position - start - 1};
-                advance(); // consume newline
+        const size_t elements = static_cast<size_t>(*count) * (kind == Frame::Kind::map ? 2 : 1);
+        Frame frame{kind, {}, elements};
 
-                if (value == "-1") {
-                    return Array{std::nullopt};
-                }
+        // an empty aggregate is complete as soon as it starts
+        if (elements == 0) {
+            push(complete(std::move(frame)));
+            return true;
+        }
 
-                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), size);
+        frame.values.reserve(std::min(elements, max_reserved_elements));
+        m_frames.push_back(std::move(frame));
+        return true;
+    }
 
-                if (ec != std::errc()) {
-                    return std::nullopt;
-                }
-                break;
-            }
+    Value Parser::complete(Frame frame) {
+        switch (frame.kind) {
+            case Frame::Kind::map:
+                return Map{std::move(frame.values)};
+            case Frame::Kind::set:
+                return Set{std::move(frame.values)};
+            case Frame::Kind::push:
+                return Push{std::move(frame.values)};
+            default:
+                return Array{std::move(frame.values)};
         }
+    }
 
-        std::vector<Value> values{size};
-        for (size_t i = 0; i < size; ++i) {
-            std::optional value = decode_next();
-
-            if (!value.has_value()) {
-                return std::nullopt;
+    void Parser::push(Value value) {
+        while (!m_frames.empty()) {
+            Frame &frame = m_frames.back();
+            frame.values.push_back(std::move(value));
+            if (--frame.remaining > 0) {
+                return;
             }
 
-            values[i] = std::move(*value);
+            // that completes the aggregate, which in turn is an element of the one around it, if any
+            value = complete(std::move(frame));
+            m_frames.pop_back();
         }
 
-        return Array{std::move(values)};
+        m_values.push_back(std::move(value));
     }
 }
@@ -0,0 +1,194 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "resp_scan.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace resp {
+    namespace {
+        constexpr size_t npos{std::string_view::npos};
+        // how far find_crlf looks one byte at a time before handing over to the kernel
+        constexpr size_t short_line{8};
+
+        // the byte at a time loop the parsers used to have, and the tail end of the vector kernels
+        size_t find_crlf_scalar(const char *data, const size_t size, size_t position) {
+            for (; position + 1 < size; ++position) {
+                if (data[position] == '\r' && data[position + 1] == '\n') {
+                    return position;
+                }
+            }
+            return npos;
+        }
+
+#if defined(__x86_64__)
+        // each block is compared with '\r', and the same block one byte further on with '\n', so a bit that is set
+        // in both masks is a CRLF, even one that straddles two blocks
+        size_t find_crlf_sse2(const char *data, const size_t size) {
+            const __m128i cr = _mm_set1_epi8('\r');
+            const __m128i lf = _mm_set1_epi8('\n');
+
+            size_t position{0};
+            for (; position + 16 < size; position += 16) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position));
+                const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position + 1));
+                const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(block, cr), _mm_cmpeq_epi8(next, lf))));
+                if (mask != 0) {
+                    return position + std::countr_zero(mask);
+                }
+            }
+            return find_crlf_scalar(data, size, position);
+        }
+
+        __attribute__((target("avx2")))
+        size_t find_crlf_avx2(const char *data, const size_t size) {
+            const __m256i cr = _mm256_set1_epi8('\r');
+            const __m256i lf = _mm256_set1_epi8('\n');
+
+            size_t position{0};
+            for (; position + 32 < size; position += 32) {
+                const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + position));
+                const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + position + 1));
+                const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(block, cr), _mm256_cmpeq_epi8(next, lf))));
+                if (mask != 0) {
+                    return position + std::countr_zero(mask);
+                }
+            }
+
+            // most headers are shorter than a whole block
+            if (position + 16 < size) {
+                const size_t found = find_crlf_sse2(data + position, size - position);
+                return found == npos ? npos : position + found;
+            }
+            return find_crlf_scalar(data, size, position);
+        }
+#endif
+
+        using Kernel = size_t (*)(const char *, size_t);
+
+        size_t find_crlf_portable(const char *data, const size_t size) {
+            return find_crlf_scalar(data, size, 0);
+        }
+
+        bool supported(const ScanKernel kernel) {
+            switch (kernel) {
+                case ScanKernel::scalar:
+                    return true;
+#if defined(__x86_64__)
+                case ScanKernel::sse2:
+                    // part of x86-64 itself
+                    return true;
+                case ScanKernel::avx2:
+                    // this runs during static initialization, possibly before the runtime has looked at the CPU
+                    __builtin_cpu_init();
+                    return __builtin_cpu_supports("avx2");
+#endif
+                default:
+                    return false;
+            }
+        }
+
+        Kernel kernel_for(const ScanKernel kernel) {
+            switch (kernel) {
+#if defined(__x86_64__)
+                case ScanKernel::sse2:
+                    return find_crlf_sse2;
+                case ScanKernel::avx2:
+                    return find_crlf_avx2;
+#endif
+                default:
+                    return find_crlf_portable;
+            }
+        }
+
+        // picked once, before main runs, so the hot path is a single indirect call
+        ScanKernel g_scan_kernel{best_scan_kernel()};
+        Kernel g_find_crlf{kernel_for(g_scan_kernel)};
+    }
+
+    ScanKernel best_scan_kernel() {
+        for (const ScanKernel kernel: {ScanKernel::avx2, ScanKernel::sse2}) {
+            if (supported(kernel)) {
+                return kernel;
+            }
+        }
+        return ScanKernel::scalar;
+    }
+
+    ScanKernel scan_kernel() {
+        return g_scan_kernel;
+    }
+
+    bool set_scan_kernel(const ScanKernel kernel) {
+        if (!supported(kernel)) {
+            return false;
+        }
+
+        g_scan_kernel = kernel;
+        g_find_crlf = kernel_for(kernel);
+        return true;
+    }
+
+    std::string_view to_string(const ScanKernel kernel) {
+        switch (kernel) {
+            case ScanKernel::scalar:
+                return "scalar";
+            case ScanKernel::sse2:
+                return "sse2";
+            case ScanKernel::avx2:
+                return "avx2";
+        }
+        return "unknown";
+    }
+
+    size_t find_crlf(const std::span<const char> data) {
+        // length headers end within a few bytes, sooner than a vector kernel would get going
+        const size_t probe{std::min(data.size(), short_line)};
+        for (size_t position{0}; position + 1 < probe; ++position) {
+            if (data[position] == '\r' && data[position + 1] == '\n') {
+                return position;
+            }
+        }
+        if (data.size() <= short_line) {
+            return npos;
+        }
+
+        // the probe may have stopped on the CR of a CRLF, so the kernel starts on that byte
+        const size_t found = g_find_crlf(data.data() + probe - 1, data.size() - probe + 1);
+        return found == npos ? npos : probe - 1 + found;
+    }
+
+    std::optional<int64_t> parse_length(const std::string_view digits) {
+        const bool negative = !digits.empty() && digits.front() == '-';
+        const std::string_view magnitude = negative ? digits.substr(1) : digits;
+
+        // up to 18 digits cannot overflow, which covers every length a client sends, so there is nothing to check
+        // but the digits themselves
+        if (!magnitude.empty() && magnitude.size() <= 18) {
+            int64_t value{0};
+            for (const char digit: magnitude) {
+                if (digit < '0' || digit > '9') {
+                    return std::nullopt;
+                }
+                value = value * 10 + (digit - '0');
+            }
+            return negative ? -value : value;
+        }
+
+        int64_t value{};
+        const auto [last, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+        if (error != std::errc{} || last != digits.data() + digits.size()) {
+            return std::nullopt;
+        }
+        return value;
+    }
+}
@@ -0,0 +1,982 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "script.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <format>
+#include <memory>
+#include <optional>
+#include <ranges>
+
+namespace script {
+    namespace {
+        // the most a run may hold at once on its stack and in its locals
+        constexpr size_t max_memory{64 * 1024 * 1024};
+        // copying or comparing strings costs an instruction for every so many bytes, so that a loop over long strings
+        // runs out of budget about as soon as one taking as long over short strings would
+        constexpr size_t bytes_per_instruction{64};
+        // how deeply blocks and expressions may nest, so that compiling does not run out of stack
+        constexpr size_t max_depth{200};
+
+        constexpr std::string_view keywords[]{"function", "let", "if", "else", "while", "return", "nil"};
+
+        enum class Kind {
+            name,
+            integer,
+            string,
+            symbol,
+            end,
+        };
+
+        struct Token {
+            Kind kind;
+            std::string text;
+            uint32_t line;
+        };
+
+        // only ever thrown while compiling, and caught by compile
+        struct CompileError {
+            std::string message;
+        };
+
+        // a string a function works with, shared from resp::share_threshold up, so that copying it onto the stack or
+        // into a local costs no more than copying a short one
+        resp::Value make_string(std::string string) {
+            if (string.size() < resp::share_threshold) {
+                return resp::BulkString{std::move(string)};
+            }
+            return resp::SharedString{std::make_shared<const std::string>(std::move(string))};
+        }
+
+        std::vector<Token> tokenize(const std::string_view source) {
+            static constexpr std::string_view pairs[]{"==", "!=", "<=", ">=", "&&", "||", ".."};
+            static constexpr std::string_view singles{"(){}[],;=<>+-*/%!"};
+
+            std::vector<Token> tokens{};
+            uint32_t line{1};
+            size_t i{0};
+            while (i < source.size()) {
+                const auto c = static_cast<unsigned char>(source[i]);
+                const size_t start = i;
+
+                if (c == '\n') {
+                    ++line;
+                    ++i;
+                } else if (std::isspace(c)) {
+                    ++i;
+                } else if (c == '#') {
+                    while (i < source.size() && source[i] != '\n') {
+                        ++i;
+                    }
+                } else if (std::isalpha(c) || c == '_') {
+                    while (i < source.size() &&
+                           (std::isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_')) {
+                        ++i;
+                    }
+                    tokens.push_back({Kind::name, std::string{source.substr(start, i - start)}, line});
+                } else if (std::isdigit(c)) {
+                    while (i < source.size() && std::isdigit(static_cast<unsigned char>(source[i]))) {
+                        ++i;
+                    }
+                    tokens.push_back({Kind::integer, std::string{source.substr(start, i - start)}, line});
+                } else if (c == '"') {
+                    const uint32_t first_line = line;
+                    std::string text{};
+                    for (++i; i < source.size() && source[i] != '"'; ++i) {
+                        char next = source[i];
+                        if (next == '\n') {
+                            ++line;
+                        } else if (next == '\\' && i + 1 < source.size()) {
+                            switch (next = source[++i]) {
+                                case 'n': next = '\n';
+                                    break;
+                                case 'r': next = '\r';
+                                    break;
+                                case 't': next = '\t';
+                                    break;
+                                case '"':
+                                case '\\': break;
+                                default:
+                                    throw CompileError{std::format("line {}: unknown escape '\\{}'", line, next)};
+                            }
+                        }
+                        text += next;
+                    }
+                    if (i == source.size()) {
+                        throw CompileError{std::format("line {}: unterminated string", first_line)};
+                    }
+                    ++i;
+                    tokens.push_back({Kind::string, std::move(text), first_line});
+                } else if (i + 1 < source.size() && std::ranges::find(pairs, source.substr(i, 2)) != std::end(pairs)) {
+                    tokens.push_back({Kind::symbol, std::string{source.substr(i, 2)}, line});
+                    i += 2;
+                } else if (singles.contains(static_cast<char>(c))) {
+                    tokens.push_back({Kind::symbol, std::string(1, static_cast<char>(c)), line});
+                    ++i;
+                } else {
+                    throw CompileError{std::format("line {}: unexpected character '{}'", line, static_cast<char>(c))};
+                }
+            }
+
+            tokens.push_back({Kind::end, {}, line});
+            return tokens;
+        }
+
+        // a recursive descent over the tokens, emitting the code of each function as it goes
+        class Compiler {
+        public:
+            explicit Compiler(std::vector<Token> tokens): m_tokens{std::move(tokens)} {
+            }
+
+            std::vector<Function> library() {
+                std::vector<Function> functions{};
+                while (peek().kind != Kind::end) {
+                    functions.push_back(function());
+                }
+                if (functions.empty()) {
+                    throw CompileError{"no functions"};
+                }
+                return functions;
+            }
+
+        private:
+            std::vector<Token> m_tokens;
+            size_t m_next{0};
+            Function m_function{};
+            // the locals each enclosing block has declared, innermost last, and the slots they are in
+            std::vector<std::vector<std::pair<std::string, uint32_t> > > m_scopes{};
+            size_t m_depth{0};
+
+            // counts one level of nesting for as long as it lives
+            class Nested {
+            public:
+                explicit Nested(Compiler &compiler): m_compiler{compiler} {
+                    if (++m_compiler.m_depth > max_depth) {
+                        m_compiler.error("nested too deeply");
+                    }
+                }
+
+                ~Nested() { --m_compiler.m_depth; }
+
+            private:
+                Compiler &m_compiler;
+            };
+
+            [[nodiscard]] const Token &peek(const size_t ahead = 0) const {
+                return m_tokens[std::min(m_next + ahead, m_tokens.size() - 1)];
+            }
+
+            [[noreturn]] void error(const std::string_view message) const {
+                const Token &token = peek();
+                throw CompileError{
+                    token.kind == Kind::end
+                        ? std::format("line {}: {} at the end", token.line, message)
+                        : std::format("line {}: {} near '{}'", token.line, message, token.text)
+                };
+            }
+
+            bool accept(const std::string_view symbol) {
+                if (peek().kind != Kind::symbol || peek().text != symbol) {
+                    return false;
+                }
+                ++m_next;
+                return true;
+            }
+
+            bool accept_keyword(const std::string_view keyword) {
+                if (peek().kind != Kind::name || peek().text != keyword) {
+                    return false;
+                }
+                ++m_next;
+                return true;
+            }
+
+            void expect(const std::string_view symbol) {
+                if (!accept(symbol)) {
+                    error(std::format("expected '{}'", symbol));
+                }
+            }
+
+            std::string identifier() {
+                if (peek().kind != Kind::name || std::ranges::find(keywords, peek().text) != std::end(keywords)) {
+                    error("expected a name");
+                }
+                return m_tokens[m_next++].text;
+            }
+
+            uint32_t emit(const Op op, const uint32_t operand = 0) {
+                // the line of the token that has just been taken
+                m_function.code.push_back({op, operand, m_tokens[m_next == 0 ? 0 : m_next - 1].line});
+                return static_cast<uint32_t>(m_function.code.size() - 1);
+            }
+
+            // points the jump at where the code is now
+            void patch(const uint32_t jump) {
+                m_function.code[jump].operand = static_cast<uint32_t>(m_function.code.size());
+            }
+
+            void constant(resp::Value value) {
+                m_function.constants.push_back(std::move(value));
+                emit(Op::constant, static_cast<uint32_t>(m_function.constants.size() - 1));
+            }
+
+            std::optional<uint32_t> resolve(const std::string_view name) const {
+                for (auto scope = m_scopes.rbegin(); scope != m_scopes.rend(); ++scope) {
+                    for (const auto &[local, slot]: *scope) {
+                        if (local == name) {
+                            return slot;
+                        }
+                    }
+                }
+                return std::nullopt;
+            }
+
+            Function function() {
+                if (!accept_keyword("function")) {
+                    error("expected a function");
+                }
+                m_function = Function{identifier(), {}, {}, 2};
+                m_scopes = {{{"KEYS", 0}, {"ARGV", 1}}};
+
+                block();
+                emit(Op::nil);
+                emit(Op::ret);
+                return std::move(m_function);
+            }
+
+            void block() {
+                Nested nested{*this};
+                expect("{");
+                m_scopes.emplace_back();
+                while (!accept("}")) {
+                    if (peek().kind == Kind::end) {
+                        error("expected '}'");
+                    }
+                    statement();
+                }
+                m_scopes.pop_back();
+            }
+
+            void statement() {
+                if (accept_keyword("let")) {
+                    std::string name = identifier();
+                    expect("=");
+                    // declared once it has its value, so an outer one of the same name may give it
+                    expression();
+                    expect(";");
+                    if (std::ranges::any_of(m_scopes.back(), [&name](const auto &local) { return local.first == name; })) {
+                        error(std::format("'{}' is declared twice", name));
+                    }
+                    const auto slot = static_cast<uint32_t>(m_function.locals++);
+                    m_scopes.back().emplace_back(std::move(name), slot);
+                    emit(Op::store, slot);
+                } else if (accept_keyword("if")) {
+                    if_statement();
+                } else if (accept_keyword("while")) {
+                    const auto start = static_cast<uint32_t>(m_function.code.size());
+                    expression();
+                    const uint32_t exit = emit(Op::jump_if_false);
+                    block();
+                    emit(Op::jump, start);
+                    patch(exit);
+                } else if (accept_keyword("return")) {
+                    if (accept(";")) {
+                        emit(Op::nil);
+                    } else {
+                        expression();
+                        expect(";");
+                    }
+                    emit(Op::ret);
+                } else if (peek().kind == Kind::name && peek(1).kind == Kind::symbol && peek(1).text == "=") {
+                    const std::string name = identifier();
+                    const auto slot = resolve(name);
+                    if (!slot.has_value()) {
+                        error(std::format("'{}' is not declared", name));
+                    }
+                    ++m_next;
+                    expression();
+                    expect(";");
+                    emit(Op::store, *slot);
+                } else {
+                    expression();
+                    expect(";");
+                    emit(Op::pop);
+                }
+            }
+
+            void if_statement() {
+                expression();
+                const uint32_t skip = emit(Op::jump_if_false);
+                block();
+                if (!accept_keyword("else")) {
+                    patch(skip);
+                    return;
+                }
+
+                const uint32_t end = emit(Op::jump);
+                patch(skip);
+                if (accept_keyword("if")) {
+                    if_statement();
+                } else {
+                    block();
+                }
+                patch(end);
+            }
+
+            // from the loosest binding operator to the tightest
+            void expression() {
+                Nested nested{*this};
+                logical_and();
+                while (accept("||")) {
+                    const uint32_t end = emit(Op::jump_if_true_or_pop);
+                    logical_and();
+                    patch(end);
+                }
+            }
+
+            void logical_and() {
+                equality();
+                while (accept("&&")) {
+                    const uint32_t end = emit(Op::jump_if_false_or_pop);
+                    equality();
+                    patch(end);
+                }
+            }
+
+            void equality() {
+                comparison();
+                while (true) {
+                    if (accept("==")) {
+                        comparison();
+                        emit(Op::equal);
+                    } else if (accept("!=")) {
+                        comparison();
+                        emit(Op::not_equal);
+                    } else {
+                        return;
+                    }
+                }
+            }
+
+            void comparison() {
+                additive();
+                while (true) {
+                    if (accept("<")) {
+                        additive();
+                        emit(Op::less);
+                    } else if (accept("<=")) {
+                        additive();
+                        emit(Op::less_equal);
+                    } else if (accept(">")) {
+                        additive();
+                        emit(Op::greater);
+                    } else if (accept(">=")) {
+                        additive();
+                        emit(Op::greater_equal);
+                    } else {
+                        return;
+                    }
+                }
+            }
+
+            void additive() {
+                multiplicative();
+                while (true) {
+                    if (accept("+")) {
+                        multiplicative();
+                        emit(Op::add);
+                    } else if (accept("-")) {
+                        multiplicative();
+                        emit(Op::subtract);
+                    } else if (accept("..")) {
+                        multiplicative();
+                        emit(Op::concat);
+                    } else {
+                        return;
+                    }
+                }
+            }
+
+            void multiplicative() {
+                unary();
+                while (true) {
+                    if (accept("*")) {
+                        unary();
+                        emit(Op::multiply);
+                    } else if (accept("/")) {
+                        unary();
+                        emit(Op::divide);
+                    } else if (accept("%")) {
+                        unary();
+                        emit(Op::modulo);
+                    } else {
+                        return;
+                    }
+                }
+            }
+
+            void unary() {
+                Nested nested{*this};
+                if (accept("-")) {
+                    unary();
+                    emit(Op::negate);
+                } else if (accept("!")) {
+                    unary();
+                    emit(Op::logical_not);
+                } else {
+                    primary();
+                    while (accept("[")) {
+                        expression();
+                        expect("]");
+                        emit(Op::index);
+                    }
+                }
+            }
+
+            void primary() {
+                const Token &token = peek();
+
+                if (token.kind == Kind::integer) {
+                    int64_t value{};
+                    const auto [end, result] = std::from_chars(token.text.data(), token.text.data() + token.text.size(),
+                                                               value);
+                    if (result != std::errc{}) {
+                        error("integer out of range");
+                    }
+                    ++m_next;
+                    constant(resp::Integer{value});
+                } else if (token.kind == Kind::string) {
+                    ++m_next;
+                    constant(make_string(token.text));
+                } else if (accept("(")) {
+                    expression();
+                    expect(")");
+                } else if (accept_keyword("nil")) {
+                    emit(Op::nil);
+                } else if (token.kind == Kind::name && peek(1).kind == Kind::symbol && peek(1).text == "(") {
+                    builtin();
+                } else {
+                    const std::string name = identifier();
+                    const auto slot = resolve(name);
+                    if (!slot.has_value()) {
+                        error(std::format("'{}' is not declared", name));
+                    }
+                    emit(Op::load, *slot);
+                }
+            }
+
+            void builtin() {
+                const std::string name = m_tokens[m_next].text;
+                m_next += 2;
+
+                uint32_t count{0};
+                if (!accept(")")) {
+                    do {
+                        expression();
+                        ++count;
+                    } while (accept(","));
+                    expect(")");
+                }
+
+                if (name == "call") {
+                    if (count == 0) {
+                        error("call needs a command");
+                    }
+                    emit(Op::call, count);
+                    return;
+                }
+
+                static constexpr std::pair<std::string_view, Op> unary_builtins[]{
+                    {"len", Op::length}, {"int", Op::to_integer}, {"str", Op::to_string}
+                };
+                const auto builtin = std::ranges::find(unary_builtins, name, &std::pair<std::string_view, Op>::first);
+                if (builtin == std::end(unary_builtins)) {
+                    error(std::format("unknown function '{}'", name));
+                }
+                if (count != 1) {
+                    error(std::format("{} takes one argument", name));
+                }
+                emit(builtin->second);
+            }
+        };
+
+        bool is_nil(const resp::Value &value) {
+            if (const auto *string = std::get_if<resp::BulkString>(&value)) {
+                return !string->value.has_value();
+            }
+            if (const auto *array = std::get_if<resp::Array>(&value)) {
+                return !array->value.has_value();
+            }
+            return std::holds_alternative<resp::Null>(value);
+        }
+
+        bool truthy(const resp::Value &value) {
+            if (const auto *integer = std::get_if<resp::Integer>(&value)) {
+                return integer->value != 0;
+            }
+            if (const auto *boolean = std::get_if<resp::Boolean>(&value)) {
+                return boolean->value;
+            }
+            return !is_nil(value);
+        }
+
+        // strings, the status replies of commands included, and integers as they would be written, into scratch
+        std::optional<std::string_view> text_of(const resp::Value &value, std::string &scratch) {
+            if (const auto string = resp::string_of(value)) {
+                return string;
+            }
+            if (const auto *integer = std::get_if<resp::Integer>(&value)) {
+                scratch = std::to_string(integer->value);
+                return scratch;
+            }
+            if (const auto *status = std::get_if<resp::SimpleString>(&value)) {
+                return status->value;
+            }
+            return std::nullopt;
+        }
+
+        std::optional<int64_t> integer_of(const resp::Value &value) {
+            if (const auto *integer = std::get_if<resp::Integer>(&value)) {
+                return integer->value;
+            }
+
+            const auto string = resp::string_of(value);
+            if (!string.has_value()) {
+                return std::nullopt;
+            }
+            int64_t result{};
+            const auto [end, error] = std::from_chars(string->data(), string->data() + string->size(), result);
+            if (error != std::errc{} || end != string->data() + string->size()) {
+                return std::nullopt;
+            }
+            return result;
+        }
+
+        std::optional<std::span<const resp::Value> > elements_of(const resp::Value &value) {
+            if (const auto *array = std::get_if<resp::Array>(&value); array != nullptr && array->value.has_value()) {
+                return *array->value;
+            }
+            if (const auto *array = std::get_if<resp::SharedArray>(&value)) {
+                return array->elements();
+            }
+            return std::nullopt;
+        }
+
+        std::string_view type_of(const resp::Value &value) {
+            if (is_nil(value)) {
+                return "nil";
+            }
+            if (std::holds_alternative<resp::Integer>(value)) {
+                return "an integer";
+            }
+            if (resp::string_of(value).has_value() || std::holds_alternative<resp::SimpleString>(value)) {
+                return "a string";
+            }
+            if (elements_of(value).has_value()) {
+                return "an array";
+            }
+            return "a value of another type";
+        }
+
+        bool equals(const resp::Value &a, const resp::Value &b) {
+            if (is_nil(a) || is_nil(b)) {
+                return is_nil(a) && is_nil(b);
+            }
+
+            // "1" == 1, as both would be sent to a command as the same argument
+            std::string scratch_a{};
+            std::string scratch_b{};
+            const auto text_a = text_of(a, scratch_a);
+            const auto text_b = text_of(b, scratch_b);
+            if (text_a.has_value() && text_b.has_value()) {
+                return *text_a == *text_b;
+            }
+            return a == b;
+        }
+
+        std::optional<int64_t> arithmetic(const Op op, const int64_t a, const int64_t b) {
+            int64_t result{};
+            switch (op) {
+                case Op::add:
+                    return __builtin_add_overflow(a, b, &result) ? std::nullopt : std::optional{result};
+                case Op::subtract:
+                    return __builtin_sub_overflow(a, b, &result) ? std::nullopt : std::optional{result};
+                case Op::multiply:
+                    return __builtin_mul_overflow(a, b, &result) ? std::nullopt : std::optional{result};
+                case Op::divide:
+                case Op::modulo:
+                    if (b == 0 || (a == INT64_MIN && b == -1)) {
+                        return std::nullopt;
+                    }
+                    return op == Op::divide ? a / b : a % b;
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        bool compare(const Op op, const int64_t a, const int64_t b) {
+            switch (op) {
+                case Op::less: return a < b;
+                case Op::less_equal: return a <= b;
+                case Op::greater: return a > b;
+                default: return a >= b;
+            }
+        }
+
+        // KEYS or ARGV, shared so that loading one does not copy it
+        resp::Value strings(const Arguments arguments) {
+            std::vector<resp::Value> values{};
+            values.reserve(arguments.size());
+            for (const std::string_view argument: arguments) {
+                values.push_back(make_string(std::string{argument}));
+            }
+            return resp::share(resp::Array{std::move(values)});
+        }
+
+        // what a value holds on to. a shared buffer is counted in proportion to how many hold it, so that copies of
+        // one string in several locals add up to the string once, and an array by its elements alone, not what they
+        // hold, which in a command's reply is mostly what the keyspace stores anyway
+        size_t footprint(const resp::Value &value) {
+            if (const auto *shared = std::get_if<resp::SharedString>(&value)) {
+                return shared->value->size() / static_cast<size_t>(shared->value.use_count());
+            }
+            if (const auto *array = std::get_if<resp::SharedArray>(&value); array != nullptr && array->values) {
+                return array->count * sizeof(resp::Value) / static_cast<size_t>(array->values.use_count());
+            }
+            if (const auto elements = elements_of(value)) {
+                return elements->size() * sizeof(resp::Value);
+            }
+            if (const auto string = resp::string_of(value)) {
+                return string->size();
+            }
+            return 0;
+        }
+
+        resp::Value pop(std::vector<resp::Value> &stack) {
+            resp::Value value = std::move(stack.back());
+            stack.pop_back();
+            return value;
+        }
+    }
+
+    std::expected<std::vector<Function>, std::string> compile(const std::string_view source) {
+        try {
+            return Compiler{tokenize(source)}.library();
+        } catch (CompileError &error) {
+            return std::unexpected{std::move(error.message)};
+        }
+    }
+
+    resp::Value run(const Function &function, const Arguments keys, const Arguments arguments, Host &host,
+                    const size_t budget) {
+        std::vector<resp::Value> locals(function.locals, resp::nil);
+        locals[0] = strings(keys);
+        locals[1] = strings(arguments);
+        std::vector<resp::Value> stack{};
+        // the arguments of a call, those that are not strings already written out in scratch
+        std::vector<std::string> scratch{};
+        std::vector<std::string_view> views{};
+
+        size_t left{budget};
+        const auto charge = [&left](const size_t bytes) {
+            const size_t cost = bytes / bytes_per_instruction;
+            if (cost > left) {
+                return false;
+            }
+            left -= cost;
+            return true;
+        };
+        const auto holding = [&stack, &locals] {
+            size_t bytes{0};
+            for (const resp::Value &value: stack) {
+                bytes += footprint(value);
+            }
+            for (const resp::Value &value: locals) {
+                bytes += footprint(value);
+            }
+            return bytes;
+        };
+
+        size_t next{0};
+        while (true) {
+            const Instruction &instruction = function.code[next++];
+            const auto fail = [&function, &instruction](const std::string_view message) -> resp::Value {
+                return resp::SimpleError{
+                    "ERR", std::format("{} at line {} of function '{}'", message, instruction.line, function.name)
+                };
+            };
+            const auto out_of_budget = [&fail, budget] {
+                return fail(std::format("out of budget after {} instructions", budget));
+            };
+
+            // a loop that never ends cannot hold up the shard's other clients for longer than this
+            if (left-- == 0) {
+                return out_of_budget();
+            }
+
+            switch (instruction.op) {
+                case Op::constant:
+                    stack.push_back(function.constants[instruction.operand]);
+                    break;
+                case Op::nil:
+                    stack.push_back(resp::nil);
+                    break;
+                case Op::load:
+                    stack.push_back(locals[instruction.operand]);
+                    break;
+                case Op::store:
+                    locals[instruction.operand] = pop(stack);
+                    break;
+                case Op::pop:
+                    stack.pop_back();
+                    break;
+                case Op::add:
+                case Op::subtract:
+                case Op::multiply:
+                case Op::divide:
+                case Op::modulo: {
+                    const resp::Value b = pop(stack);
+                    const resp::Value a = pop(stack);
+                    const auto integer_a = integer_of(a);
+                    const auto integer_b = integer_of(b);
+                    if (!integer_a.has_value() || !integer_b.has_value()) {
+                        return fail(std::format("arithmetic on {} and {}", type_of(a), type_of(b)));
+                    }
+
+                    const auto result = arithmetic(instruction.op, *integer_a, *integer_b);
+                    if (!result.has_value()) {
+                        return fail(*integer_b == 0 && (instruction.op == Op::divide || instruction.op == Op::modulo)
+                                        ? "division by zero"
+                                        : "integer overflow");
+                    }
+                    stack.emplace_back(resp::Integer{*result});
+                    break;
+                }
+                case Op::concat: {
+                    const resp::Value b = pop(stack);
+                    const resp::Value a = pop(stack);
+                    std::string scratch_a{};
+                    std::string scratch_b{};
+                    const auto text_a = text_of(a, scratch_a);
+                    const auto text_b = text_of(b, scratch_b);
+                    if (!text_a.has_value() || !text_b.has_value()) {
+                        return fail(std::format("cannot join {} and {}", type_of(a), type_of(b)));
+                    }
+
+                    const size_t size = text_a->size() + text_b->size();
+                    if (!charge(size)) {
+                        return out_of_budget();
+                    }
+                    if (holding() + size > max_memory) {
+                        return fail(std::format("out of memory, holding more than {} bytes", max_memory));
+                    }
+
+                    std::string joined{};
+                    joined.reserve(size);
+                    joined.append(*text_a).append(*text_b);
+                    stack.push_back(make_string(std::move(joined)));
+                    break;
+                }
+                case Op::equal:
+                case Op::not_equal: {
+                    const resp::Value b = pop(stack);
+                    const resp::Value a = pop(stack);
+                    const auto string_a = resp::string_of(a);
+                    const auto string_b = resp::string_of(b);
+                    if (!charge((string_a ? string_a->size() : 0) + (string_b ? string_b->size() : 0))) {
+                        return out_of_budget();
+                    }
+                    stack.emplace_back(resp::Integer{equals(a, b) == (instruction.op == Op::equal)});
+                    break;
+                }
+                case Op::less:
+                case Op::less_equal:
+                case Op::greater:
+                case Op::greater_equal: {
+                    const resp::Value b = pop(stack);
+                    const resp::Value a = pop(stack);
+                    const auto integer_a = integer_of(a);
+                    const auto integer_b = integer_of(b);
+                    if (!integer_a.has_value() || !integer_b.has_value()) {
+                        return fail(std::format("cannot compare {} and {}", type_of(a), type_of(b)));
+                    }
+                    stack.emplace_back(resp::Integer{compare(instruction.op, *integer_a, *integer_b)});
+                    break;
+                }
+                case Op::negate: {
+                    const resp::Value a = pop(stack);
+                    const auto integer = integer_of(a);
+                    if (!integer.has_value() || *integer == INT64_MIN) {
+                        return fail(std::format("cannot negate {}", type_of(a)));
+                    }
+                    stack.emplace_back(resp::Integer{-*integer});
+                    break;
+                }
+                case Op::logical_not:
+                    stack.back() = resp::Integer{!truthy(stack.back())};
+                    break;
+                case Op::index: {
+                    const resp::Value position = pop(stack);
+                    const resp::Value array = pop(stack);
+                    const auto elements = elements_of(array);
+                    const auto integer = integer_of(position);
+                    if (!elements.has_value() || !integer.has_value()) {
+                        return fail(std::format("cannot index {} with {}", type_of(array), type_of(position)));
+                    }
+
+                    // from 1 at the start, or -1 at the end
+                    const auto size = static_cast<int64_t>(elements->size());
+                    const int64_t index = *integer > 0 ? *integer - 1 : size + *integer;
+                    stack.push_back(*integer != 0 && index >= 0 && index < size
+                                        ? (*elements)[static_cast<size_t>(index)]
+                                        : resp::nil);
+                    break;
+                }
+                case Op::jump:
+                    next = instruction.operand;
+                    break;
+                case Op::jump_if_false:
+                    if (!truthy(pop(stack))) {
+                        next = instruction.operand;
+                    }
+                    break;
+                case Op::jump_if_false_or_pop:
+                case Op::jump_if_true_or_pop:
+                    if (truthy(stack.back()) == (instruction.op == Op::jump_if_true_or_pop)) {
+                        next = instruction.operand;
+                    } else {
+                        stack.pop_back();
+                    }
+                    break;
+                case Op::call: {
+                    const size_t first = stack.size() - instruction.operand;
+                    // the views point into the arguments where they are on the stack, or into scratch, which is not
+                    // to move until the command has run
+                    scratch.clear();
+                    scratch.reserve(instruction.operand);
+                    views.clear();
+                    size_t bytes{0};
+                    for (size_t i{first}; i < stack.size(); ++i) {
+                        const auto text = text_of(stack[i], scratch.emplace_back());
+                        if (!text.has_value()) {
+                            return fail(std::format("cannot pass {} to a command", type_of(stack[i])));
+                        }
+                        views.push_back(*text);
+                        bytes += text->size();
+                    }
+                    if (!charge(bytes)) {
+                        return out_of_budget();
+                    }
+
+                    resp::Value reply = host.call(views);
+                    if (std::holds_alternative<resp::SimpleError>(reply)) {
+                        return reply;
+                    }
+                    stack.resize(first);
+                    stack.push_back(resp::share(std::move(reply)));
+                    if (holding() > max_memory) {
+                        return fail(std::format("out of memory, holding more than {} bytes", max_memory));
+                    }
+                    break;
+                }
+                case Op::length: {
+                    const resp::Value a = pop(stack);
+                    std::string scratch_a{};
+                    if (const auto elements = elements_of(a)) {
+                        stack.emplace_back(resp::Integer{static_cast<int64_t>(elements->size())});
+                    } else if (const auto text = text_of(a, scratch_a)) {
+                        stack.emplace_back(resp::Integer{static_cast<int64_t>(text->size())});
+                    } else if (is_nil(a)) {
+                        stack.emplace_back(resp::Integer{0});
+                    } else {
+                        return fail(std::format("{} has no length", type_of(a)));
+                    }
+                    break;
+                }
+                case Op::to_integer: {
+                    const resp::Value a = pop(stack);
+                    // a missing counter is 0, as it is to INCR
+                    const auto integer = is_nil(a) ? std::optional<int64_t>{0} : integer_of(a);
+                    if (!integer.has_value()) {
+                        return fail(std::format("{} is not an integer", type_of(a)));
+                    }
+                    stack.emplace_back(resp::Integer{*integer});
+                    break;
+                }
+                case Op::to_string: {
+                    resp::Value a = pop(stack);
+                    if (is_nil(a)) {
+                        stack.push_back(resp::nil);
+                        break;
+                    }
+                    // a string already, and maybe a long one
+                    if (resp::string_of(a).has_value()) {
+                        stack.push_back(std::move(a));
+                        break;
+                    }
+                    std::string scratch_a{};
+                    const auto text = text_of(a, scratch_a);
+                    if (!text.has_value()) {
+                        return fail(std::format("{} is not a string", type_of(a)));
+                    }
+                    stack.emplace_back(resp::BulkString{std::string{*text}});
+                    break;
+                }
+                case Op::ret:
+                    return pop(stack);
+            }
+        }
+    }
+
+    std::expected<std::vector<std::string>, std::string> Library::load(const std::string_view source,
+                                                                       const bool replace) {
+        auto functions = compile(source);
+        if (!functions.has_value()) {
+            return std::unexpected{std::move(functions.error())};
+        }
+
+        std::vector<std::string> names{};
+        for (const Function &function: *functions) {
+            if (std::ranges::find(names, function.name) != names.end()) {
+                return std::unexpected{std::format("function '{}' is defined twice", function.name)};
+            }
+            if (!replace && m_functions.contains(function.name)) {
+                return std::unexpected{std::format("function '{}' already exists", function.name)};
+            }
+            names.push_back(function.name);
+        }
+
+        for (Function &function: *functions) {
+            std::string name = function.name;
+            m_functions.insert_or_assign(std::move(name), std::move(function));
+        }
+        return names;
+    }
+
+    bool Library::remove(const std::string_view name) {
+        const auto function = m_functions.find(name);
+        if (function == m_functions.end()) {
+            return false;
+        }
+        m_functions.erase(function);
+        return true;
+    }
+
+    const Function *Library::find(const std::string_view name) const {
+        const auto function = m_functions.find(name);
+        return function == m_functions.end() ? nullptr : &function->second;
+    }
+
+    std::vector<std::string> Library::names() const {
+        std::vector<std::string> names{};
+        names.reserve(m_functions.size());
+        for (const auto &name: m_functions | std::views::keys) {
+            names.push_back(name);
+        }
+        return names;
+    }
+}
@@ -8,71 +8,178 @@
 #include <format>
 #include <cstdio>
 #include <cstring>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <system_error>
 #include <sys/epoll.h>
 #include <fcntl.h>
 #include <fstream>
+#include <iostream>
 #include <bits/fs_fwd.h>
+#include <thread>
 
 #include "acceptor.h"
 #include "request_handler.h"
 
 
-void Server::start(const std::string_view port, const int backlog_size) {
-    addrinfo hints{};
-    addrinfo *result{}; // will point to the results
+namespace {
+    int listen_on(const std::string &port, const int backlog_size, const bool reuse_port) {
+        addrinfo hints{};
+        addrinfo *result{}; // will point to the results
 
-    memset(&hints, 0, sizeof hints); // make sure the struct is empty
-    hints.ai_family = AF_UNSPEC; // don't care IPv4 or IPv6
-    hints.ai_socktype = SOCK_STREAM; // TCP stream sockets
-    hints.ai_flags = AI_PASSIVE; // fill in my IP for me
+        memset(&hints, 0, sizeof hints); // make sure the struct is empty
+        hints.ai_family = AF_UNSPEC; // don't care IPv4 or IPv6
+        hints.ai_socktype = SOCK_STREAM; // TCP stream sockets
+        hints.ai_flags = AI_PASSIVE; // fill in my IP for me
 
-    if (getaddrinfo(nullptr, port.data(), &hints, &result) != 0) {
-        throw std::system_error(errno, std::system_category(), "Server::start getaddrinfo");
+        if (getaddrinfo(nullptr, port.c_str(), &hints, &result) != 0) {
+            throw std::system_error(errno, std::system_category(), "Server::start getaddrinfo");
+        }
+
+        int listener{-1};
+        const addrinfo *p{nullptr};
+        for (p = result; p != nullptr; p = p->ai_next) {
+            if ((listener = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                   p->ai_protocol)) == -1) {
+                continue;
+            }
+
+            constexpr int yes = 1;
+            if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1) {
+                throw std::system_error(errno, std::system_category(), "Server::start setsockopt");
+            }
+
+            // every shard listens on its own socket and the kernel spreads incoming connections across them
+            if (reuse_port && setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1) {
+                throw std::system_error(errno, std::system_category(), "Server::start setsockopt");
+            }
+
+            if (bind(listener, result->ai_addr, result->ai_addrlen) != 0) {
+                close(listener);
+                continue;
+            }
+
+            break;
+        }
+
+        if (p == nullptr) {
+            throw std::system_error(errno, std::system_category(), "Server::start bind");
+        }
+
+        freeaddrinfo(result);
+
+        if (listen(listener, backlog_size) != 0) {
+            throw std::system_error(errno, std::system_category(), "Server::start listen");
+        }
+
+        return listener;
     }
 
-    const addrinfo *p{nullptr};
-    for (p = result; p != nullptr; p = p->ai_next) {
-        if ((m_socket = socket(p->ai_family, p->ai_socktype,
-                               p->ai_protocol)) == -1) {
-            continue;
+    int listen_on_unix(const std::filesystem::path &path, const mode_t permissions, const int backlog_size) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.native().size() >= sizeof(address.sun_path)) {
+            throw std::system_error(ENAMETOOLONG, std::system_category(), "Server::start unix socket path");
+        }
+        path.native().copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+        const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listener == -1) {
+            throw std::system_error(errno, std::system_category(), "Server::start socket");
         }
 
-        constexpr int yes = 1;
-        if (setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1) {
-            throw std::system_error(errno, std::system_category(), "Server::start setsockopt");
+        // a socket file left behind by an earlier run would make the bind fail
+        if (unlink(path.c_str()) == -1 && errno != ENOENT) {
+            close(listener);
+            throw std::system_error(errno, std::system_category(), "Server::start unlink");
         }
 
-        if (bind(m_socket, result->ai_addr, result->ai_addrlen) != 0) {
-            close(m_socket);
-            continue;
+        if (bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+            close(listener);
+            throw std::system_error(errno, std::system_category(), "Server::start bind");
         }
 
-        break;
+        if (chmod(path.c_str(), permissions) != 0) {
+            close(listener);
+            throw std::system_error(errno, std::system_category(), "Server::start chmod");
+        }
+
+        if (listen(listener, backlog_size) != 0) {
+            close(listener);
+            throw std::system_error(errno, std::system_category(), "Server::start listen");
+        }
+
+        return listener;
     }
+}
+
+void Server::start(const Options &options) {
+    const size_t threads{std::max<size_t>(options.threads, 1)};
 
-    if (p == nullptr) {
-        throw std::system_error(errno, std::system_category(), "Server::start bind");
+    // io_uring already leaves the system calls to the kernel, and hands the loop its data ready to parse
+    size_t io_threads{std::max<size_t>(options.io_threads, 1)};
+    if (io_threads > 1 && options.backend == EventLoop::Backend::io_uring) {
+        std::cerr << "Warning: I/O threads are only used with the epoll backend\n";
+        io_threads = 1;
     }
 
-    freeaddrinfo(result);
+    for (size_t i{0}; i < threads; ++i) {
+        m_shards.push_back(std::make_unique<Shard>(i, m_shards, options.backend, io_threads, options.busy_poll));
+    }
+
+    const Connection::Options connection_options{options.idle_timeout, options.command_budget, options.byte_budget};
+
+    // unix domain sockets cannot be spread across shards with SO_REUSEPORT, so there is just the one of each, and every
+    // shard accepts from its own duplicate of it; whichever gets to a connection first serves it
+    const auto listen_locally = [&options](const std::filesystem::path &path) {
+        return path.empty() ? -1 : listen_on_unix(path, options.unix_socket_permissions, options.backlog_size);
+    };
+    const int unix_listener = listen_locally(options.unix_socket);
+    const int shm_listener = listen_locally(options.shm_socket);
+
+    for (const auto &shard: m_shards) {
+        shard->dictionary().set_encode_threshold(options.encode_threshold);
+        shard->request_handler().set_function_budget(options.function_budget);
+        if (exists(dump_path)) {
+            std::ifstream file{dump_path};
+            shard->dictionary().load(file, [&shard](const std::string &key) { return shard->owns(key); });
+        }
+
+        const auto add_acceptor = [&](const int listener, const bool shared_memory = false) {
+            auto acceptor = std::make_unique<Acceptor>(listener, shard->event_loop(), shard->request_handler(),
+                                                       shard->connection_pool(), connection_options,
+                                                       shared_memory);
+            shard->event_loop().add_acceptor(listener, std::move(acceptor));
+        };
+
+        const auto add_local_acceptor = [&](const int listener, const bool shared_memory) {
+            if (listener == -1) {
+                return;
+            }
+
+            const int duplicate = shard == m_shards.front() ? listener : fcntl(listener, F_DUPFD_CLOEXEC, 0);
+            if (duplicate == -1) {
+                throw std::system_error(errno, std::system_category(), "Server::start fcntl");
+            }
+            add_acceptor(duplicate, shared_memory);
+        };
+
+        if (options.port != "0") {
+            add_acceptor(listen_on(options.port, options.backlog_size, threads > 1));
+        }
 
-    if (listen(m_socket, backlog_size) != 0) {
-        throw std::system_error(errno, std::system_category(), "Server::start listen");
+        add_local_acceptor(unix_listener, false);
+        add_local_acceptor(shm_listener, true);
     }
 
-    if (exists(dump_path)) {
-        std::ifstream file{dump_path};
-        m_dictionary.load(file);
+    std::vector<std::jthread> reactors{};
+    for (size_t i{1}; i < threads; ++i) {
+        reactors.emplace_back([&shard = *m_shards[i]] { shard.start(); });
     }
 
-    RequestHandler request_handler{m_dictionary};
-    EventLoop event_loop{};
-    auto acceptor = std::make_unique<Acceptor>(m_socket, event_loop, request_handler);
-    event_loop.add_handler(m_socket, EPOLLIN, std::move(acceptor));
-    event_loop.start();
+    m_shards.front()->start();
 }
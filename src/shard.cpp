@@ -0,0 +1,32 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "shard.h"
+
+#include <sys/epoll.h>
+
+Shard::Shard(const size_t index, const std::vector<std::unique_ptr<Shard> > &shards, const EventLoop::Backend backend,
+             const size_t io_threads, const std::chrono::microseconds busy_poll)
+    : m_index{index}, m_shards{shards}, m_event_loop{backend, io_threads, busy_poll} {
+    auto mailbox = std::make_unique<Mailbox>();
+    m_mailbox = mailbox.get();
+    m_event_loop.add_handler(m_mailbox->fd(), EPOLLIN, std::move(mailbox));
+    m_dictionary.observe(&m_tracking);
+}
+
+void Shard::start() {
+    m_event_loop.start();
+}
+
+void Shard::post(Mailbox::Task task) const {
+    m_mailbox->post(std::move(task));
+}
+
+Shard &Shard::owner(const std::string_view key) const {
+    if (m_shards.size() == 1) {
+        return *m_shards.front();
+    }
+
+    return *m_shards[std::hash<std::string_view>{}(key) % m_shards.size()];
+}
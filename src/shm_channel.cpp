@@ -0,0 +1,310 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "shm_channel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <poll.h>
+#include <system_error>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace {
+    constexpr size_t page_size{4096};
+    constexpr uint32_t magic{0x52445348}; // "RDSH"
+
+    // what the server sends along with the descriptors
+    struct Offer {
+        uint32_t magic;
+        uint32_t reserved;
+        uint64_t capacity;
+    };
+
+    size_t round_to_pages(const size_t size) {
+        return (size + page_size - 1) / page_size * page_size;
+    }
+
+    // maps the ring at offset twice, back to back, so a span running off the end carries on at the start
+    char *map_mirrored(const int memory, const off_t offset, const size_t capacity) {
+        void *area = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (area == MAP_FAILED) {
+            throw std::system_error(errno, std::system_category(), "ShmChannel mmap");
+        }
+
+        char *base = static_cast<char *>(area);
+        for (char *half: {base, base + capacity}) {
+            if (mmap(half, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memory, offset) == MAP_FAILED) {
+                const int error = errno;
+                munmap(base, 2 * capacity);
+                throw std::system_error(error, std::system_category(), "ShmChannel mmap");
+            }
+        }
+
+        return base;
+    }
+
+    // how much a ring holds. the indices live where the client can write to them, so a client that is not following
+    // the protocol can have them say anything, and they are only trusted once they make sense
+    size_t held(const uint64_t head, const uint64_t tail, const size_t capacity) {
+        if (tail - head > capacity) {
+            throw std::system_error(EPROTO, std::system_category(), "ShmChannel ring indices out of range");
+        }
+        return static_cast<size_t>(tail - head);
+    }
+}
+
+// the head is only ever written by the consumer and the tail by the producer, each on its own cache line. the waiting
+// flags are raised by whoever is about to wait and taken by the other end, which then rings. raising a flag and then
+// checking the ring once more, against moving the ring and then checking the flag, is what keeps a wakeup from being
+// lost, which is why those accesses are sequentially consistent
+struct ShmChannel::Ring {
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    // a reader starts out waiting for whatever comes first
+    alignas(64) std::atomic<uint32_t> reader_waiting{1};
+    std::atomic<uint32_t> writer_waiting{0};
+};
+
+struct ShmChannel::Header {
+    Ring requests{};
+    Ring replies{};
+};
+
+std::unique_ptr<ShmChannel> ShmChannel::create(const size_t capacity) {
+    const size_t ring_capacity = round_to_pages(std::max(capacity, page_size));
+
+    const int memory = memfd_create("redish-channel", MFD_CLOEXEC);
+    if (memory == -1) {
+        throw std::system_error(errno, std::system_category(), "ShmChannel::create memfd_create");
+    }
+
+    if (ftruncate(memory, static_cast<off_t>(page_size + 2 * ring_capacity)) == -1) {
+        const int error = errno;
+        close(memory);
+        throw std::system_error(error, std::system_category(), "ShmChannel::create ftruncate");
+    }
+
+    const int server_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    const int client_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server_event == -1 || client_event == -1) {
+        const int error = errno;
+        close(memory);
+        close(server_event);
+        close(client_event);
+        throw std::system_error(error, std::system_category(), "ShmChannel::create eventfd");
+    }
+
+    std::unique_ptr<ShmChannel> channel{new ShmChannel{memory, server_event, client_event, ring_capacity}};
+    channel->map(true);
+    return channel;
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::take(const int socket) {
+    Offer offer{};
+    iovec data{&offer, sizeof(offer)};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))]{};
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received{};
+    do {
+        received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    } while (received == -1 && errno == EINTR);
+
+    if (received == -1) {
+        throw std::system_error(errno, std::system_category(), "ShmChannel::take recvmsg");
+    }
+
+    int fds[3]{-1, -1, -1};
+    const cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header != nullptr && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS &&
+        header->cmsg_len == CMSG_LEN(sizeof(fds))) {
+        memcpy(fds, CMSG_DATA(header), sizeof(fds));
+    }
+
+    // the server rings the client through the second eventfd, and is rung through the first. the channel owns the
+    // descriptors from here on, whatever else is wrong with the offer
+    std::unique_ptr<ShmChannel> channel{new ShmChannel{fds[0], fds[2], fds[1], offer.capacity}};
+    if (received != sizeof(offer) || offer.magic != magic || fds[0] == -1 || offer.capacity == 0 ||
+        offer.capacity % page_size != 0) {
+        throw std::system_error(EPROTO, std::system_category(), "ShmChannel::take unexpected offer");
+    }
+
+    channel->map(false);
+    return channel;
+}
+
+ShmChannel::~ShmChannel() {
+    for (char *ring: {m_requests, m_replies}) {
+        if (ring != nullptr) {
+            munmap(ring, 2 * m_capacity);
+        }
+    }
+
+    if (m_header != nullptr) {
+        munmap(m_header, page_size);
+    }
+
+    close(m_memory);
+    close(m_own_event);
+    close(m_peer_event);
+}
+
+void ShmChannel::offer(const int socket) const {
+    Offer offer{magic, 0, m_capacity};
+    iovec data{&offer, sizeof(offer)};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))]{};
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    const int fds[3]{m_memory, m_own_event, m_peer_event};
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    // a freshly accepted socket has all of its buffer free, so this goes out in one piece or not at all
+    if (sendmsg(socket, &message, MSG_NOSIGNAL) != sizeof(offer)) {
+        throw std::system_error(errno, std::system_category(), "ShmChannel::offer sendmsg");
+    }
+}
+
+void ShmChannel::map(const bool server) {
+    static_assert(sizeof(Header) <= page_size);
+
+    // mapping more than there is would only fail once touched
+    struct stat status{};
+    if (fstat(m_memory, &status) == -1) {
+        throw std::system_error(errno, std::system_category(), "ShmChannel fstat");
+    }
+    if (static_cast<size_t>(status.st_size) < page_size + 2 * m_capacity) {
+        throw std::system_error(EPROTO, std::system_category(), "ShmChannel shared memory too small");
+    }
+
+    void *header = mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_memory, 0);
+    if (header == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "ShmChannel mmap");
+    }
+
+    // the server lays the header out; the client finds it already there
+    m_header = server ? new(header) Header{} : static_cast<Header *>(header);
+    m_requests = map_mirrored(m_memory, page_size, m_capacity);
+    m_replies = map_mirrored(m_memory, static_cast<off_t>(page_size + m_capacity), m_capacity);
+
+    m_in = server ? &m_header->requests : &m_header->replies;
+    m_out = server ? &m_header->replies : &m_header->requests;
+    m_in_data = server ? m_requests : m_replies;
+    m_out_data = server ? m_replies : m_requests;
+}
+
+std::span<const char> ShmChannel::readable() const {
+    const uint64_t head = m_in->head.load(std::memory_order_relaxed);
+    const uint64_t tail = m_in->tail.load(std::memory_order_acquire);
+    return {m_in_data + head % m_capacity, held(head, tail, m_capacity)};
+}
+
+void ShmChannel::consume(const size_t bytes) {
+    m_in->head.store(m_in->head.load(std::memory_order_relaxed) + bytes, std::memory_order_seq_cst);
+
+    if (m_in->writer_waiting.load(std::memory_order_seq_cst) != 0 &&
+        m_in->writer_waiting.exchange(0, std::memory_order_seq_cst) != 0) {
+        ring_peer();
+    }
+}
+
+bool ShmChannel::expect_data() {
+    m_in->reader_waiting.store(1, std::memory_order_seq_cst);
+    return m_in->tail.load(std::memory_order_seq_cst) == m_in->head.load(std::memory_order_relaxed);
+}
+
+size_t ShmChannel::write(const std::span<const iovec> data) {
+    const uint64_t tail = m_out->tail.load(std::memory_order_relaxed);
+    size_t room = m_capacity - held(m_out->head.load(std::memory_order_acquire), tail, m_capacity);
+
+    if (room == 0) {
+        m_out->writer_waiting.store(1, std::memory_order_seq_cst);
+        room = m_capacity - held(m_out->head.load(std::memory_order_seq_cst), tail, m_capacity);
+        if (room == 0) {
+            return 0;
+        }
+    }
+
+    char *out = m_out_data + tail % m_capacity;
+    size_t written{0};
+    for (const iovec &segment: data) {
+        const size_t length = std::min(segment.iov_len, room - written);
+        memcpy(out + written, segment.iov_base, length);
+        written += length;
+        if (written == room) {
+            break;
+        }
+    }
+
+    m_out->tail.store(tail + written, std::memory_order_seq_cst);
+
+    if (m_out->reader_waiting.load(std::memory_order_seq_cst) != 0 &&
+        m_out->reader_waiting.exchange(0, std::memory_order_seq_cst) != 0) {
+        ring_peer();
+    }
+
+    return written;
+}
+
+size_t ShmChannel::write(const std::span<const char> data) {
+    const iovec segment{const_cast<char *>(data.data()), data.size()};
+    return write(std::span{&segment, 1});
+}
+
+void ShmChannel::answer_doorbell() const {
+    uint64_t count{};
+    if (read(m_own_event, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        throw std::system_error(errno, std::system_category(), "ShmChannel::answer_doorbell read");
+    }
+}
+
+void ShmChannel::ring_doorbell() const {
+    constexpr uint64_t one{1};
+    if (::write(m_own_event, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        throw std::system_error(errno, std::system_category(), "ShmChannel::ring_doorbell write");
+    }
+}
+
+void ShmChannel::wait() const {
+    pollfd doorbell{m_own_event, POLLIN, 0};
+    while (poll(&doorbell, 1, -1) == -1) {
+        if (errno != EINTR) {
+            throw std::system_error(errno, std::system_category(), "ShmChannel::wait poll");
+        }
+    }
+
+    answer_doorbell();
+}
+
+size_t ShmChannel::memory_size() const {
+    return page_size + 2 * m_capacity;
+}
+
+void ShmChannel::ring_peer() const {
+    constexpr uint64_t one{1};
+    if (::write(m_peer_event, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        throw std::system_error(errno, std::system_category(), "ShmChannel::ring_peer write");
+    }
+}
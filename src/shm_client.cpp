@@ -0,0 +1,116 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "shm_client.h"
+
+#include <cstring>
+#include <format>
+#include <system_error>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+ShmClient::ShmClient(const std::filesystem::path &socket, const std::chrono::nanoseconds spin): m_spin{spin} {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket.native().size() >= sizeof(address.sun_path)) {
+        throw std::system_error(ENAMETOOLONG, std::system_category(), "ShmClient::ShmClient socket path");
+    }
+    socket.native().copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+    m_socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_socket == -1) {
+        throw std::system_error(errno, std::system_category(), "ShmClient::ShmClient socket");
+    }
+
+    // the socket stays open for as long as the client is around; closing it is how the server learns it has gone
+    try {
+        if (connect(m_socket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+            throw std::system_error(errno, std::system_category(), "ShmClient::ShmClient connect");
+        }
+        m_channel = ShmChannel::take(m_socket);
+    } catch (...) {
+        close(m_socket);
+        throw;
+    }
+}
+
+ShmClient::~ShmClient() {
+    m_channel.reset();
+    close(m_socket);
+}
+
+void ShmClient::send(const std::initializer_list<std::string_view> command) {
+    send(std::span{command.begin(), command.size()});
+}
+
+void ShmClient::send(const std::vector<std::string_view> &command) {
+    send(std::span{command});
+}
+
+void ShmClient::send(const std::span<const std::string_view> command) {
+    std::format_to(std::back_inserter(m_requests), "*{}\r\n", command.size());
+    for (const std::string_view argument: command) {
+        std::format_to(std::back_inserter(m_requests), "${}\r\n{}\r\n", argument.size(), argument);
+    }
+
+    if (m_requests.size() >= flush_threshold) {
+        flush();
+    }
+}
+
+void ShmClient::flush() {
+    std::span<const char> requests{m_requests};
+    while (!requests.empty()) {
+        const size_t written = m_channel->write(requests);
+        if (written == 0) {
+            // the server is behind on reading; its replies may be what it is stuck on, so make room for them
+            if (!take_replies()) {
+                m_channel->wait();
+            }
+            continue;
+        }
+        requests = requests.subspan(written);
+    }
+
+    m_requests.clear();
+}
+
+resp::Value ShmClient::receive() {
+    flush();
+
+    const auto spin_until = std::chrono::steady_clock::now() + m_spin;
+
+    while (m_replies.empty()) {
+        if (take_replies()) {
+            continue;
+        }
+
+        if (m_spin > std::chrono::nanoseconds::zero() && std::chrono::steady_clock::now() < spin_until) {
+            continue;
+        }
+
+        if (m_channel->expect_data()) {
+            m_channel->wait();
+        }
+    }
+
+    resp::Value reply = std::move(m_replies.front());
+    m_replies.pop_front();
+    return reply;
+}
+
+bool ShmClient::take_replies() {
+    const std::span<const char> data = m_channel->readable();
+    if (data.empty()) {
+        return false;
+    }
+
+    m_parser.feed(data);
+    m_channel->consume(data.size());
+    for (resp::Value &value: m_parser.take_values()) {
+        m_replies.push_back(std::move(value));
+    }
+    return true;
+}
@@ -0,0 +1,146 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(const Clock::duration tick, const Clock::time_point now): m_tick{tick}, m_start{now} {
+}
+
+TimerWheel::Id TimerWheel::schedule(const Clock::duration delay, Callback callback) {
+    return add(ticks(delay), 0, std::move(callback));
+}
+
+TimerWheel::Id TimerWheel::schedule_every(const Clock::duration period, Callback callback) {
+    const uint64_t period_ticks{std::max<uint64_t>(ticks(period), 1)};
+    return add(period_ticks, period_ticks, std::move(callback));
+}
+
+void TimerWheel::cancel(const Id id) {
+    m_timers.erase(id);
+}
+
+void TimerWheel::advance(const Clock::time_point now) {
+    if (now < m_start) {
+        return;
+    }
+
+    const auto target = static_cast<uint64_t>((now - m_start) / m_tick);
+
+    // nothing to run, so there is no need to step through the ticks one by one
+    if (m_timers.empty()) {
+        m_current = std::max(m_current, target);
+        return;
+    }
+
+    while (m_current < target) {
+        ++m_current;
+
+        // at the turn of each level, pull the slot that is coming up next on the level above down into it
+        for (unsigned level{1}; level < levels && (m_current >> slot_bits * (level - 1) & slot_mask) == 0; ++level) {
+            cascade(level);
+        }
+
+        run(m_current);
+    }
+}
+
+std::optional<TimerWheel::Clock::duration> TimerWheel::until_next(const Clock::time_point now) const {
+    if (m_timers.empty()) {
+        return std::nullopt;
+    }
+
+    // the innermost level covers the next few dozen ticks; beyond its next turn there has to be a cascade anyway, so
+    // that is as far as we need to look
+    uint64_t tick{m_current + 1};
+    while ((tick & slot_mask) != 0 && m_wheel[0][tick & slot_mask].empty()) {
+        ++tick;
+    }
+
+    const auto deadline = m_start + m_tick * static_cast<Clock::rep>(tick);
+    return std::max(deadline - now, Clock::duration::zero());
+}
+
+uint64_t TimerWheel::ticks(const Clock::duration duration) const {
+    // round up, so that a timer never fires early
+    if (duration <= Clock::duration::zero()) {
+        return 0;
+    }
+
+    return static_cast<uint64_t>((duration + m_tick - Clock::duration{1}) / m_tick);
+}
+
+TimerWheel::Id TimerWheel::add(const uint64_t delay, const uint64_t period, Callback callback) {
+    const Id id{m_next_id++};
+    // the current tick has already run, so the soonest a timer can fire is the next one
+    const uint64_t expires{m_current + std::max<uint64_t>(delay, 1)};
+    m_timers.emplace(id, Timer{expires, period, std::move(callback)});
+    place(id, expires);
+    return id;
+}
+
+void TimerWheel::place(const Id id, const uint64_t expires) {
+    const uint64_t delta{expires - m_current};
+
+    unsigned level{0};
+    while (level + 1 < levels && delta >= uint64_t{1} << slot_bits * (level + 1)) {
+        ++level;
+    }
+
+    // further out than the wheel reaches: park it in the outermost slot it can get to, and place it again from there
+    const uint64_t reach{(uint64_t{1} << slot_bits * levels) - 1};
+    const uint64_t slot{std::min(expires, m_current + reach) >> slot_bits * level & slot_mask};
+    m_wheel[level][slot].push_back(id);
+}
+
+void TimerWheel::cascade(const unsigned level) {
+    auto &slot = m_wheel[level][m_current >> slot_bits * level & slot_mask];
+    std::vector<Id> ids{};
+    std::swap(ids, slot);
+
+    for (const Id id: ids) {
+        if (const auto timer = m_timers.find(id); timer != m_timers.end()) {
+            place(id, timer->second.expires);
+        }
+    }
+}
+
+void TimerWheel::run(const uint64_t tick) {
+    auto &slot = m_wheel[0][tick & slot_mask];
+    std::vector<Id> ids{};
+    std::swap(ids, slot);
+
+    for (const Id id: ids) {
+        auto timer = m_timers.find(id);
+        if (timer == m_timers.end()) {
+            continue;
+        }
+
+        if (timer->second.expires > tick) {
+            // a parked timer that is still too far out
+            place(id, timer->second.expires);
+            continue;
+        }
+
+        // the callback is free to schedule and cancel timers, itself included, so it is moved out of the map first
+        Callback callback{std::move(timer->second.callback)};
+        const uint64_t period{timer->second.period};
+
+        if (period == 0) {
+            m_timers.erase(timer);
+            callback();
+            continue;
+        }
+
+        timer->second.expires = tick + period;
+        place(id, tick + period);
+        callback();
+
+        // put the callback back, unless the timer was cancelled while it ran
+        if (timer = m_timers.find(id); timer != m_timers.end()) {
+            timer->second.callback = std::move(callback);
+        }
+    }
+}
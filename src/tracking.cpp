@@ -0,0 +1,110 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "tracking.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "connection.h"
+#include "shard.h"
+
+void Tracking::remember(const std::string_view key, const Subscriber &subscriber) {
+    auto entry = m_keys.find(key);
+    if (entry == m_keys.end()) {
+        if (m_keys.size() >= max_keys) {
+            const auto evicted = m_keys.begin();
+            for (const auto &[token, other]: evicted->second) {
+                notify(other, evicted->first);
+            }
+            m_keys.erase(evicted);
+        }
+        entry = m_keys.emplace(std::string{key}, Subscribers{}).first;
+    }
+
+    entry->second.insert_or_assign(subscriber.connection.get(), subscriber);
+}
+
+void Tracking::subscribe(const std::string_view prefix, const Subscriber &subscriber) {
+    auto entry = m_prefixes.find(prefix);
+    if (entry == m_prefixes.end()) {
+        entry = m_prefixes.emplace(std::string{prefix}, Subscribers{}).first;
+    }
+
+    entry->second.insert_or_assign(subscriber.connection.get(), subscriber);
+}
+
+void Tracking::unsubscribe(Connection **connection) {
+    for (auto entry = m_prefixes.begin(); entry != m_prefixes.end();) {
+        entry->second.erase(connection);
+        entry = entry->second.empty() ? m_prefixes.erase(entry) : std::next(entry);
+    }
+}
+
+void Tracking::modified(const std::string_view key) {
+    // nearly always, nobody is listening
+    if (m_keys.empty() && m_prefixes.empty()) {
+        return;
+    }
+
+    if (const auto entry = m_keys.find(key); entry != m_keys.end()) {
+        const Subscribers subscribers = std::move(entry->second);
+        m_keys.erase(entry);
+        for (const auto &[token, subscriber]: subscribers) {
+            notify(subscriber, key);
+        }
+    }
+
+    // a client whose prefixes overlap still hears about the key once
+    std::vector<Connection **> told{};
+    for (const auto &[prefix, subscribers]: m_prefixes) {
+        if (!key.starts_with(prefix)) {
+            continue;
+        }
+
+        for (const auto &[token, subscriber]: subscribers) {
+            if (std::ranges::find(told, token) == told.end()) {
+                told.push_back(token);
+                notify(subscriber, key);
+            }
+        }
+    }
+}
+
+void Tracking::flushed() {
+    for (const auto &[key, subscribers]: m_keys) {
+        for (const auto &[token, subscriber]: subscribers) {
+            notify(subscriber, std::nullopt);
+        }
+    }
+    m_keys.clear();
+
+    for (const auto &[prefix, subscribers]: m_prefixes) {
+        for (const auto &[token, subscriber]: subscribers) {
+            notify(subscriber, std::nullopt);
+        }
+    }
+}
+
+void Tracking::notify(const Subscriber &subscriber, const std::optional<std::string_view> key) {
+    if (subscriber.home == nullptr) {
+        if (Connection *connection = *subscriber.connection) {
+            connection->invalidate(key);
+        }
+        return;
+    }
+
+    std::optional<std::string> owned{key};
+    subscriber.home->post([this, shard = m_shard, token = subscriber.connection, key = std::move(owned)] {
+        if (Connection *connection = *token) {
+            connection->invalidate(key);
+            return;
+        }
+
+        // the client has gone, so its prefixes can go too, on the thread they belong to
+        if (shard != nullptr) {
+            shard->post([this, token] { unsubscribe(token.get()); });
+        }
+    });
+}
@@ -0,0 +1,207 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "uring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace {
+    int io_uring_setup(const unsigned entries, io_uring_params &params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+
+    int io_uring_enter(const int fd, const unsigned to_submit, const unsigned min_complete, const unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int io_uring_register(const int fd, const unsigned opcode, void *arg, const unsigned nr_args) {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    template<typename T>
+    T *at_offset(void *base, const size_t offset) {
+        return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+    }
+}
+
+Uring::Uring(const unsigned entries) {
+    io_uring_params params{};
+    // completions are only reaped when we ask for them, so the kernel need not interrupt us to post them. the ring is
+    // set up on one thread and driven from another, which rules out IORING_SETUP_SINGLE_ISSUER
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    m_fd = io_uring_setup(entries, params);
+
+    if (m_fd == -1 && errno == EINVAL) {
+        // older kernel without the optional setup flags
+        params = io_uring_params{};
+        m_fd = io_uring_setup(entries, params);
+    }
+
+    if (m_fd == -1) {
+        throw std::system_error(errno, std::system_category(), "Uring::Uring io_uring_setup");
+    }
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(m_fd);
+        throw std::system_error(ENOSYS, std::system_category(), "Uring::Uring kernel too old");
+    }
+
+    m_ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                           params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    m_ring = mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_ring == MAP_FAILED) {
+        close(m_fd);
+        throw std::system_error(errno, std::system_category(), "Uring::Uring mmap");
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        munmap(m_ring, m_ring_size);
+        close(m_fd);
+        throw std::system_error(errno, std::system_category(), "Uring::Uring mmap");
+    }
+    m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+    m_sq_head = at_offset<unsigned>(m_ring, params.sq_off.head);
+    m_sq_tail = at_offset<unsigned>(m_ring, params.sq_off.tail);
+    m_sq_array = at_offset<unsigned>(m_ring, params.sq_off.array);
+    m_sq_mask = *at_offset<unsigned>(m_ring, params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sq_local_tail = *m_sq_tail;
+
+    m_cq_head = at_offset<unsigned>(m_ring, params.cq_off.head);
+    m_cq_tail = at_offset<unsigned>(m_ring, params.cq_off.tail);
+    m_cq_mask = *at_offset<unsigned>(m_ring, params.cq_off.ring_mask);
+    m_cqes = at_offset<io_uring_cqe>(m_ring, params.cq_off.cqes);
+
+    // submission slots always map onto the entry of the same index
+    for (unsigned i{0}; i < m_sq_entries; ++i) {
+        m_sq_array[i] = i;
+    }
+}
+
+Uring::~Uring() {
+    if (m_buffer_ring != nullptr) {
+        munmap(m_buffer_ring, m_buffer_ring_size);
+    }
+    munmap(m_sqes, m_sqes_size);
+    munmap(m_ring, m_ring_size);
+    close(m_fd);
+}
+
+io_uring_sqe &Uring::prepare() {
+    if (m_sq_local_tail - std::atomic_ref{*m_sq_head}.load(std::memory_order_acquire) >= m_sq_entries) {
+        submit();
+    }
+
+    io_uring_sqe &sqe = m_sqes[m_sq_local_tail & m_sq_mask];
+    memset(&sqe, 0, sizeof(sqe));
+    ++m_sq_local_tail;
+    return sqe;
+}
+
+void Uring::submit(const unsigned wait_for) {
+    std::atomic_ref{*m_sq_tail}.store(m_sq_local_tail, std::memory_order_release);
+
+    while (true) {
+        const unsigned to_submit{m_sq_local_tail - std::atomic_ref{*m_sq_head}.load(std::memory_order_acquire)};
+        if (to_submit == 0 && wait_for == 0) {
+            return;
+        }
+
+        if (io_uring_enter(m_fd, to_submit, wait_for, wait_for > 0 ? IORING_ENTER_GETEVENTS : 0) >= 0) {
+            return;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        // the completion queue is backed up; reaping it is the caller's next step anyway
+        if (errno == EBUSY || errno == EAGAIN) {
+            return;
+        }
+
+        throw std::system_error(errno, std::system_category(), "Uring::submit io_uring_enter");
+    }
+}
+
+bool Uring::poll() {
+    std::atomic_ref{*m_sq_tail}.store(m_sq_local_tail, std::memory_order_release);
+
+    const unsigned to_submit{m_sq_local_tail - std::atomic_ref{*m_sq_head}.load(std::memory_order_acquire)};
+    const auto ready = [this] {
+        return *m_cq_head != std::atomic_ref{*m_cq_tail}.load(std::memory_order_acquire);
+    };
+
+    if (to_submit == 0 && ready()) {
+        return true;
+    }
+
+    // entering the kernel also runs the task work that completions may be waiting on, with IORING_SETUP_COOP_TASKRUN
+    if (io_uring_enter(m_fd, to_submit, 0, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR && errno != EBUSY &&
+        errno != EAGAIN) {
+        throw std::system_error(errno, std::system_category(), "Uring::poll io_uring_enter");
+    }
+
+    return ready();
+}
+
+void Uring::timeout(const std::chrono::nanoseconds after, const uint64_t user_data) {
+    m_timeout.tv_sec = after.count() / 1'000'000'000;
+    m_timeout.tv_nsec = after.count() % 1'000'000'000;
+
+    io_uring_sqe &sqe = prepare();
+    sqe.opcode = IORING_OP_TIMEOUT;
+    sqe.addr = reinterpret_cast<uint64_t>(&m_timeout);
+    sqe.len = 1;
+    sqe.user_data = user_data;
+}
+
+void Uring::provide_buffers(const uint16_t group, const unsigned count, const unsigned size) {
+    m_buffer_ring_size = count * sizeof(io_uring_buf);
+    void *ring = mmap(nullptr, m_buffer_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "Uring::provide_buffers mmap");
+    }
+    m_buffer_ring = static_cast<io_uring_buf_ring *>(ring);
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(m_buffer_ring);
+    registration.ring_entries = count;
+    registration.bgid = group;
+    if (io_uring_register(m_fd, IORING_REGISTER_PBUF_RING, &registration, 1) == -1) {
+        throw std::system_error(errno, std::system_category(), "Uring::provide_buffers io_uring_register");
+    }
+
+    m_buffers.resize(static_cast<size_t>(count) * size);
+    m_buffer_size = size;
+    m_buffer_mask = count - 1;
+
+    for (unsigned i{0}; i < count; ++i) {
+        recycle(static_cast<uint16_t>(i));
+    }
+}
+
+std::span<const char> Uring::buffer(const uint16_t id, const size_t length) const {
+    return {m_buffers.data() + static_cast<size_t>(id) * m_buffer_size, length};
+}
+
+void Uring::recycle(const uint16_t id) {
+    // only the address, length and id are written: the reserved field of the first slot doubles as the ring's tail.
+    // the slots are indexed by hand because in C++ the uapi's flexible array member does not start at offset 0
+    io_uring_buf &buffer = reinterpret_cast<io_uring_buf *>(m_buffer_ring)[m_buffer_tail & m_buffer_mask];
+    buffer.addr = reinterpret_cast<uint64_t>(m_buffers.data() + static_cast<size_t>(id) * m_buffer_size);
+    buffer.len = m_buffer_size;
+    buffer.bid = id;
+
+    std::atomic_ref{m_buffer_ring->tail}.store(++m_buffer_tail, std::memory_order_release);
+}
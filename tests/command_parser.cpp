@@ -0,0 +1,260 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "command_parser.h"
+
+#include <gtest/gtest.h>
+
+using namespace resp;
+
+static std::vector<std::string> to_strings(const CommandParser::Arguments arguments) {
+    return {arguments.begin(), arguments.end()};
+}
+
+TEST(CommandParser, DecodesCommand) {
+    const std::string data{"*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n"};
+    CommandParser parser{};
+    parser.feed(data);
+
+    const auto arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ((std::vector<std::string>{"SET", "key", "value"}), to_strings(*arguments));
+    EXPECT_FALSE(parser.next().has_value());
+    EXPECT_FALSE(parser.pending());
+}
+
+TEST(CommandParser, ArgumentsPointIntoFedData) {
+    const std::string data{"*1\r\n$4\r\nPING\r\n"};
+    CommandParser parser{};
+    parser.feed(data);
+
+    const auto arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ(data.data() + 8, (*arguments)[0].data());
+}
+
+TEST(CommandParser, DecodesPipeline) {
+    const std::string data{"*1\r\n$4\r\nPING\r\n*2\r\n$3\r\nGET\r\n$1\r\na\r\n"};
+    CommandParser parser{};
+    parser.feed(data);
+
+    auto arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ(std::vector<std::string>{"PING"}, to_strings(*arguments));
+
+    arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ((std::vector<std::string>{"GET", "a"}), to_strings(*arguments));
+    EXPECT_FALSE(parser.next().has_value());
+}
+
+TEST(CommandParser, RewindsToMark) {
+    const std::string data{"*1\r\n$4\r\nPING\r\n*2\r\n$3\r\nGET\r\n$1\r\na\r\n*1\r\n$4\r\nPING\r\n"};
+    CommandParser parser{};
+    parser.feed(data);
+
+    ASSERT_TRUE(parser.next().has_value());
+    const size_t mark = parser.mark();
+    ASSERT_TRUE(parser.next().has_value());
+    ASSERT_TRUE(parser.next().has_value());
+    EXPECT_FALSE(parser.pending());
+
+    // decoded again, as if they had never been
+    parser.rewind(mark);
+    EXPECT_TRUE(parser.pending());
+    const auto arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ((std::vector<std::string>{"GET", "a"}), to_strings(*arguments));
+}
+
+TEST(CommandParser, RewindForgetsError) {
+    const std::string data{"*1\r\n$4\r\nPING\r\n*1\r\n$x\r\n"};
+    CommandParser parser{};
+    parser.feed(data);
+
+    const size_t mark = parser.mark();
+    ASSERT_TRUE(parser.next().has_value());
+    EXPECT_FALSE(parser.next().has_value());
+    EXPECT_TRUE(parser.error().has_value());
+
+    // the error is found again once decoding gets that far
+    parser.rewind(mark);
+    EXPECT_FALSE(parser.error().has_value());
+    ASSERT_TRUE(parser.next().has_value());
+    EXPECT_FALSE(parser.next().has_value());
+    EXPECT_TRUE(parser.error().has_value());
+}
+
+TEST(CommandParser, KeepsIncompleteCommandAcrossFeeds) {
+    const std::string data{"*2\r\n$3\r\nGET\r\n$5\r\nhello\r\n"};
+    CommandParser parser{};
+
+    // every split point, with the caller's data gone after each feed
+    for (size_t split{1}; split < data.size(); ++split) {
+        std::string first{data.substr(0, split)};
+        parser.feed(first);
+        EXPECT_FALSE(parser.next().has_value()) << split;
+        parser.keep();
+        first.assign(first.size(), 'x');
+
+        std::string second{data.substr(split)};
+        parser.feed(second);
+        const auto arguments = parser.next();
+        ASSERT_TRUE(arguments.has_value()) << split;
+        EXPECT_EQ((std::vector<std::string>{"GET", "hello"}), to_strings(*arguments));
+        parser.keep();
+        EXPECT_FALSE(parser.pending());
+    }
+}
+
+TEST(CommandParser, KeepsUndecodedCommands) {
+    const std::string data{"*1\r\n$4\r\nPING\r\n*1\r\n$4\r\nECHO\r\n"};
+    CommandParser parser{};
+    parser.feed(data);
+    ASSERT_TRUE(parser.next().has_value());
+
+    // a suspended connection stops decoding, and the rest has to outlive the receive buffer
+    parser.keep();
+    EXPECT_TRUE(parser.pending());
+
+    const auto arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ(std::vector<std::string>{"ECHO"}, to_strings(*arguments));
+    EXPECT_NE(data.data() + 22, (*arguments)[0].data());
+}
+
+TEST(CommandParser, BinarySafeArguments) {
+    const std::string data{"*2\r\n$3\r\nGET\r\n$4\r\na\r\nb\r\n", 26};
+    CommandParser parser{};
+    parser.feed(data);
+
+    const auto arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ("a\r\nb", (*arguments)[1]);
+}
+
+TEST(CommandParser, SkipsEmptyAndNullArrays) {
+    const std::string data{"*0\r\n*-1\r\n*1\r\n$4\r\nPING\r\n"};
+    CommandParser parser{};
+    parser.feed(data);
+
+    const auto arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ(std::vector<std::string>{"PING"}, to_strings(*arguments));
+}
+
+TEST(CommandParser, EmptyBulkString) {
+    const std::string data{"*2\r\n$4\r\nECHO\r\n$0\r\n\r\n"};
+    CommandParser parser{};
+    parser.feed(data);
+
+    const auto arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ("", (*arguments)[1]);
+}
+
+TEST(CommandParser, RejectsInlineCommand) {
+    const std::string data{"PING\r\n"};
+    CommandParser parser{};
+    parser.feed(data);
+
+    EXPECT_FALSE(parser.next().has_value());
+    ASSERT_TRUE(parser.error().has_value());
+    EXPECT_EQ("Protocol error: expected '*', got 'P'", *parser.error());
+}
+
+TEST(CommandParser, RejectsBadLengths) {
+    for (const std::string data: {"*x\r\n", "*1\r\n$-1\r\n", "*1\r\n$1x\r\n", "*2000000\r\n", "*1\r\n$999999999999\r\n"}) {
+        CommandParser parser{};
+        parser.feed(data);
+        EXPECT_FALSE(parser.next().has_value()) << data;
+        EXPECT_TRUE(parser.error().has_value()) << data;
+    }
+}
+
+TEST(CommandParser, RejectsEndlessLengthLine) {
+    const std::string start{"*"};
+    const std::string data(64, '1');
+    CommandParser parser{};
+    parser.feed(start);
+    parser.keep();
+    parser.feed(data);
+
+    EXPECT_FALSE(parser.next().has_value());
+    EXPECT_TRUE(parser.error().has_value());
+}
+
+TEST(CommandParser, RejectsMissingCrlfAfterBulkString) {
+    const std::string data{"*1\r\n$4\r\nPINGxx"};
+    CommandParser parser{};
+    parser.feed(data);
+
+    EXPECT_FALSE(parser.next().has_value());
+    ASSERT_TRUE(parser.error().has_value());
+    EXPECT_EQ("Protocol error: expected CRLF after bulk string", *parser.error());
+}
+
+TEST(CommandParser, ReleasesLargeBuffer) {
+    const std::string value(1 << 16, 'v');
+    const std::string data{"*1\r\n$65536\r\n" + value + "\r\n"};
+    CommandParser parser{1024};
+    parser.feed(std::span{data}.first(100));
+    parser.keep();
+    parser.feed(std::span{data}.subspan(100));
+    ASSERT_TRUE(parser.next().has_value());
+    EXPECT_GE(parser.memory_usage(), value.size());
+
+    parser.keep();
+    EXPECT_LT(parser.memory_usage(), value.size());
+}
+
+TEST(CommandParser, ResumesManyArgumentsAcrossFeeds) {
+    std::string data{"*1000\r\n"};
+    for (size_t i{0}; i < 1000; ++i) {
+        const std::string argument = std::to_string(i);
+        data += "$" + std::to_string(argument.size()) + "\r\n" + argument + "\r\n";
+    }
+
+    CommandParser parser{};
+    std::optional<CommandParser::Arguments> arguments{};
+    for (size_t offset{0}; offset < data.size() && !arguments.has_value(); offset += 7) {
+        const std::string chunk{data.substr(offset, 7)};
+        parser.feed(chunk);
+        arguments = parser.next();
+        if (!arguments.has_value()) {
+            parser.keep();
+        }
+    }
+
+    ASSERT_TRUE(arguments.has_value());
+    ASSERT_EQ(1000u, arguments->size());
+    for (size_t i{0}; i < 1000; ++i) {
+        EXPECT_EQ(std::to_string(i), (*arguments)[i]);
+    }
+}
+
+TEST(CommandParser, ReservesAnnouncedArgument) {
+    const std::string value(1 << 20, 'v');
+    const std::string data{"*2\r\n$3\r\nSET\r\n$1048576\r\n" + value + "\r\n"};
+    CommandParser parser{};
+    parser.feed(std::span{data}.first(4096));
+    EXPECT_FALSE(parser.next().has_value());
+    parser.keep();
+
+    // room for the whole command straight away, so the rest goes in without the buffer growing again
+    const size_t reserved = parser.memory_usage();
+    EXPECT_GE(reserved, data.size());
+    for (size_t offset{4096}; offset < data.size(); offset += 4096) {
+        parser.feed(std::span{data}.subspan(offset, std::min<size_t>(4096, data.size() - offset)));
+        if (offset + 4096 < data.size()) {
+            EXPECT_FALSE(parser.next().has_value());
+            parser.keep();
+            EXPECT_EQ(reserved, parser.memory_usage());
+        }
+    }
+
+    const auto arguments = parser.next();
+    ASSERT_TRUE(arguments.has_value());
+    EXPECT_EQ(value, (*arguments)[1]);
+}
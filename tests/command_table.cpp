@@ -0,0 +1,91 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "command_table.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using commands::Command;
+using commands::Spec;
+using commands::Table;
+
+namespace {
+    // the handler is only carried along, so any type does
+    constexpr Table table{
+        std::to_array<Command<int> >({
+            {{"get", 2, commands::read, 1, 1, 1}, 1},
+            {{"set", -3, commands::write, 1, 1, 1}, 2},
+            {{"del", -2, commands::write, 1, -1, 1}, 3},
+            {{"mset", -3, commands::write, 1, -1, 2}, 4},
+            {{"ping", -1, 0, 0, 0, 0}, 5},
+            {{"flushdb", -1, commands::write | commands::admin, 0, 0, 0}, 6},
+            {{"fcall", -3, 0, 0, 0, 0, 2}, 7},
+        })
+    };
+
+    std::vector<std::string> keys(const Spec &spec, const std::vector<std::string_view> &arguments) {
+        std::vector<std::string> keys{};
+        spec.for_each_key(arguments, [&keys](const std::string_view key) { keys.emplace_back(key); });
+        return keys;
+    }
+}
+
+TEST(CommandTable, FindsEveryCommand) {
+    for (const auto &command: table.all()) {
+        ASSERT_EQ(&command, table.find(command.name)) << command.name;
+    }
+    static_assert(table.find("get")->handler == 1);
+}
+
+TEST(CommandTable, IgnoresCase) {
+    EXPECT_EQ(2, table.find("SET")->handler);
+    EXPECT_EQ(6, table.find("FlushDB")->handler);
+}
+
+TEST(CommandTable, RejectsUnknownNames) {
+    EXPECT_EQ(nullptr, table.find(""));
+    EXPECT_EQ(nullptr, table.find("gets"));
+    EXPECT_EQ(nullptr, table.find("ge"));
+    EXPECT_EQ(nullptr, table.find("lpush"));
+    // the same letters folded, but not letters to begin with
+    EXPECT_EQ(nullptr, table.find("G\xc5T"));
+    EXPECT_EQ(nullptr, table.find(std::string_view{"get\0", 4}));
+}
+
+TEST(CommandTable, ChecksArity) {
+    const Spec &get = *table.find("get");
+    EXPECT_FALSE(get.accepts(1));
+    EXPECT_TRUE(get.accepts(2));
+    EXPECT_FALSE(get.accepts(3));
+
+    const Spec &set = *table.find("set");
+    EXPECT_FALSE(set.accepts(2));
+    EXPECT_TRUE(set.accepts(3));
+    EXPECT_TRUE(set.accepts(5));
+}
+
+TEST(CommandTable, FindsKeys) {
+    EXPECT_EQ(std::vector<std::string>{"key"}, keys(*table.find("set"), {"set", "key", "value", "NX"}));
+    EXPECT_EQ((std::vector<std::string>{"a", "b", "c"}), keys(*table.find("del"), {"del", "a", "b", "c"}));
+    EXPECT_EQ((std::vector<std::string>{"a", "b"}), keys(*table.find("mset"), {"mset", "a", "1", "b", "2"}));
+    EXPECT_TRUE(keys(*table.find("ping"), {"ping", "hello"}).empty());
+}
+
+TEST(CommandTable, FindsCountedKeys) {
+    const Spec &fcall = *table.find("fcall");
+    EXPECT_EQ((std::vector<std::string>{"a", "b"}), keys(fcall, {"fcall", "f", "2", "a", "b", "argument"}));
+    EXPECT_TRUE(keys(fcall, {"fcall", "f", "0", "argument"}).empty());
+    // a count that is not one, or more keys than there are arguments, is for the command to reply to
+    EXPECT_TRUE(keys(fcall, {"fcall", "f", "-1", "a"}).empty());
+    EXPECT_EQ(std::vector<std::string>{"a"}, keys(fcall, {"fcall", "f", "5", "a"}));
+}
+
+TEST(CommandTable, HasFlags) {
+    const Spec &flushdb = *table.find("flushdb");
+    EXPECT_TRUE(flushdb.has(commands::write));
+    EXPECT_TRUE(flushdb.has(commands::admin));
+    EXPECT_FALSE(flushdb.has(commands::read));
+}
@@ -0,0 +1,71 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "connection_pool.h"
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+
+#include "dictionary.h"
+
+namespace {
+    struct Fixture {
+        ConnectionPool pool{};
+        EventLoop event_loop{};
+        Dictionary dictionary{};
+        script::Library library{};
+        RequestHandler request_handler{dictionary, library};
+
+        // a connection on one end of a fresh socket pair, whose other end is closed straight away
+        std::unique_ptr<Connection> connect() {
+            int sockets[2];
+            socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+            close(sockets[1]);
+            return pool.acquire(sockets[0], request_handler, event_loop, {});
+        }
+    };
+}
+
+TEST(ConnectionPool, ReusesStorageAndToken) {
+    Fixture fixture{};
+
+    auto connection = fixture.connect();
+    const Connection *first = connection.get();
+    const Connection *const *token = connection->self().get();
+    connection.reset();
+    EXPECT_EQ(1u, fixture.pool.size());
+
+    connection = fixture.connect();
+    EXPECT_EQ(first, connection.get());
+    EXPECT_EQ(token, connection->self().get());
+    EXPECT_EQ(connection.get(), *connection->self());
+    EXPECT_EQ(0u, fixture.pool.size());
+}
+
+TEST(ConnectionPool, KeepsTokensOthersStillHold) {
+    Fixture fixture{};
+
+    auto connection = fixture.connect();
+    const std::shared_ptr<Connection *> held = connection->self();
+    connection.reset();
+    EXPECT_EQ(nullptr, *held);
+
+    // whoever still holds the old token must go on seeing the connection as gone
+    connection = fixture.connect();
+    EXPECT_NE(held, connection->self());
+    EXPECT_EQ(nullptr, *held);
+}
+
+TEST(ConnectionPool, CountsClients) {
+    Fixture fixture{};
+
+    auto first = fixture.connect();
+    auto second = fixture.connect();
+    EXPECT_EQ(2u, fixture.event_loop.stats().connected_clients);
+
+    first.reset();
+    second.reset();
+    EXPECT_EQ(0u, fixture.event_loop.stats().connected_clients);
+    EXPECT_EQ(2u, fixture.pool.size());
+}
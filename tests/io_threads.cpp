@@ -0,0 +1,61 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "io_threads.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST(IoThreads, RunsEveryItemOnce) {
+    IoThreads threads{4};
+    std::vector<std::atomic<int> > runs(1000);
+
+    threads.run(runs.size(), [&runs](const size_t item, size_t) { runs[item].fetch_add(1); });
+
+    for (const auto &count: runs) {
+        EXPECT_EQ(1, count.load());
+    }
+}
+
+TEST(IoThreads, SpreadsBatchAcrossThreads) {
+    IoThreads threads{4};
+    std::vector<size_t> ran_on(64);
+
+    // every item waits for the others to have been picked up, which they only can be by the other threads
+    std::atomic<size_t> started{0};
+    threads.run(ran_on.size(), [&](const size_t item, const size_t thread) {
+        ran_on[item] = thread;
+        if (started.fetch_add(1) < threads.size()) {
+            while (started.load() < threads.size()) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    const std::set<size_t> used(ran_on.begin(), ran_on.end());
+    EXPECT_EQ(threads.size(), used.size());
+}
+
+TEST(IoThreads, RunsSmallBatchOnCaller) {
+    IoThreads threads{4};
+    std::vector<size_t> ran_on(3, 99);
+
+    threads.run(ran_on.size(), [&ran_on](const size_t item, const size_t thread) { ran_on[item] = thread; });
+
+    EXPECT_EQ(std::vector<size_t>(3, 0), ran_on);
+}
+
+TEST(IoThreads, RunsManyBatches) {
+    IoThreads threads{3};
+    std::vector<int> counts(16);
+
+    for (int batch{0}; batch < 1000; ++batch) {
+        threads.run(counts.size(), [&counts](const size_t item, size_t) { ++counts[item]; });
+    }
+
+    EXPECT_EQ(std::vector<int>(16, 1000), counts);
+}
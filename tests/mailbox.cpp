@@ -0,0 +1,91 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "mailbox.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+
+TEST(Mailbox, RunsPostedTask) {
+    Mailbox mailbox{};
+    bool ran{false};
+
+    mailbox.post([&ran] { ran = true; });
+    EXPECT_FALSE(ran);
+
+    mailbox.handle(EPOLLIN);
+    EXPECT_TRUE(ran);
+}
+
+TEST(Mailbox, IgnoresOtherEvents) {
+    Mailbox mailbox{};
+    bool ran{false};
+
+    mailbox.post([&ran] { ran = true; });
+    mailbox.handle(EPOLLOUT);
+    EXPECT_FALSE(ran);
+}
+
+TEST(Mailbox, PreservesPostOrder) {
+    Mailbox mailbox{};
+    std::vector<int> order{};
+
+    for (int i{0}; i < 100; ++i) {
+        mailbox.post([&order, i] { order.push_back(i); });
+    }
+    mailbox.handle(EPOLLIN);
+
+    ASSERT_EQ(100u, order.size());
+    for (int i{0}; i < 100; ++i) {
+        EXPECT_EQ(i, order[i]);
+    }
+}
+
+TEST(Mailbox, TaskCanPostToItsOwnMailbox) {
+    Mailbox mailbox{};
+    int runs{0};
+
+    mailbox.post([&] {
+        ++runs;
+        mailbox.post([&runs] { ++runs; });
+    });
+
+    mailbox.handle(EPOLLIN);
+    EXPECT_EQ(1, runs);
+    mailbox.handle(EPOLLIN);
+    EXPECT_EQ(2, runs);
+}
+
+TEST(Mailbox, ConcurrentProducers) {
+    constexpr int producers{4};
+    constexpr int tasks_per_producer{10000};
+
+    Mailbox mailbox{};
+    // only touched by the consumer, so no synchronization is needed
+    int total{0};
+    std::vector<int> last(producers, -1);
+    bool ordered{true};
+
+    std::vector<std::jthread> threads{};
+    for (int p{0}; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            for (int i{0}; i < tasks_per_producer; ++i) {
+                mailbox.post([&, p, i] {
+                    ordered = ordered && last[p] == i - 1;
+                    last[p] = i;
+                    ++total;
+                });
+            }
+        });
+    }
+
+    while (total < producers * tasks_per_producer) {
+        mailbox.handle(EPOLLIN);
+    }
+
+    EXPECT_EQ(producers * tasks_per_producer, total);
+    EXPECT_TRUE(ordered);
+}
@@ -0,0 +1,173 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "output_buffer.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace resp;
+
+namespace {
+    // what a socket would receive if every send took at most chunk bytes
+    std::string drain(OutputBuffer &buffer, const size_t chunk) {
+        std::string received{};
+        while (!buffer.empty()) {
+            iovec iovecs[4];
+            const size_t count = buffer.gather(iovecs);
+
+            size_t sent{0};
+            for (size_t i{0}; i < count && sent < chunk; ++i) {
+                const size_t length{std::min(iovecs[i].iov_len, chunk - sent)};
+                received.append(static_cast<const char *>(iovecs[i].iov_base), length);
+                sent += length;
+            }
+
+            buffer.consume(sent);
+        }
+        return received;
+    }
+
+    std::string serialized(const Value &value) {
+        std::vector<char> out{};
+        serialize(value, out);
+        return {out.begin(), out.end()};
+    }
+}
+
+TEST(OutputBuffer, CopiesPlainValues) {
+    OutputBuffer buffer{};
+    buffer.append(SimpleString{"OK"});
+    buffer.append(Integer{42});
+
+    EXPECT_EQ(10u, buffer.size());
+
+    iovec iovecs[4];
+    EXPECT_EQ(1u, buffer.gather(iovecs));
+    EXPECT_EQ("+OK\r\n:42\r\n", drain(buffer, 100));
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST(OutputBuffer, RefersToSharedStrings) {
+    const auto contents = std::make_shared<const std::string>(share_threshold, 'x');
+
+    OutputBuffer buffer{};
+    buffer.append(SimpleString{"OK"});
+    buffer.append(SharedString{contents});
+    buffer.append(Integer{1});
+
+    iovec iovecs[4];
+    ASSERT_EQ(3u, buffer.gather(iovecs));
+    EXPECT_EQ(contents->data(), iovecs[1].iov_base);
+    EXPECT_EQ(contents->size(), iovecs[1].iov_len);
+
+    // the buffer keeps the string alive while it is referred to
+    EXPECT_EQ(2, contents.use_count());
+
+    const std::string expected{"+OK\r\n" + serialized(SharedString{contents}) + ":1\r\n"};
+    EXPECT_EQ(expected.size(), buffer.size());
+    EXPECT_EQ(expected, drain(buffer, 100));
+    EXPECT_EQ(1, contents.use_count());
+}
+
+TEST(OutputBuffer, PartialSends) {
+    const auto first = std::make_shared<const std::string>(share_threshold, 'a');
+    const auto second = std::make_shared<const std::string>(share_threshold + 1, 'b');
+
+    for (const size_t chunk: {1, 2, 7, 1024, 1030}) {
+        OutputBuffer buffer{};
+        buffer.append(SharedString{first});
+        buffer.append(SharedString{second});
+        buffer.append(BulkString{"tail"});
+
+        EXPECT_EQ(serialized(SharedString{first}) + serialized(SharedString{second}) + serialized(BulkString{"tail"}),
+                  drain(buffer, chunk)) << "chunk " << chunk;
+    }
+}
+
+TEST(OutputBuffer, ReusableOnceDrained) {
+    OutputBuffer buffer{};
+    buffer.append(SharedString{std::make_shared<const std::string>(share_threshold, 'x')});
+    drain(buffer, 100);
+
+    buffer.append(SimpleString{"OK"});
+    EXPECT_EQ("+OK\r\n", drain(buffer, 100));
+}
+
+TEST(OutputBuffer, SendsEncodedStringsAsStored) {
+    const SharedString small = encode("value");
+    const SharedString large = encode(std::string(share_threshold, 'x'));
+
+    OutputBuffer buffer{};
+    buffer.append(small);
+    buffer.append(large);
+
+    // the small one is copied in with no header to work out, the large one is a single iovec of its own
+    iovec iovecs[4];
+    ASSERT_EQ(2u, buffer.gather(iovecs));
+    EXPECT_EQ(small.value->size(), iovecs[0].iov_len);
+    EXPECT_EQ(large.value->data(), iovecs[1].iov_base);
+    EXPECT_EQ(large.value->size(), iovecs[1].iov_len);
+
+    EXPECT_EQ(*small.value + *large.value, drain(buffer, 100));
+}
+
+namespace {
+    SharedArray numbers(const size_t count) {
+        auto values = std::make_shared<std::vector<Value> >();
+        for (size_t i{0}; i < count; ++i) {
+            values->emplace_back(BulkString{std::to_string(i)});
+        }
+        return SharedArray{values, 0, count};
+    }
+}
+
+TEST(OutputBuffer, StreamsLargeArrays) {
+    const SharedArray array = numbers(100'000);
+    const std::string expected = serialized(array);
+
+    OutputBuffer buffer{};
+    buffer.append(array);
+
+    // only the header is serialized up front, the elements a chunk at a time as they are sent
+    EXPECT_FALSE(buffer.empty());
+    EXPECT_EQ(9u, buffer.size());
+    EXPECT_LT(buffer.memory_usage(), expected.size() / 4);
+
+    std::string received{};
+    while (!buffer.empty()) {
+        iovec iovecs[4];
+        const size_t count = buffer.gather(iovecs);
+        ASSERT_GT(count, 0u);
+        EXPECT_LT(buffer.size(), expected.size() / 4);
+
+        received.append(static_cast<const char *>(iovecs[0].iov_base), iovecs[0].iov_len);
+        buffer.consume(iovecs[0].iov_len);
+    }
+    EXPECT_EQ(expected, received);
+}
+
+TEST(OutputBuffer, StreamedArrayBetweenReplies) {
+    const SharedArray array = numbers(1000);
+
+    for (const size_t chunk: {1, 7, 4096, 1 << 20}) {
+        OutputBuffer buffer{};
+        buffer.append(SimpleString{"OK"});
+        buffer.append(array);
+        buffer.append(array);
+        buffer.append(Integer{1});
+
+        EXPECT_EQ("+OK\r\n" + serialized(array) + serialized(array) + ":1\r\n", drain(buffer, chunk)) << chunk;
+    }
+}
+
+TEST(OutputBuffer, SmallArraysAreSerializedAtOnce) {
+    const SharedArray array = numbers(10);
+
+    OutputBuffer buffer{};
+    buffer.append(array);
+    EXPECT_EQ(serialized(array).size(), buffer.size());
+    EXPECT_EQ(serialized(Array{std::vector<Value>{array.elements().begin(), array.elements().end()}}),
+              drain(buffer, 100));
+}
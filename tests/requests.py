@@ -1,8 +1,10 @@
+import os
 import time
 import unittest
 
-from redis import ResponseError
-from redis.connection import Connection
+from redis import ConnectionError, ResponseError
+from redis.exceptions import ClusterCrossSlotError, ExecAbortError
+from redis.connection import Connection, UnixDomainSocketConnection
 
 
 class Requests(unittest.TestCase):
@@ -57,10 +59,59 @@ class Requests(unittest.TestCase):
         with self.assertRaises(ResponseError):
             self.send("pinggggggggggg")
 
+    def test_wrong_number_of_arguments(self):
+        with self.assertRaisesRegex(ResponseError, "wrong number of arguments for 'get'"):
+            self.send("get")
+        with self.assertRaisesRegex(ResponseError, "wrong number of arguments for 'lrange'"):
+            self.send("LRANGE", "list", "0")
+        with self.assertRaisesRegex(ResponseError, "wrong number of arguments for 'lpush'"):
+            self.send("lpush", "list")
+        with self.assertRaisesRegex(ResponseError, "wrong number of arguments for 'rpush'"):
+            self.send("rpush", "list")
+
+    def test_command_names_ignore_case(self):
+        self.assertEqual(b"OK", self.send("SeT", "key", "value"))
+        self.assertEqual(b"value", self.send("gEt", "key"))
+
     def test_empty_command(self):
         with self.assertRaises(ResponseError):
             self.send("")
 
+    def test_protocol_error(self):
+        self.connection.send_packed_command([b"*1\r\n$x\r\n"])
+        with self.assertRaisesRegex(ResponseError, "Protocol error"):
+            self.connection.read_response()
+        # and the server hangs up
+        with self.assertRaises(ConnectionError):
+            self.connection.read_response()
+
+    def test_protocol_error_after_unread_replies(self):
+        self.send("set", "key", "x" * 200_000)
+        self.connection.send_packed_command([b"*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n" * 500 + b"*1\r\n$x\r\n"])
+        time.sleep(0.1)
+
+        # the replies piling up for the first client hold up nobody else
+        other = Connection(socket_timeout=1)
+        other.connect()
+        other.send_command("ping")
+        self.assertEqual(b"PONG", other.read_response())
+        other.disconnect()
+
+        # and the error comes after all of them
+        for _ in range(500):
+            self.assertEqual(200_000, len(self.connection.read_response()))
+        with self.assertRaisesRegex(ResponseError, "Protocol error"):
+            self.connection.read_response()
+        with self.assertRaises(ConnectionError):
+            self.connection.read_response()
+
+    def test_split_command(self):
+        self.connection.send_packed_command([b"*2\r\n$4\r\nPI"])
+        time.sleep(0.05)
+        self.connection.send_packed_command([b"NG\r\n$5\r\nhello\r\n*1\r\n$4\r\nPING\r\n"])
+        self.assertEqual(b"hello", self.connection.read_response())
+        self.assertEqual(b"PONG", self.connection.read_response())
+
     def test_ping(self):
         self.assertEqual(b"PONG", self.send("ping"))
 
@@ -172,6 +223,29 @@ class Requests(unittest.TestCase):
     def test_decr_nonexistent(self):
         self.assertEqual(-1, self.send("decr key"))
 
+    def test_incr_stores_result(self):
+        self.send("set key 5")
+        self.send("decr key")
+        self.assertEqual(b"4", self.send("get key"))
+        self.send("incr key")
+        self.assertEqual(b"5", self.send("get key"))
+
+    def test_get_large_value(self):
+        value = b"x" * (1 << 20)
+        self.send("set", "key", value)
+        self.assertEqual(value, self.send("get", "key"))
+
+    def test_overwrite_large_value_while_pipelined(self):
+        first = b"a" * (1 << 20)
+        second = b"b" * (1 << 20)
+        self.send("set", "key", first)
+        self.connection.send_command("get", "key")
+        self.connection.send_command("set", "key", second)
+        self.connection.send_command("get", "key")
+        self.assertEqual(first, self.connection.read_response())
+        self.assertEqual(b"OK", self.connection.read_response())
+        self.assertEqual(second, self.connection.read_response())
+
     def test_decr_existing(self):
         self.send("set key 1")
         self.assertEqual(0, self.send("decr key"))
@@ -218,7 +292,6 @@ class Requests(unittest.TestCase):
         self.assertEqual([b"1", b"2", b"3"], self.send("lrange key 0 10"))
 
     def test_lrange_empty(self):
-        self.send("rpush key")
         self.assertEqual([], self.send("lrange key 0 -1"))
 
     def test_lrange_non_array(self):
@@ -226,6 +299,23 @@ class Requests(unittest.TestCase):
         with self.assertRaises(ResponseError):
             self.send("lrange key")
 
+    def test_lrange_large(self):
+        values = [str(i) for i in range(100_000)]
+        for start in range(0, len(values), 10_000):
+            self.send("rpush", "key", *values[start:start + 10_000])
+        self.assertEqual([v.encode() for v in values], self.send("lrange", "key", "0", "-1"))
+
+    def test_lrange_while_pushing(self):
+        # the reply is what the list was when it was read, whatever is pushed while it is still being sent
+        values = [str(i) for i in range(50_000)]
+        self.send("rpush", "key", *values)
+        self.connection.send_command("lrange", "key", "0", "-1")
+        self.connection.send_command("lpush", "key", "first")
+        self.connection.send_command("lrange", "key", "0", "0")
+        self.assertEqual([v.encode() for v in values], self.connection.read_response())
+        self.assertEqual(50_001, self.connection.read_response())
+        self.assertEqual([b"first"], self.connection.read_response())
+
     def test_lpush_non_array(self):
         self.send("set key value")
         with self.assertRaises(ResponseError):
@@ -236,6 +326,345 @@ class Requests(unittest.TestCase):
         with self.assertRaises(ResponseError):
             self.send("rpush key")
 
+    @unittest.skipUnless(os.environ.get("REDISH_UNIX_SOCKET"), "the server is not listening on a unix socket")
+    def test_unix_socket(self):
+        connection = UnixDomainSocketConnection(path=os.environ["REDISH_UNIX_SOCKET"])
+        connection.connect()
+        connection.send_command("set", "key", "value")
+        self.assertEqual(b"OK", connection.read_response())
+        connection.disconnect()
+
+        # the same keyspace as over TCP
+        self.assertEqual(b"value", self.send("get", "key"))
+
+    def info(self, *section):
+        info = self.send("info", *section).decode()
+        return dict(line.split(":") for line in info.splitlines() if line and not line.startswith("#"))
+
+    def test_info_counts_accepted_connections(self):
+        fields = self.info()
+        self.assertGreaterEqual(int(fields["total_connections_received"]), 1)
+        self.assertGreaterEqual(int(fields["accept_wakeups"]), 1)
+        self.assertGreater(float(fields["accepts_per_wakeup"]), 0)
+
+    def test_info_reports_client_memory(self):
+        fields = self.info("clients")
+        self.assertGreaterEqual(int(fields["connected_clients"]), 1)
+        self.assertGreater(int(fields["mem_per_client"]), 0)
+        self.assertGreaterEqual(int(fields["mem_clients"]), int(fields["mem_per_client"]))
+
+    def test_info_reports_io_threads(self):
+        fields = self.info("stats")
+        # zero unless the server runs with --io-threads, and then at least this request went through them
+        self.assertGreaterEqual(int(fields["io_threaded_reads_processed"]), 0)
+        self.assertGreaterEqual(int(fields["io_threaded_writes_processed"]), 0)
+
+    def test_info_reports_busy_poll(self):
+        fields = self.info("stats")
+        # zero unless the server runs with --busy-poll; handling this very request counts as work either way
+        self.assertGreaterEqual(int(fields["busy_poll_us"]), 0)
+        self.assertGreaterEqual(int(fields["busy_poll_hits"]), 0)
+        self.assertGreater(int(fields["event_loop_work_us"]), 0)
+
+    def test_info_section(self):
+        self.assertTrue(self.send("info", "STATS").startswith(b"# Stats"))
+        self.assertTrue(self.send("info", "clients").startswith(b"# Clients"))
+        self.assertEqual(b"", self.send("info", "keyspace"))
+        with self.assertRaises(ResponseError):
+            self.send("info", "stats", "extra")
+
+    def test_hello(self):
+        connection = Connection(protocol=3)
+        connection.connect()
+        connection.send_command("hello")
+        fields = connection.read_response()
+        self.assertEqual(3, fields[b"proto"])
+        connection.send_command("client", "id")
+        self.assertEqual(fields[b"id"], connection.read_response())
+
+        # back to RESP2, where a map is a flat array
+        connection.send_command("hello", "2")
+        self.assertIsInstance(connection.read_response(), list)
+        connection.disconnect()
+
+        with self.assertRaisesRegex(ResponseError, "NOPROTO"):
+            self.send("hello", "4")
+
+    def test_tracking_requires_resp3(self):
+        # redis-py speaks RESP3 unless told otherwise
+        connection = Connection(protocol=2)
+        connection.connect()
+        connection.send_command("client", "tracking", "on")
+        with self.assertRaisesRegex(ResponseError, "RESP3"):
+            connection.read_response()
+        connection.send_command("client", "tracking", "on", "optin")
+        with self.assertRaises(ResponseError):
+            connection.read_response()
+        connection.disconnect()
+
+    def tracking_connection(self, *options):
+        connection = Connection(protocol=3)
+        connection.connect()
+        # without a handler of its own, redis-py swallows invalidations rather than returning them
+        connection._parser.set_invalidation_push_handler(lambda push: push)
+        connection.send_command("client", "tracking", "on", *options)
+        self.assertEqual(b"OK", connection.read_response())
+        return connection
+
+    def test_tracking_invalidates_read_keys(self):
+        self.send("set", "key", "value")
+        connection = self.tracking_connection()
+        connection.send_command("get", "key")
+        self.assertEqual(b"value", connection.read_response())
+
+        self.send("set", "key", "other")
+        self.assertEqual([b"invalidate", [b"key"]], connection.read_response(push_request=True))
+
+        # the key is forgotten once invalidated, so changing it again sends nothing until it is read again
+        self.send("set", "key", "again")
+        connection.send_command("ping")
+        self.assertEqual(b"PONG", connection.read_response(push_request=True))
+        connection.disconnect()
+
+    def test_tracking_flush_invalidates_everything(self):
+        connection = self.tracking_connection()
+        connection.send_command("get", "key")
+        self.assertIsNone(connection.read_response())
+
+        self.send("flushdb")
+        self.assertEqual([b"invalidate", None], connection.read_response(push_request=True))
+        connection.disconnect()
+
+    def test_tracking_broadcast(self):
+        connection = self.tracking_connection("bcast", "prefix", "user:")
+        self.send("set", "other", "value")
+        self.send("incr", "user:1")
+        self.assertEqual([b"invalidate", [b"user:1"]], connection.read_response(push_request=True))
+        self.assertGreaterEqual(int(self.info("stats")["tracking_total_prefixes"]), 1)
+
+        connection.send_command("client", "tracking", "off")
+        self.assertEqual(b"OK", connection.read_response())
+        self.send("incr", "user:1")
+        connection.send_command("ping")
+        self.assertEqual(b"PONG", connection.read_response(push_request=True))
+        connection.disconnect()
+
+    def test_mset_mget(self):
+        self.assertEqual(b"OK", self.send("mset", "a", "1", "b", "2", "c", "3"))
+        self.send("rpush", "list", "x")
+        self.assertEqual([b"1", None, b"2", None, b"3"], self.send("mget", "a", "missing", "b", "list", "c"))
+
+        with self.assertRaisesRegex(ResponseError, "wrong number of arguments"):
+            self.send("mset", "a", "1", "b")
+
+    def test_mget_many_keys(self):
+        keys = ["key:%d" % i for i in range(1000)]
+        arguments = []
+        for key in keys:
+            arguments += [key, key.upper()]
+        self.assertEqual(b"OK", self.send("mset", *arguments))
+        self.assertEqual([key.upper().encode() for key in keys], self.send("mget", *keys))
+
+    def test_msetnx(self):
+        # keys hashed to the same place, so that this works with any number of shards
+        self.assertEqual(1, self.send("msetnx", "key", "1"))
+        self.assertEqual(0, self.send("msetnx", "key", "2"))
+        self.assertEqual(b"1", self.send("get", "key"))
+
+        self.assertEqual(b"OK", self.send("mset", "a", "1", "b", "2", "c", "3"))
+        try:
+            self.assertEqual(0, self.send("msetnx", "a", "1", "d", "4"))
+            self.assertIsNone(self.send("get", "d"))
+        except ClusterCrossSlotError:
+            # with several shards, a and d may be on different ones
+            pass
+
+    def test_pipelined_batch(self):
+        # more commands than are decoded ahead at once, each depending on the one before
+        commands = [("set", "counter", "0")] + [("incr", "counter")] * 100 + [("get", "counter")]
+        for command in commands:
+            self.connection.send_command(*command)
+        replies = [self.connection.read_response() for _ in commands]
+        self.assertEqual(b"OK", replies[0])
+        self.assertEqual(list(range(1, 101)), replies[1:-1])
+        self.assertEqual(b"100", replies[-1])
+
+    def test_client_reply_skip(self):
+        self.connection.send_command("client", "reply", "skip")
+        self.connection.send_command("set", "key", "value")
+        # only the reply to the command after the skipped one comes back
+        self.assertEqual(b"value", self.send("get", "key"))
+
+    def test_client_reply_off(self):
+        self.connection.send_command("client", "reply", "off")
+        self.connection.send_command("set", "key", "value")
+        self.connection.send_command("incr", "key")
+        self.connection.send_command("del", "key", "other", "another")
+        self.connection.send_command("set", "key", "again")
+        self.assertEqual(b"OK", self.send("client", "reply", "on"))
+        self.assertEqual(b"again", self.send("get", "key"))
+
+        with self.assertRaisesRegex(ResponseError, "syntax"):
+            self.send("client", "reply", "maybe")
+
+    def other_connection(self):
+        connection = Connection()
+        connection.connect()
+        return connection
+
+    def test_multi_exec(self):
+        self.assertEqual(b"OK", self.send("multi"))
+        self.assertEqual(b"QUEUED", self.send("set", "key", "1"))
+        self.assertEqual(b"QUEUED", self.send("incr", "key"))
+        self.assertEqual(b"QUEUED", self.send("get", "key"))
+        self.assertEqual([b"OK", 2, b"2"], self.send("exec"))
+
+        with self.assertRaisesRegex(ResponseError, "without MULTI"):
+            self.send("exec")
+        self.send("multi")
+        with self.assertRaisesRegex(ResponseError, "nested"):
+            self.send("multi")
+        self.assertEqual([], self.send("exec"))
+
+    def test_discard(self):
+        self.send("multi")
+        self.send("set", "key", "value")
+        self.assertEqual(b"OK", self.send("discard"))
+        self.assertIsNone(self.send("get", "key"))
+
+        with self.assertRaisesRegex(ResponseError, "without MULTI"):
+            self.send("discard")
+
+    def test_exec_abort(self):
+        self.send("multi")
+        self.send("set", "key", "value")
+        with self.assertRaises(ResponseError):
+            self.send("get")
+        with self.assertRaises(ExecAbortError):
+            self.send("exec")
+        self.assertIsNone(self.send("get", "key"))
+
+    def test_watch(self):
+        self.send("set", "key", "1")
+        self.assertEqual(b"OK", self.send("watch", "key"))
+        other = self.other_connection()
+        other.send_command("incr", "key")
+        self.assertEqual(2, other.read_response())
+
+        self.send("multi")
+        self.send("incr", "key")
+        self.assertIsNone(self.send("exec"))
+        self.assertEqual(b"2", self.send("get", "key"))
+
+        # EXEC unwatches, aborted or not
+        self.send("multi")
+        self.send("incr", "key")
+        self.assertEqual([3], self.send("exec"))
+
+        self.send("watch", "key")
+        self.assertEqual(b"OK", self.send("unwatch"))
+        other.send_command("incr", "key")
+        other.read_response()
+        self.send("multi")
+        self.send("incr", "key")
+        self.assertEqual([5], self.send("exec"))
+        other.disconnect()
+
+    def test_watch_missing_key(self):
+        self.send("watch", "key")
+        other = self.other_connection()
+        other.send_command("set", "key", "value")
+        other.read_response()
+        other.send_command("del", "key")
+        other.read_response()
+        other.disconnect()
+
+        # the key is missing again, yet it has been there in the meantime
+        self.send("multi")
+        self.send("set", "key", "mine")
+        self.assertIsNone(self.send("exec"))
+        self.assertIsNone(self.send("get", "key"))
+
+    def test_multi_across_shards(self):
+        self.send("multi")
+        self.send("set", "a", "1")
+        try:
+            self.assertEqual(b"QUEUED", self.send("set", "b", "2"))
+            self.assertEqual([b"OK", b"OK"], self.send("exec"))
+        except ClusterCrossSlotError:
+            with self.assertRaises(ExecAbortError):
+                self.send("exec")
+
+    def load_function(self, source):
+        return self.send("function", "load", "replace", source)
+
+    def test_fcall(self):
+        self.assertEqual([b"bump", b"greet"], self.load_function("""
+            # adds to a counter, which starts at 0
+            function bump {
+                let total = int(call("GET", KEYS[1])) + ARGV[1];
+                call("SET", KEYS[1], total);
+                return total;
+            }
+
+            function greet { return "hello " .. ARGV[1]; }
+        """))
+        self.assertEqual(5, self.send("fcall", "bump", "1", "counter", "5"))
+        self.assertEqual(8, self.send("fcall", "bump", "1", "counter", "3"))
+        self.assertEqual(b"8", self.send("get", "counter"))
+        self.assertEqual(b"hello world", self.send("fcall", "greet", "0", "world"))
+
+        self.send("multi")
+        self.send("fcall", "bump", "1", "counter", "2")
+        self.send("get", "counter")
+        self.assertEqual([10, b"10"], self.send("exec"))
+
+    def test_fcall_errors(self):
+        with self.assertRaisesRegex(ResponseError, "compiling"):
+            self.load_function("function broken { return 1 }")
+        self.load_function("""
+            function spin { while 1 { } }
+            function flush { call("FLUSHDB"); }
+            function fail { call("INCR", KEYS[1]); return 1; }
+        """)
+        with self.assertRaisesRegex(ResponseError, "budget"):
+            self.send("fcall", "spin", "0")
+        with self.assertRaisesRegex(ResponseError, "cannot be called"):
+            self.send("fcall", "flush", "0")
+        self.send("set", "key", "text")
+        with self.assertRaisesRegex(ResponseError, "integer"):
+            self.send("fcall", "fail", "1", "key")
+        with self.assertRaisesRegex(ResponseError, "not found"):
+            self.send("fcall", "missing", "0")
+        with self.assertRaisesRegex(ResponseError, "keys"):
+            self.send("fcall", "spin", "2", "key")
+
+    def test_fcall_across_shards(self):
+        self.load_function("""
+            function swap {
+                let a = call("GET", KEYS[1]);
+                call("SET", KEYS[1], call("GET", KEYS[2]));
+                call("SET", KEYS[2], a);
+            }
+        """)
+        self.send("mset", "a", "1", "b", "2")
+        try:
+            self.assertIsNone(self.send("fcall", "swap", "2", "a", "b"))
+            self.assertEqual([b"2", b"1"], self.send("mget", "a", "b"))
+        except ClusterCrossSlotError:
+            # with several shards, a and b may be on different ones
+            pass
+
+    def test_function_list_delete(self):
+        self.load_function("function listed { }")
+        self.assertIn(b"listed", self.send("function", "list"))
+        with self.assertRaisesRegex(ResponseError, "exists"):
+            self.send("function", "load", "function listed { }")
+        self.assertEqual(b"OK", self.send("function", "delete", "listed"))
+        self.assertNotIn(b"listed", self.send("function", "list"))
+        with self.assertRaisesRegex(ResponseError, "not found"):
+            self.send("function", "delete", "listed")
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -4,7 +4,9 @@
 
 #include "resp.h"
 
+#include <format>
 #include <gtest/gtest.h>
+#include <limits>
 
 
 using namespace resp;
@@ -59,3 +61,104 @@ TEST(Resp, SaveLoadArray) {
     };
     test_save_load(array);
 }
+
+TEST(Resp, SharedStringSavesAsBulkString) {
+    const std::string contents(share_threshold, 'x');
+    std::stringstream ss;
+    save(SharedString{std::make_shared<const std::string>(contents)}, ss);
+    ss.seekg(0);
+
+    EXPECT_EQ(Value{BulkString{contents}}, load(ss));
+}
+
+TEST(Resp, SharedStringSerializesAsBulkString) {
+    std::vector<char> shared{};
+    serialize(SharedString{std::make_shared<const std::string>("value")}, shared);
+
+    std::vector<char> bulk{};
+    serialize(BulkString{"value"}, bulk);
+
+    EXPECT_EQ(bulk, shared);
+}
+
+TEST(Resp, ShareOnlyLongStrings) {
+    EXPECT_TRUE(std::holds_alternative<BulkString>(share(BulkString{"short"})));
+    EXPECT_TRUE(std::holds_alternative<BulkString>(share(BulkString{std::nullopt})));
+    EXPECT_TRUE(std::holds_alternative<Integer>(share(Integer{1})));
+
+    const std::string contents(share_threshold, 'x');
+    const Value shared = share(BulkString{contents});
+    ASSERT_TRUE(std::holds_alternative<SharedString>(shared));
+    EXPECT_EQ(contents, string_of(shared));
+}
+
+namespace {
+    std::string serialized(const Value &value, const Protocol protocol) {
+        std::vector<char> out{};
+        serialize(value, out, protocol);
+        return {out.begin(), out.end()};
+    }
+}
+
+TEST(Resp, SerializeResp3Types) {
+    EXPECT_EQ("_\r\n", serialized(Null{}, Protocol::resp3));
+    EXPECT_EQ("_\r\n", serialized(nil, Protocol::resp3));
+    EXPECT_EQ("_\r\n", serialized(Array{std::nullopt}, Protocol::resp3));
+    EXPECT_EQ("#t\r\n", serialized(Boolean{true}, Protocol::resp3));
+    EXPECT_EQ("#f\r\n", serialized(Boolean{false}, Protocol::resp3));
+    EXPECT_EQ(",1.5\r\n", serialized(Double{1.5}, Protocol::resp3));
+    EXPECT_EQ(",-inf\r\n", serialized(Double{-std::numeric_limits<double>::infinity()}, Protocol::resp3));
+    EXPECT_EQ("%1\r\n+a\r\n:1\r\n", serialized(Map{{SimpleString{"a"}, Integer{1}}}, Protocol::resp3));
+    EXPECT_EQ("~2\r\n:1\r\n:2\r\n", serialized(Set{{Integer{1}, Integer{2}}}, Protocol::resp3));
+    EXPECT_EQ(">2\r\n+invalidate\r\n_\r\n",
+              serialized(Push{{SimpleString{"invalidate"}, Array{std::nullopt}}}, Protocol::resp3));
+}
+
+TEST(Resp, SerializeResp3TypesForResp2) {
+    EXPECT_EQ("$-1\r\n", serialized(Null{}, Protocol::resp2));
+    EXPECT_EQ("*-1\r\n", serialized(Array{std::nullopt}, Protocol::resp2));
+    EXPECT_EQ(":1\r\n", serialized(Boolean{true}, Protocol::resp2));
+    EXPECT_EQ("$3\r\n1.5\r\n", serialized(Double{1.5}, Protocol::resp2));
+    EXPECT_EQ("*2\r\n+a\r\n:1\r\n", serialized(Map{{SimpleString{"a"}, Integer{1}}}, Protocol::resp2));
+    EXPECT_EQ("*1\r\n:1\r\n", serialized(Set{{Integer{1}}}, Protocol::resp2));
+    // nested values are downgraded too
+    EXPECT_EQ("*1\r\n#t\r\n", serialized(Array{std::vector<Value>{Boolean{true}}}, Protocol::resp3));
+    EXPECT_EQ("*1\r\n:1\r\n", serialized(Array{std::vector<Value>{Boolean{true}}}, Protocol::resp2));
+}
+
+TEST(Resp, SaveLoadResp3Types) {
+    test_save_load(Null{});
+    test_save_load(Boolean{true});
+    test_save_load(Double{2.25});
+    test_save_load(Map{{BulkString{"key"}, Integer{1}}});
+    test_save_load(Set{{Integer{1}, Integer{2}}});
+    test_save_load(Push{{BulkString{"invalidate"}, Array{std::nullopt}}});
+}
+
+TEST(Resp, EncodeStoresWireForm) {
+    const SharedString encoded = encode("value");
+    EXPECT_EQ("$5\r\nvalue\r\n", *encoded.value);
+    EXPECT_EQ("value", encoded.contents());
+    std::stringstream ss;
+    save(encoded, ss);
+    ss.seekg(0);
+    EXPECT_EQ(Value{BulkString{"value"}}, load(ss));
+    EXPECT_EQ("$5\r\nvalue\r\n", serialized(encoded, Protocol::resp3));
+    EXPECT_EQ("$0\r\n\r\n", *encode("").value);
+    EXPECT_EQ(encoded, (SharedString{std::make_shared<const std::string>("value")}));
+}
+
+TEST(Resp, StringValueEncodesFromThreshold) {
+    EXPECT_TRUE(std::holds_alternative<BulkString>(string_value("short", 6)));
+    ASSERT_TRUE(std::holds_alternative<SharedString>(string_value("short", 5)));
+    EXPECT_EQ("short", string_of(string_value("short", 0)));
+    EXPECT_TRUE(std::holds_alternative<SharedString>(share(BulkString{"short"}, 0)));
+}
+
+TEST(Resp, SerializeIntegersAroundTheEncodedOnes) {
+    for (const int64_t i: {0l, 1l, 42l, 9999l, 10000l, -1l, 1234567890123l}) {
+        EXPECT_EQ(std::format(":{}\r\n", i), serialized(Integer{i}, Protocol::resp2)) << i;
+    }
+    EXPECT_EQ("+OK\r\n", serialized(ok, Protocol::resp2));
+    EXPECT_EQ("+OKAY\r\n", serialized(SimpleString{"OKAY"}, Protocol::resp2));
+}
@@ -1,5 +1,7 @@
 #include "resp_parser.h"
+#include "utils.h"
 
+#include <cmath>
 #include <gtest/gtest.h>
 #include <sstream>
 #include <iterator>
@@ -260,3 +262,156 @@ TEST(RespParser, ArrayInvalidVariant) {
     auto values = parse_all("*4\r\n+Hi\r\n:123\r\n");
     EXPECT_TRUE(values.empty());
 }
+
+TEST(RespParser, BulkStringLengthSplitBeforeLf) {
+    Parser p;
+    p.feed({"$5\r", 3});
+    EXPECT_TRUE(p.take_values().empty());
+    p.feed({"\nhello\r\n", 8});
+    auto values = p.take_values();
+    ASSERT_EQ(values.size(), 1u);
+    EXPECT_EQ("hello", *std::get<BulkString>(values[0]).value);
+}
+
+TEST(RespParser, BulkStringPayloadSplit) {
+    Parser p;
+    p.feed({"$5\r\nhel", 7});
+    EXPECT_TRUE(p.take_values().empty());
+    p.feed({"lo\r\n", 4});
+    auto values = p.take_values();
+    ASSERT_EQ(values.size(), 1u);
+    EXPECT_EQ("hello", *std::get<BulkString>(values[0]).value);
+}
+
+TEST(RespParser, ArrayLengthSplit) {
+    Parser p;
+    p.feed({"*2", 2});
+    EXPECT_TRUE(p.take_values().empty());
+    p.feed({"\r\n$3\r\nfoo\r\n$3\r\nbar\r\n", 22});
+    auto values = p.take_values();
+    ASSERT_EQ(values.size(), 1u);
+    EXPECT_EQ(make_array("foo", "bar"), std::get<Array>(values[0]));
+}
+
+TEST(RespParser, PipelineFedByteByByte) {
+    const std::string pipeline{"*2\r\n$3\r\nGET\r\n$1\r\na\r\n*3\r\n$3\r\nSET\r\n$1\r\nb\r\n$2\r\nxy\r\n"};
+    Parser p;
+    std::vector<Value> values{};
+    for (const char c: pipeline) {
+        p.feed({&c, 1});
+        for (auto &value: p.take_values()) {
+            values.push_back(std::move(value));
+        }
+    }
+
+    ASSERT_EQ(values.size(), 2u);
+    EXPECT_EQ(make_array("GET", "a"), std::get<Array>(values[0]));
+    EXPECT_EQ(make_array("SET", "b", "xy"), std::get<Array>(values[1]));
+}
+
+TEST(RespParser, KeepsOnlyIncompleteValues) {
+    Parser p;
+    p.feed({"+OK\r\n", 5});
+    EXPECT_EQ(1u, p.take_values().size());
+    EXPECT_EQ(0u, p.memory_usage());
+
+    const std::string large{"$100000\r\n" + std::string(100000, 'x') + "\r\n"};
+    p.feed({large.data(), 50000});
+    EXPECT_TRUE(p.take_values().empty());
+    EXPECT_GE(p.memory_usage(), 50000u);
+
+    p.feed({large.data() + 50000, large.size() - 50000});
+    auto values = p.take_values();
+    ASSERT_EQ(1u, values.size());
+    EXPECT_EQ(std::string(100000, 'x'), *std::get<BulkString>(values[0]).value);
+    EXPECT_EQ(0u, p.memory_usage());
+}
+
+TEST(RespParser, LargeBulkStringInSmallChunks) {
+    const std::string value(1 << 20, 'x');
+    const std::string data{"$1048576\r\n" + value + "\r\n"};
+    Parser p;
+    for (size_t offset{0}; offset < data.size(); offset += 4096) {
+        p.feed({data.data() + offset, std::min<size_t>(4096, data.size() - offset)});
+        // the string is sized from its announced length once, and filled in place from then on
+        EXPECT_LT(p.memory_usage(), value.size() + 4096);
+    }
+
+    auto values = p.take_values();
+    ASSERT_EQ(1u, values.size());
+    EXPECT_EQ(value, *std::get<BulkString>(values[0]).value);
+}
+
+TEST(RespParser, BulkStringTerminatorSplit) {
+    Parser p;
+    p.feed({"$2\r\nab\r", 7});
+    EXPECT_TRUE(p.take_values().empty());
+    p.feed({"\n", 1});
+    auto values = p.take_values();
+    ASSERT_EQ(1u, values.size());
+    EXPECT_EQ("ab", *std::get<BulkString>(values[0]).value);
+}
+
+TEST(RespParser, BulkStringBadTerminator) {
+    Parser p;
+    p.feed({"$2\r\nabxx+OK\r\n", 13});
+    EXPECT_TRUE(p.take_values().empty());
+    EXPECT_TRUE(p.failed());
+}
+
+TEST(RespParser, NestedArraySplitAcrossFeeds) {
+    const std::string data{"*2\r\n*2\r\n$3\r\nfoo\r\n:7\r\n$3\r\nbar\r\n+OK\r\n"};
+    for (size_t split{1}; split < data.size(); ++split) {
+        Parser p;
+        p.feed({data.data(), split});
+        p.feed({data.data() + split, data.size() - split});
+        auto values = p.take_values();
+        ASSERT_EQ(2u, values.size()) << split;
+
+        const Array expected{
+            std::vector<Value>{
+                Array{std::vector<Value>{BulkString{"foo"}, Integer{7}}},
+                BulkString{"bar"},
+            }
+        };
+        EXPECT_EQ(expected, std::get<Array>(values[0])) << split;
+        EXPECT_EQ("OK", std::get<SimpleString>(values[1]).value) << split;
+    }
+}
+
+TEST(RespParser, StopsAfterProtocolError) {
+    Parser p;
+    EXPECT_FALSE(p.failed());
+    p.feed({"?\r\n+OK\r\n", 8});
+    EXPECT_TRUE(p.take_values().empty());
+    EXPECT_TRUE(p.failed());
+}
+
+TEST(RespParser, Resp3Scalars) {
+    auto values = parse_all("_\r\n#t\r\n#f\r\n,1.5\r\n,-inf\r\n");
+    ASSERT_EQ(values.size(), 5u);
+    EXPECT_EQ(Value{Null{}}, values[0]);
+    EXPECT_EQ(Value{Boolean{true}}, values[1]);
+    EXPECT_EQ(Value{Boolean{false}}, values[2]);
+    EXPECT_EQ(Value{Double{1.5}}, values[3]);
+    EXPECT_TRUE(std::isinf(std::get<Double>(values[4]).value));
+}
+
+TEST(RespParser, Resp3Aggregates) {
+    auto values = parse_all("%2\r\n+a\r\n:1\r\n+b\r\n~1\r\n#t\r\n>2\r\n$10\r\ninvalidate\r\n*1\r\n$3\r\nkey\r\n%0\r\n");
+    ASSERT_EQ(values.size(), 3u);
+    const Map expected_map{{SimpleString{"a"}, Integer{1}, SimpleString{"b"}, Set{{Boolean{true}}}}};
+    EXPECT_EQ(Value{expected_map}, values[0]);
+    const Push expected_push{{BulkString{"invalidate"}, Array{std::vector<Value>{BulkString{"key"}}}}};
+    EXPECT_EQ(Value{expected_push}, values[1]);
+    EXPECT_EQ(Value{Map{}}, values[2]);
+}
+
+TEST(RespParser, Resp3Invalid) {
+    for (const std::string input: {"_x\r\n", "#x\r\n", ",x\r\n", "%-1\r\n"}) {
+        Parser p;
+        p.feed({input.data(), input.size()});
+        EXPECT_TRUE(p.take_values().empty()) << input;
+        EXPECT_TRUE(p.failed()) << input;
+    }
+}
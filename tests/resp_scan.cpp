@@ -0,0 +1,90 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "resp_scan.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace resp;
+
+namespace {
+    // runs a test once with every kernel this CPU supports
+    class RespScan : public testing::TestWithParam<ScanKernel> {
+    protected:
+        void SetUp() override {
+            if (!set_scan_kernel(GetParam())) {
+                GTEST_SKIP() << "the CPU does not support " << to_string(GetParam());
+            }
+        }
+
+        void TearDown() override {
+            set_scan_kernel(best_scan_kernel());
+        }
+    };
+
+    size_t find(const std::string &data) {
+        return find_crlf(data);
+    }
+}
+
+TEST_P(RespScan, FindsCrlfAtEveryOffset) {
+    for (size_t size{2}; size < 100; ++size) {
+        for (size_t offset{0}; offset + 2 <= size; ++offset) {
+            std::string data(size, 'x');
+            data[offset] = '\r';
+            data[offset + 1] = '\n';
+            ASSERT_EQ(offset, find(data)) << size << " " << offset;
+        }
+    }
+}
+
+TEST_P(RespScan, FindsFirstOfSeveral) {
+    std::string data(80, 'x');
+    data.replace(40, 2, "\r\n");
+    data.replace(70, 2, "\r\n");
+    EXPECT_EQ(40u, find(data));
+}
+
+TEST_P(RespScan, SkipsLoneCrAndLf) {
+    for (size_t offset{0}; offset + 3 < 70; ++offset) {
+        std::string data(70, 'x');
+        data[offset] = '\n';
+        data[offset + 1] = '\r';
+        data[offset + 2] = 'x';
+        EXPECT_EQ(std::string_view::npos, find(data)) << offset;
+
+        data[offset + 2] = '\r';
+        data[offset + 3] = '\n';
+        EXPECT_EQ(offset + 2, find(data)) << offset;
+    }
+}
+
+TEST_P(RespScan, CrAtTheEndIsNotALine) {
+    for (size_t size{1}; size < 70; ++size) {
+        std::string data(size, 'x');
+        data.back() = '\r';
+        EXPECT_EQ(std::string_view::npos, find(data)) << size;
+    }
+    EXPECT_EQ(std::string_view::npos, find(""));
+}
+
+INSTANTIATE_TEST_SUITE_P(Kernels, RespScan, testing::Values(ScanKernel::scalar, ScanKernel::sse2, ScanKernel::avx2),
+                         [](const testing::TestParamInfo<ScanKernel> &info) {
+                             return std::string{to_string(info.param)};
+                         });
+
+TEST(Resp, ParseLength) {
+    EXPECT_EQ(0, parse_length("0"));
+    EXPECT_EQ(42, parse_length("42"));
+    EXPECT_EQ(-1, parse_length("-1"));
+    EXPECT_EQ(999999999999999999, parse_length("999999999999999999"));
+    EXPECT_EQ(9223372036854775807, parse_length("9223372036854775807"));
+    EXPECT_EQ(std::nullopt, parse_length("9223372036854775808"));
+    EXPECT_EQ(std::nullopt, parse_length(""));
+    EXPECT_EQ(std::nullopt, parse_length("-"));
+    EXPECT_EQ(std::nullopt, parse_length("+1"));
+    EXPECT_EQ(std::nullopt, parse_length("1x"));
+    EXPECT_EQ(std::nullopt, parse_length(" 1"));
+}
@@ -0,0 +1,224 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "script.h"
+
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace resp;
+
+namespace {
+    // a keyspace of strings, with GET, SET and INCR
+    class FakeHost final : public script::Host {
+    public:
+        Value call(const script::Arguments arguments) override {
+            calls.emplace_back(arguments.begin(), arguments.end());
+
+            const std::string key{arguments.size() > 1 ? arguments[1] : ""};
+            if (arguments[0] == "GET") {
+                const auto value = values.find(key);
+                return value == values.end() ? nil : Value{BulkString{value->second}};
+            }
+            if (arguments[0] == "SET") {
+                values[key] = arguments[2];
+                return ok;
+            }
+            if (arguments[0] == "INCR") {
+                const int64_t value = std::stoll(values[key].empty() ? "0" : values[key]) + 1;
+                values[key] = std::to_string(value);
+                return Integer{value};
+            }
+            return SimpleError{"ERR", "unknown command"};
+        }
+
+        std::map<std::string, std::string> values{};
+        std::vector<std::vector<std::string> > calls{};
+    };
+
+    Value run(const std::string_view source, const std::vector<std::string_view> &keys = {},
+              const std::vector<std::string_view> &arguments = {}, const size_t budget = 10'000) {
+        FakeHost host{};
+        const auto functions = script::compile(source);
+        EXPECT_TRUE(functions.has_value()) << functions.error();
+        return script::run(functions->front(), keys, arguments, host, budget);
+    }
+
+    std::string compile_error(const std::string_view source) {
+        const auto functions = script::compile(source);
+        EXPECT_FALSE(functions.has_value());
+        return functions.has_value() ? std::string{} : functions.error();
+    }
+
+    bool is_error(const Value &value) { return std::holds_alternative<SimpleError>(value); }
+}
+
+TEST(Script, ReturnsValues) {
+    EXPECT_EQ(Value{Integer{7}}, run("function f { return 1 + 2 * 3; }"));
+    EXPECT_EQ(Value{BulkString{"a\"b\n"}}, run(R"(function f { return "a\"b\n"; })"));
+    EXPECT_EQ(nil, run("function f { }"));
+    EXPECT_EQ(nil, run("function f { return; }"));
+}
+
+TEST(Script, Arithmetic) {
+    EXPECT_EQ(Value{Integer{-1}}, run("function f { return (1 - 2) % 3; }"));
+    EXPECT_EQ(Value{Integer{-3}}, run("function f { return -7 / 2; }"));
+    EXPECT_EQ(Value{Integer{5}}, run("function f { return ARGV[1] + 2; }", {}, {"3"}));
+    EXPECT_EQ(Value{BulkString{"a1"}}, run(R"(function f { return "a" .. 1; })"));
+
+    EXPECT_TRUE(is_error(run("function f { return 1 / 0; }")));
+    EXPECT_TRUE(is_error(run("function f { return 9223372036854775807 + 1; }")));
+    EXPECT_TRUE(is_error(run(R"(function f { return "a" + 1; })")));
+    EXPECT_TRUE(is_error(run("function f { return nil + 1; }")));
+}
+
+TEST(Script, Logic) {
+    EXPECT_EQ(Value{Integer{1}}, run("function f { return 1 < 2 && 2 <= 2; }"));
+    EXPECT_EQ(Value{Integer{0}}, run("function f { return !3; }"));
+    EXPECT_EQ(Value{Integer{1}}, run(R"(function f { return "1" == 1 && nil != 0; })"));
+    // the operand that decides, as in Lua
+    EXPECT_EQ(Value{BulkString{"x"}}, run(R"(function f { return nil || "x"; })"));
+    EXPECT_EQ(nil, run("function f { return nil && 1 / 0; }"));
+}
+
+TEST(Script, Control) {
+    constexpr std::string_view source{
+        R"(
+        function sum {
+            let total = 0;
+            let i = 1;
+            while i <= len(ARGV) {
+                if ARGV[i] == "skip" {
+                } else if ARGV[i] == "stop" {
+                    return total;
+                } else {
+                    total = total + ARGV[i];
+                }
+                i = i + 1;
+            }
+            return total;
+        })"
+    };
+    EXPECT_EQ(Value{Integer{6}}, run(source, {}, {"1", "skip", "2", "3"}));
+    EXPECT_EQ(Value{Integer{1}}, run(source, {}, {"1", "stop", "2"}));
+}
+
+TEST(Script, Scopes) {
+    EXPECT_EQ(Value{Integer{1}}, run("function f { let x = 1; if 1 { let x = 2; } return x; }"));
+    EXPECT_EQ(Value{Integer{3}}, run("function f { let x = 1; if 1 { let x = x + 2; return x; } }"));
+}
+
+TEST(Script, Indexes) {
+    EXPECT_EQ(Value{BulkString{"b"}}, run("function f { return KEYS[2]; }", {"a", "b"}));
+    EXPECT_EQ(Value{BulkString{"b"}}, run("function f { return KEYS[-1]; }", {"a", "b"}));
+    EXPECT_EQ(nil, run("function f { return KEYS[0]; }", {"a", "b"}));
+    EXPECT_EQ(nil, run("function f { return KEYS[3]; }", {"a", "b"}));
+    EXPECT_TRUE(is_error(run("function f { return 1[1]; }")));
+}
+
+TEST(Script, Builtins) {
+    EXPECT_EQ(Value{Integer{0}}, run("function f { return int(nil); }"));
+    EXPECT_EQ(Value{Integer{12}}, run(R"(function f { return int("12"); })"));
+    EXPECT_EQ(Value{BulkString{"12"}}, run("function f { return str(12); }"));
+    EXPECT_EQ(Value{Integer{3}}, run(R"(function f { return len("abc"); })"));
+    EXPECT_TRUE(is_error(run(R"(function f { return int("x"); })")));
+}
+
+TEST(Script, CallsCommands) {
+    FakeHost host{};
+    host.values["from"] = "10";
+    const auto functions = script::compile(R"(
+        function transfer {
+            let balance = int(call("GET", KEYS[1]));
+            if balance < int(ARGV[1]) {
+                return nil;
+            }
+            call("SET", KEYS[1], balance - ARGV[1]);
+            call("SET", KEYS[2], int(call("GET", KEYS[2])) + ARGV[1]);
+            return balance - ARGV[1];
+        })");
+    ASSERT_TRUE(functions.has_value()) << functions.error();
+
+    const std::vector<std::string_view> keys{"from", "to"};
+    const std::vector<std::string_view> amount{"4"};
+    EXPECT_EQ(Value{Integer{6}}, script::run(functions->front(), keys, amount, host, 1000));
+    EXPECT_EQ("6", host.values["from"]);
+    EXPECT_EQ("4", host.values["to"]);
+    EXPECT_EQ((std::vector<std::string>{"SET", "from", "6"}), host.calls[1]);
+
+    const std::vector<std::string_view> too_much{"7"};
+    EXPECT_EQ(nil, script::run(functions->front(), keys, too_much, host, 1000));
+}
+
+TEST(Script, FailingCommandAborts) {
+    const Value reply = run(R"(function f { call("NOPE"); return 1; })");
+    EXPECT_EQ((Value{SimpleError{"ERR", "unknown command"}}), reply);
+    EXPECT_TRUE(is_error(run(R"(function f { return call("GET", KEYS); })")));
+}
+
+TEST(Script, StopsOutOfBudget) {
+    const Value reply = run("function f { while 1 { } }", {}, {}, 1000);
+    ASSERT_TRUE(is_error(reply));
+    EXPECT_NE(std::string::npos, std::get<SimpleError>(reply).value.find("out of budget"));
+
+    EXPECT_EQ(Value{Integer{100}},
+              run("function f { let i = 0; while i < 100 { i = i + 1; } return i; }", {}, {}, 1000));
+}
+
+TEST(Script, ChargesForTheBytesItCopies) {
+    const std::string argument(1024 * 1024, 'x');
+
+    // a few instructions, each joining a megabyte
+    const Value reply = run("function f { let s = nil; while 1 { s = ARGV[1] .. ARGV[1]; } }", {}, {argument},
+                            10'000);
+    ASSERT_TRUE(is_error(reply));
+    EXPECT_NE(std::string::npos, std::get<SimpleError>(reply).value.find("out of budget"));
+
+    // loading a long string or taking its length copies nothing, so costs no more than for a short one
+    EXPECT_EQ(Value{Integer{1024 * 1024}},
+              run("function f { let i = 0; let s = ARGV[1]; while i < 1000 { s = ARGV[1]; i = i + 1; } "
+                  "return len(str(s)); }", {}, {argument}, 100'000));
+}
+
+TEST(Script, StopsHoldingTooMuch) {
+    const Value reply = run(R"(function f { let s = "x"; while 1 { s = s .. s; } })", {}, {}, SIZE_MAX);
+    ASSERT_TRUE(is_error(reply));
+    EXPECT_NE(std::string::npos, std::get<SimpleError>(reply).value.find("out of memory"));
+}
+
+TEST(Script, CompileErrors) {
+    EXPECT_EQ("no functions", compile_error("# nothing\n"));
+    EXPECT_EQ("line 2: expected ';' near '}'", compile_error("function f {\n return 1 }"));
+    EXPECT_EQ("line 1: 'x' is not declared near '='", compile_error("function f { x = 1; }"));
+    EXPECT_EQ("line 1: unknown function 'print' near ';'", compile_error("function f { print(1); }"));
+    EXPECT_EQ("line 1: unterminated string", compile_error(R"(function f { return "a; })"));
+    EXPECT_EQ("line 1: expected a name near 'nil'", compile_error("function f { let nil = 1; }"));
+    EXPECT_FALSE(compile_error("function f { let x = 1; let x = 2; }").empty());
+    EXPECT_FALSE(compile_error("function f { return 99999999999999999999; }").empty());
+    EXPECT_FALSE(compile_error("function f { return " + std::string(1000, '(') + "1" + std::string(1000, ')') +
+                               "; }").empty());
+}
+
+TEST(Script, Library) {
+    script::Library library{};
+    const auto loaded = library.load("function a { return 1; } function b { return 2; }", false);
+    ASSERT_TRUE(loaded.has_value());
+    EXPECT_EQ((std::vector<std::string>{"a", "b"}), *loaded);
+    ASSERT_NE(nullptr, library.find("a"));
+
+    // all or nothing
+    EXPECT_FALSE(library.load("function c { return 3; } function a { return 4; }", false).has_value());
+    EXPECT_EQ(nullptr, library.find("c"));
+    EXPECT_FALSE(library.load("function c { } function c { }", true).has_value());
+
+    EXPECT_TRUE(library.load("function a { return 4; }", true).has_value());
+    FakeHost host{};
+    EXPECT_EQ(Value{Integer{4}}, script::run(*library.find("a"), {}, {}, host, 100));
+
+    EXPECT_TRUE(library.remove("a"));
+    EXPECT_FALSE(library.remove("a"));
+    EXPECT_EQ(std::vector<std::string>{"b"}, library.names());
+}
@@ -0,0 +1,232 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "shm_channel.h"
+
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "connection.h"
+#include "dictionary.h"
+
+namespace {
+    struct Channels {
+        std::unique_ptr<ShmChannel> server;
+        std::unique_ptr<ShmChannel> client;
+    };
+
+    Channels make_channels(const size_t capacity) {
+        int sockets[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+
+        Channels channels{ShmChannel::create(capacity), nullptr};
+        channels.server->offer(sockets[0]);
+        channels.client = ShmChannel::take(sockets[1]);
+
+        close(sockets[0]);
+        close(sockets[1]);
+        return channels;
+    }
+
+    std::string read_all(ShmChannel &channel) {
+        const auto data = channel.readable();
+        std::string result{data.begin(), data.end()};
+        channel.consume(data.size());
+        return result;
+    }
+
+    bool rung(const ShmChannel &channel) {
+        pollfd doorbell{channel.doorbell(), POLLIN, 0};
+        return poll(&doorbell, 1, 0) == 1;
+    }
+
+    // the rings' indices, as a client that does not follow the protocol can get at them: the requests' head and tail
+    // are at 0 and 8, the replies' at 24 and 32, each on its own cache line
+    struct Indices {
+        uint64_t *words;
+
+        explicit Indices(const ShmChannel &server) {
+            int sockets[2];
+            socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+            server.offer(sockets[0]);
+
+            char offer[16];
+            iovec data{offer, sizeof(offer)};
+            alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))]{};
+            msghdr message{};
+            message.msg_iov = &data;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            recvmsg(sockets[1], &message, 0);
+
+            int fds[3];
+            memcpy(fds, CMSG_DATA(CMSG_FIRSTHDR(&message)), sizeof(fds));
+            words = static_cast<uint64_t *>(mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0));
+
+            for (const int fd: {fds[0], fds[1], fds[2], sockets[0], sockets[1]}) {
+                close(fd);
+            }
+        }
+
+        ~Indices() { munmap(words, 4096); }
+
+        uint64_t &request_tail() const { return words[8]; }
+        uint64_t &reply_head() const { return words[24]; }
+    };
+
+    struct Server {
+        EventLoop event_loop{};
+        Dictionary dictionary{};
+        script::Library library{};
+        RequestHandler request_handler{dictionary, library};
+
+        // a connection served over channel, on one end of a socket pair whose other end is closed straight away
+        std::unique_ptr<Connection> connect(std::unique_ptr<ShmChannel> channel) {
+            int sockets[2];
+            socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+            close(sockets[1]);
+            return std::make_unique<Connection>(sockets[0], request_handler, event_loop, Connection::Options{},
+                                                std::move(channel));
+        }
+    };
+}
+
+TEST(ShmChannel, CarriesRequestsAndReplies) {
+    auto [server, client] = make_channels(4096);
+
+    EXPECT_EQ(5u, client->write(std::string_view{"hello"}));
+    EXPECT_EQ("hello", read_all(*server));
+    EXPECT_TRUE(server->readable().empty());
+
+    EXPECT_EQ(5u, server->write(std::string_view{"world"}));
+    EXPECT_EQ("world", read_all(*client));
+}
+
+TEST(ShmChannel, RoundsCapacityUpToPages) {
+    const auto [server, client] = make_channels(100);
+    EXPECT_EQ(4096u, server->capacity());
+    EXPECT_EQ(4096u, client->capacity());
+}
+
+TEST(ShmChannel, ReadableSpanRunsAcrossWrapAround) {
+    auto [server, client] = make_channels(4096);
+
+    const std::string first(3000, 'a');
+    ASSERT_EQ(first.size(), client->write(std::string_view{first}));
+    EXPECT_EQ(first, read_all(*server));
+
+    // starts 3000 bytes in, so it wraps around the end of the ring, yet still comes out in one piece
+    std::string second(2000, 'b');
+    second.back() = 'c';
+    ASSERT_EQ(second.size(), client->write(std::string_view{second}));
+    EXPECT_EQ(second.size(), server->readable().size());
+    EXPECT_EQ(second, read_all(*server));
+}
+
+TEST(ShmChannel, WritesWhatFitsAndAsksForRoom) {
+    auto [server, client] = make_channels(4096);
+
+    const std::string data(5000, 'x');
+    EXPECT_EQ(4096u, client->write(std::string_view{data}));
+    EXPECT_EQ(0u, client->write(std::string_view{data}));
+    EXPECT_FALSE(rung(*client));
+
+    // the client asked to be rung once there is room
+    server->consume(1);
+    EXPECT_TRUE(rung(*client));
+    client->answer_doorbell();
+    EXPECT_FALSE(rung(*client));
+
+    EXPECT_EQ(1u, client->write(std::string_view{data}));
+}
+
+TEST(ShmChannel, RingsOnlyAWaitingReader) {
+    auto [server, client] = make_channels(4096);
+
+    // the first write always rings, since nobody has started reading yet
+    client->write(std::string_view{"first"});
+    EXPECT_TRUE(rung(*server));
+    server->answer_doorbell();
+    read_all(*server);
+
+    client->write(std::string_view{"busy"});
+    EXPECT_FALSE(rung(*server));
+    read_all(*server);
+
+    EXPECT_TRUE(server->expect_data());
+    client->write(std::string_view{"asleep"});
+    EXPECT_TRUE(rung(*server));
+    EXPECT_FALSE(server->expect_data());
+    EXPECT_EQ("asleep", read_all(*server));
+}
+
+TEST(ShmChannel, IovecsAreWrittenInOrder) {
+    auto [server, client] = make_channels(4096);
+
+    char first[]{"abc"};
+    char second[]{"def"};
+    const iovec data[]{{first, 3}, {second, 3}};
+    EXPECT_EQ(6u, server->write(std::span{data}));
+    EXPECT_EQ("abcdef", read_all(*client));
+}
+
+TEST(ShmChannel, TakeRejectsAnythingButAnOffer) {
+    int sockets[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+    ASSERT_EQ(16, write(sockets[0], "not a channel!!!", 16));
+
+    EXPECT_THROW(ShmChannel::take(sockets[1]), std::system_error);
+
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+TEST(ShmChannel, RejectsIndicesNoRingCanHave) {
+    auto [server, client] = make_channels(4096);
+    const Indices indices{*server};
+
+    // more than the ring holds
+    indices.request_tail() = 4097;
+    EXPECT_THROW(static_cast<void>(server->readable()), std::system_error);
+    indices.request_tail() = 0;
+    EXPECT_TRUE(server->readable().empty());
+
+    // a head ahead of the tail, which would have the server write past the end of the ring
+    indices.reply_head() = 1;
+    EXPECT_THROW(server->write(std::string_view{"+OK\r\n"}), std::system_error);
+}
+
+TEST(ShmChannel, CorruptIndicesDisconnect) {
+    Server server{};
+
+    {
+        auto [channel, client] = make_channels(4096);
+        const Indices indices{*channel};
+        const auto connection = server.connect(std::move(channel));
+
+        indices.request_tail() = 1 << 20;
+        connection->handle_doorbell();
+        EXPECT_EQ(nullptr, *connection->self());
+    }
+
+    {
+        auto [channel, client] = make_channels(4096);
+        const Indices indices{*channel};
+        const auto connection = server.connect(std::move(channel));
+
+        client->write(std::string_view{"*1\r\n$4\r\nPING\r\n"});
+        indices.reply_head() = 1;
+        connection->handle_doorbell();
+        EXPECT_EQ(nullptr, *connection->self());
+    }
+}
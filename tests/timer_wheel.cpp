@@ -0,0 +1,142 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "timer_wheel.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr auto tick{10ms};
+    const TimerWheel::Clock::time_point start{};
+}
+
+TEST(TimerWheel, FiresOnceDue) {
+    TimerWheel wheel{tick, start};
+    int fired{0};
+    wheel.schedule(50ms, [&fired] { ++fired; });
+
+    wheel.advance(start + 40ms);
+    EXPECT_EQ(0, fired);
+
+    wheel.advance(start + 50ms);
+    EXPECT_EQ(1, fired);
+    EXPECT_EQ(0u, wheel.size());
+
+    wheel.advance(start + 1s);
+    EXPECT_EQ(1, fired);
+}
+
+TEST(TimerWheel, RoundsUpToWholeTicks) {
+    TimerWheel wheel{tick, start};
+    bool fired{false};
+    wheel.schedule(15ms, [&fired] { fired = true; });
+
+    wheel.advance(start + 15ms);
+    EXPECT_FALSE(fired);
+
+    wheel.advance(start + 20ms);
+    EXPECT_TRUE(fired);
+}
+
+TEST(TimerWheel, FiresInDeadlineOrder) {
+    TimerWheel wheel{tick, start};
+    std::vector<int> order{};
+    wheel.schedule(300ms, [&order] { order.push_back(3); });
+    wheel.schedule(100ms, [&order] { order.push_back(1); });
+    wheel.schedule(200ms, [&order] { order.push_back(2); });
+
+    wheel.advance(start + 1s);
+    EXPECT_EQ((std::vector{1, 2, 3}), order);
+}
+
+TEST(TimerWheel, CascadesFromOuterLevels) {
+    // one timer on each level of the wheel, plus one further out than the wheel reaches
+    const std::vector<std::chrono::seconds> delays{30s, 10min, 10h, 5 * 24h, 200 * 24h};
+
+    TimerWheel wheel{1s, start};
+    std::vector<std::chrono::seconds> fired{};
+    for (const auto delay: delays) {
+        wheel.schedule(delay, [&fired, delay] { fired.push_back(delay); });
+    }
+
+    for (size_t i{0}; i < delays.size(); ++i) {
+        wheel.advance(start + delays[i] - 1s);
+        EXPECT_EQ(i, fired.size());
+
+        wheel.advance(start + delays[i]);
+        ASSERT_EQ(i + 1, fired.size());
+        EXPECT_EQ(delays[i], fired.back());
+    }
+}
+
+TEST(TimerWheel, Cancel) {
+    TimerWheel wheel{tick, start};
+    bool fired{false};
+    const auto id = wheel.schedule(50ms, [&fired] { fired = true; });
+
+    wheel.cancel(id);
+    EXPECT_EQ(0u, wheel.size());
+
+    wheel.advance(start + 1s);
+    EXPECT_FALSE(fired);
+}
+
+TEST(TimerWheel, Repeats) {
+    TimerWheel wheel{tick, start};
+    int fired{0};
+    wheel.schedule_every(100ms, [&fired] { ++fired; });
+
+    wheel.advance(start + 1s);
+    EXPECT_EQ(10, fired);
+    EXPECT_EQ(1u, wheel.size());
+}
+
+TEST(TimerWheel, RepeatingTimerCancelsItself) {
+    TimerWheel wheel{tick, start};
+    int fired{0};
+    TimerWheel::Id id{};
+    id = wheel.schedule_every(100ms, [&] {
+        if (++fired == 3) {
+            wheel.cancel(id);
+        }
+    });
+
+    wheel.advance(start + 1s);
+    EXPECT_EQ(3, fired);
+    EXPECT_EQ(0u, wheel.size());
+}
+
+TEST(TimerWheel, CallbackSchedulesAnother) {
+    TimerWheel wheel{tick, start};
+    bool fired{false};
+    wheel.schedule(100ms, [&] {
+        wheel.schedule(100ms, [&fired] { fired = true; });
+    });
+
+    wheel.advance(start + 150ms);
+    EXPECT_FALSE(fired);
+
+    wheel.advance(start + 200ms);
+    EXPECT_TRUE(fired);
+}
+
+TEST(TimerWheel, UntilNext) {
+    TimerWheel wheel{tick, start};
+    EXPECT_FALSE(wheel.until_next(start).has_value());
+
+    wheel.schedule(50ms, [] {
+    });
+    EXPECT_EQ(50ms, wheel.until_next(start));
+    EXPECT_EQ(20ms, wheel.until_next(start + 30ms));
+    EXPECT_EQ(0ms, wheel.until_next(start + 80ms));
+
+    // a timer on an outer level needs the wheel advanced no later than its next turn
+    TimerWheel far{tick, start};
+    far.schedule(1h, [] {
+    });
+    EXPECT_EQ(640ms, far.until_next(start));
+}
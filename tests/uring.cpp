@@ -0,0 +1,120 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+
+#include "uring.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+#include <sys/socket.h>
+
+namespace {
+    std::unique_ptr<Uring> try_make_ring() {
+        try {
+            return std::make_unique<Uring>(8);
+        } catch (const std::system_error &) {
+            return nullptr;
+        }
+    }
+
+    struct SocketPair {
+        int fds[2]{-1, -1};
+
+        SocketPair() {
+            socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        }
+
+        ~SocketPair() {
+            close(fds[0]);
+            close(fds[1]);
+        }
+    };
+}
+
+TEST(Uring, Nop) {
+    const auto ring = try_make_ring();
+    if (!ring) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    io_uring_sqe &sqe = ring->prepare();
+    sqe.opcode = IORING_OP_NOP;
+    sqe.user_data = 42;
+    ring->submit(1);
+
+    size_t completions{0};
+    ring->for_each_completion([&completions](const io_uring_cqe &cqe) {
+        ++completions;
+        EXPECT_EQ(42u, cqe.user_data);
+        EXPECT_EQ(0, cqe.res);
+    });
+
+    EXPECT_EQ(1u, completions);
+}
+
+TEST(Uring, SubmitsMoreThanQueueDepth) {
+    const auto ring = try_make_ring();
+    if (!ring) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    // the queue holds 8 entries, so preparing the later ones has to flush the earlier ones
+    for (uint64_t i{0}; i < 20; ++i) {
+        io_uring_sqe &sqe = ring->prepare();
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = i + 1;
+    }
+    ring->submit();
+
+    size_t completions{0};
+    while (completions < 20) {
+        ring->submit(1);
+        ring->for_each_completion([&completions](const io_uring_cqe &) { ++completions; });
+    }
+
+    EXPECT_EQ(20u, completions);
+}
+
+TEST(Uring, MultishotReceiveIntoProvidedBuffers) {
+    const auto ring = try_make_ring();
+    if (!ring) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    ring->provide_buffers(0, 4, 16);
+
+    const SocketPair sockets{};
+    io_uring_sqe &sqe = ring->prepare();
+    sqe.opcode = IORING_OP_RECV;
+    sqe.fd = sockets.fds[0];
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = 0;
+    sqe.user_data = 1;
+    ring->submit();
+
+    // more rounds than there are buffers, so recycling has to work for this to keep going
+    for (int round{0}; round < 10; ++round) {
+        constexpr std::string_view message{"hello"};
+        ASSERT_EQ(static_cast<ssize_t>(message.size()), write(sockets.fds[1], message.data(), message.size()));
+
+        std::string received{};
+        while (received.empty()) {
+            ring->submit(1);
+            ring->for_each_completion([&](const io_uring_cqe &cqe) {
+                ASSERT_GT(cqe.res, 0);
+                ASSERT_TRUE(cqe.flags & IORING_CQE_F_BUFFER);
+                EXPECT_TRUE(cqe.flags & IORING_CQE_F_MORE);
+                const auto id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                const auto data = ring->buffer(id, cqe.res);
+                received.append(data.begin(), data.end());
+                ring->recycle(id);
+            });
+        }
+
+        EXPECT_EQ(message, received);
+    }
+}
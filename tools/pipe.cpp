@@ -0,0 +1,303 @@
+//
+// Created by d4wgr on 10/18/2026.
+//
+// Mass insertion, like redis-cli --pipe: streams a file of RESP commands to a running server over one connection,
+// writing as fast as the server takes them in rather than waiting for any reply. Replies are turned off with CLIENT
+// REPLY OFF first, so the server does not spend time on them either, unless --replies asks for them, in which case
+// they are read while writing and the errors among them are counted. Once everything is written, a PING with a marker
+// nobody else would send tells when the server has got through it all.
+//
+//   pipe_loader [--port 6379] [--unix-socket PATH] [--file PATH] [--replies]
+//
+
+#include <charconv>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "command_parser.h"
+#include "resp_parser.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string port{"6379"};
+        std::string unix_socket{};
+        // the commands come from standard input without one
+        std::string file{};
+        bool replies{false};
+    };
+
+    struct Totals {
+        size_t commands{0};
+        size_t bytes{0};
+        size_t errors{0};
+    };
+
+    // how much of the input is read, and written, at once
+    constexpr size_t chunk_size{1024 * 1024};
+
+    std::string bulk(const std::string_view value) {
+        return std::format("${}\r\n{}\r\n", value.size(), value);
+    }
+
+    std::string command(const std::initializer_list<std::string_view> arguments) {
+        std::string data = std::format("*{}\r\n", arguments.size());
+        for (const std::string_view argument: arguments) {
+            data += bulk(argument);
+        }
+        return data;
+    }
+
+    std::string random_marker() {
+        std::random_device device{};
+        return std::format("pipe:{:016x}{:08x}", std::uniform_int_distribution<uint64_t>{}(device), device());
+    }
+
+    int connect_tcp(const std::string &port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *result{};
+        if (getaddrinfo("localhost", port.c_str(), &hints, &result) != 0) {
+            throw std::runtime_error("getaddrinfo failed");
+        }
+
+        const int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+        const int connected = connect(fd, result->ai_addr, result->ai_addrlen);
+        freeaddrinfo(result);
+        if (connected == -1) {
+            throw std::system_error(errno, std::system_category(), "connect");
+        }
+        return fd;
+    }
+
+    int connect_unix(const std::string &path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+            throw std::system_error(errno, std::system_category(), "connect");
+        }
+        return fd;
+    }
+
+    // writes input to the server a chunk at a time, reading its replies in between so neither side ever waits for
+    // the other, and returns once the server has replied to the marker that follows the last of it
+    class Loader {
+    public:
+        Loader(const int socket, const int input, const bool replies): m_socket{socket}, m_input{input},
+                                                                       m_replies{replies} {
+            if (fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL) | O_NONBLOCK) == -1) {
+                throw std::system_error(errno, std::system_category(), "fcntl");
+            }
+            if (!m_replies) {
+                m_pending = command({"CLIENT", "REPLY", "OFF"});
+            }
+        }
+
+        ~Loader() { close(m_socket); }
+
+        Totals run() {
+            while (!m_done) {
+                if (m_written == m_pending.size() && !m_trailer_sent) {
+                    refill();
+                }
+
+                pollfd descriptor{m_socket, POLLIN, 0};
+                if (m_written < m_pending.size()) {
+                    descriptor.events |= POLLOUT;
+                }
+                if (poll(&descriptor, 1, -1) == -1) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::system_error(errno, std::system_category(), "poll");
+                }
+
+                if (descriptor.revents & POLLOUT) {
+                    write_pending();
+                }
+                if (descriptor.revents & (POLLIN | POLLHUP | POLLERR)) {
+                    read_replies();
+                }
+            }
+            return m_totals;
+        }
+
+    private:
+        int m_socket;
+        int m_input;
+        bool m_replies;
+        Totals m_totals{};
+        resp::CommandParser m_commands{};
+        resp::Parser m_parser{};
+        // what is being written, and how much of it has been
+        std::string m_pending{};
+        size_t m_written{0};
+        std::string m_marker{random_marker()};
+        bool m_trailer_sent{false};
+        bool m_done{false};
+        char m_buffer[64 * 1024]{};
+
+        // the next chunk of input, its commands counted on the way, or at the end of it, the marker
+        void refill() {
+            m_pending.resize(chunk_size);
+            m_written = 0;
+
+            const ssize_t result = read(m_input, m_pending.data(), m_pending.size());
+            if (result == -1) {
+                throw std::system_error(errno, std::system_category(), "read input");
+            }
+            m_pending.resize(static_cast<size_t>(result));
+
+            if (result > 0) {
+                m_totals.bytes += m_pending.size();
+                m_commands.feed(m_pending);
+                while (m_commands.next()) {
+                    ++m_totals.commands;
+                }
+                if (m_commands.error().has_value()) {
+                    throw std::runtime_error(std::format("invalid input: {}", *m_commands.error()));
+                }
+                m_commands.keep();
+                return;
+            }
+
+            if (m_commands.pending()) {
+                throw std::runtime_error("invalid input: the last command is incomplete");
+            }
+
+            // with replies off, the PING would not be answered either
+            if (!m_replies) {
+                m_pending = command({"CLIENT", "REPLY", "ON"});
+            }
+            m_pending += command({"PING", m_marker});
+            m_trailer_sent = true;
+        }
+
+        void write_pending() {
+            const ssize_t result = write(m_socket, m_pending.data() + m_written, m_pending.size() - m_written);
+            if (result == -1) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    return;
+                }
+                throw std::system_error(errno, std::system_category(), "write");
+            }
+            m_written += static_cast<size_t>(result);
+        }
+
+        void read_replies() {
+            const ssize_t result = read(m_socket, m_buffer, sizeof(m_buffer));
+            if (result == -1) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    return;
+                }
+                throw std::system_error(errno, std::system_category(), "read");
+            }
+            if (result == 0) {
+                throw std::runtime_error("the server closed the connection");
+            }
+
+            m_parser.feed({m_buffer, static_cast<size_t>(result)});
+            if (m_parser.failed()) {
+                throw std::runtime_error("invalid reply from the server");
+            }
+
+            for (const resp::Value &reply: m_parser.take_values()) {
+                if (const auto *error = std::get_if<resp::SimpleError>(&reply)) {
+                    // the first few are worth seeing, the rest only counting
+                    if (m_totals.errors++ < 10) {
+                        std::cerr << std::format("{} {}\n", error->prefix, error->value);
+                    }
+                } else if (const auto *string = std::get_if<resp::BulkString>(&reply);
+                    string != nullptr && string->value == m_marker) {
+                    m_done = true;
+                }
+            }
+        }
+    };
+
+    template<typename T>
+    bool parse(const std::string_view value, T &result) {
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+        return error == std::errc{} && end == value.data() + value.size();
+    }
+}
+
+int main(const int argc, char *argv[]) {
+    Options options{};
+
+    for (int i{1}; i < argc; ++i) {
+        const std::string_view flag{argv[i]};
+
+        // the one option without a value
+        if (flag == "--replies") {
+            options.replies = true;
+            continue;
+        }
+
+        if (i + 1 == argc) {
+            std::cerr << std::format("Missing value for option '{}'\n", flag);
+            return 1;
+        }
+        const std::string_view value{argv[++i]};
+
+        bool valid{true};
+        if (flag == "--port") {
+            uint16_t port{};
+            valid = parse(value, port);
+            options.port = value;
+        } else if (flag == "--unix-socket") {
+            options.unix_socket = value;
+        } else if (flag == "--file") {
+            options.file = value;
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << std::format("Invalid option '{} {}'\n", flag, value);
+            return 1;
+        }
+    }
+
+    try {
+        const int input = options.file.empty() ? STDIN_FILENO : open(options.file.c_str(), O_RDONLY);
+        if (input == -1) {
+            throw std::system_error(errno, std::system_category(), options.file);
+        }
+
+        const int socket = options.unix_socket.empty() ? connect_tcp(options.port) : connect_unix(options.unix_socket);
+        Loader loader{socket, input, options.replies};
+
+        const auto start = Clock::now();
+        const Totals totals = loader.run();
+        const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+        std::cout << std::format("{} commands, {} errors in {:.2f}s: {:.0f} commands/s, {:.1f}MB/s\n",
+                                 totals.commands, totals.errors, elapsed.count(),
+                                 static_cast<double>(totals.commands) / elapsed.count(),
+                                 static_cast<double>(totals.bytes) / elapsed.count() / (1024 * 1024));
+        if (input != STDIN_FILENO) {
+            close(input);
+        }
+        return totals.errors == 0 ? 0 : 1;
+    } catch (const std::exception &error) {
+        std::cerr << std::format("Loading failed: {}\n", error.what());
+        return 1;
+    }
+}